@@ -15,8 +15,20 @@ source_files=(
     '../src/tokenizer.c'
     '../src/parser.c'
     '../src/linked-list.c'
+    '../src/pool.c'
     '../src/xml-gen.c'
     '../src/code-gen.c'
+    '../src/vm-ir.c'
+    '../src/peephole.c'
+    '../src/optimizer.c'
+    '../src/liveness.c'
+    '../src/cfg.c'
+    '../src/licm.c'
+    '../src/tree-shaker.c'
+    '../src/hack-asm.c'
+    '../src/vm-interpreter.c'
+    '../src/hack-cpu.c'
+    '../src/stack-depth.c'
     '../src/hash-table.c'
     '../src/id-table.c'
 )
@@ -34,4 +46,4 @@ for file in "${files[@]}"; do
     args+=$file' '
 done
 
-clang -g -Wall -o JackAnalyzer $args
+clang -g -Wall -pthread -o JackAnalyzer $args
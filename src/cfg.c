@@ -0,0 +1,370 @@
+#include <stdlib.h>
+#include "cfg.h"
+
+static int *find_leaders(const VM_Function *function, int *blocks_count);
+static void link_blocks(CFG_Graph *graph, const VM_Function *function);
+static void add_edge(CFG_Graph *graph, int from, int to);
+static void number_postorder(CFG_Graph *graph);
+static void find_dominators(CFG_Graph *graph);
+static int intersect(const CFG_Graph *graph, const int *order, int a, int b);
+static void find_loops(CFG_Graph *graph);
+static int loop_with_header(CFG_Graph *graph, int header);
+static void nest_loops(CFG_Graph *graph);
+
+CFG_Graph *cfg_build(const VM_Function *function)
+{
+    CFG_Graph *graph = calloc(1, sizeof(CFG_Graph));
+    int *starts = find_leaders(function, &graph->blocks_count);
+
+    graph->blocks = calloc(graph->blocks_count + 1, sizeof(CFG_Block));
+    graph->instruction_blocks = malloc(sizeof(int) * (function->count + 1));
+
+    for (int i = 0; i < graph->blocks_count; i++) {
+        CFG_Block *block = &graph->blocks[i];
+
+        block->start = starts[i];
+        block->end = i + 1 < graph->blocks_count ? starts[i + 1] : function->count;
+        block->predecessors = malloc(sizeof(int) * (graph->blocks_count + 1));
+        block->immediate_dominator = CFG_NONE;
+        block->loop = CFG_NONE;
+
+        for (int j = block->start; j < block->end; j++) {
+            graph->instruction_blocks[j] = i;
+        }
+    }
+
+    free(starts);
+
+    link_blocks(graph, function);
+    number_postorder(graph);
+    find_dominators(graph);
+    find_loops(graph);
+
+    return graph;
+}
+
+void cfg_free(CFG_Graph *graph)
+{
+    for (int i = 0; i < graph->blocks_count; i++) {
+        free(graph->blocks[i].predecessors);
+    }
+    for (int i = 0; i < graph->loops_count; i++) {
+        free(graph->loops[i].contains);
+    }
+
+    free(graph->blocks);
+    free(graph->instruction_blocks);
+    free(graph->loops);
+    free(graph->postorder);
+    free(graph);
+}
+
+bool cfg_dominates(const CFG_Graph *graph, int dominator, int block)
+{
+    if (!graph->blocks[block].is_reachable) {
+        return false;
+    }
+
+    while (block != CFG_NONE) {
+        if (block == dominator) {
+            return true;
+        }
+        block = graph->blocks[block].immediate_dominator;
+    }
+
+    return false;
+}
+
+bool cfg_loop_contains(const CFG_Graph *graph, int loop, int block)
+{
+    return graph->loops[loop].contains[block];
+}
+
+// A block starts at the first instruction, at every label and right
+// after every jump or return.
+static int *find_leaders(const VM_Function *function, int *blocks_count)
+{
+    int *starts = malloc(sizeof(int) * (function->count + 1));
+    int count = 0;
+
+    for (int i = 0; i < function->count; i++) {
+        VM_Opcode previous = i > 0 ? function->instructions[i - 1].opcode : VM_RETURN;
+
+        if (i == 0 ||
+            function->instructions[i].opcode == VM_LABEL ||
+            previous == VM_GOTO ||
+            previous == VM_IF_GOTO ||
+            previous == VM_RETURN) {
+            starts[count++] = i;
+        }
+    }
+
+    *blocks_count = count;
+
+    return starts;
+}
+
+static void link_blocks(CFG_Graph *graph, const VM_Function *function)
+{
+    int max_label = -1;
+
+    for (int i = 0; i < function->count; i++) {
+        if (function->instructions[i].opcode == VM_LABEL &&
+            function->instructions[i].operand > max_label) {
+            max_label = function->instructions[i].operand;
+        }
+    }
+
+    int *label_blocks = malloc(sizeof(int) * (max_label + 2));
+
+    for (int i = 0; i < function->count; i++) {
+        if (function->instructions[i].opcode == VM_LABEL) {
+            label_blocks[function->instructions[i].operand] = graph->instruction_blocks[i];
+        }
+    }
+
+    for (int i = 0; i < graph->blocks_count; i++) {
+        VM_Instruction last = function->instructions[graph->blocks[i].end - 1];
+
+        if (last.opcode == VM_GOTO || last.opcode == VM_IF_GOTO) {
+            add_edge(graph, i, label_blocks[last.operand]);
+        }
+        if (last.opcode != VM_GOTO && last.opcode != VM_RETURN && i + 1 < graph->blocks_count) {
+            add_edge(graph, i, i + 1);
+        }
+    }
+
+    free(label_blocks);
+}
+
+static void add_edge(CFG_Graph *graph, int from, int to)
+{
+    CFG_Block *block = &graph->blocks[from];
+
+    for (int i = 0; i < block->successors_count; i++) {
+        if (block->successors[i] == to) {
+            return;
+        }
+    }
+
+    block->successors[block->successors_count++] = to;
+
+    CFG_Block *successor = &graph->blocks[to];
+    successor->predecessors[successor->predecessors_count++] = from;
+}
+
+// Depth first from the entry, with an explicit stack of blocks and
+// the next successor to visit for each one.
+static void number_postorder(CFG_Graph *graph)
+{
+    int *stack = malloc(sizeof(int) * (graph->blocks_count + 1));
+    int *next_successor = calloc(graph->blocks_count + 1, sizeof(int));
+    int stack_count = 0;
+
+    graph->postorder = malloc(sizeof(int) * (graph->blocks_count + 1));
+
+    if (graph->blocks_count > 0) {
+        graph->blocks[0].is_reachable = true;
+        stack[stack_count++] = 0;
+    }
+
+    while (stack_count > 0) {
+        int top = stack[stack_count - 1];
+        CFG_Block *block = &graph->blocks[top];
+
+        if (next_successor[top] < block->successors_count) {
+            int successor = block->successors[next_successor[top]++];
+
+            if (!graph->blocks[successor].is_reachable) {
+                graph->blocks[successor].is_reachable = true;
+                stack[stack_count++] = successor;
+            }
+            continue;
+        }
+
+        graph->postorder[graph->reachable_count++] = top;
+        stack_count--;
+    }
+
+    free(stack);
+    free(next_successor);
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm: blocks are
+// visited in reverse postorder, each taking the common dominator of
+// its processed predecessors, until nothing changes.
+static void find_dominators(CFG_Graph *graph)
+{
+    if (graph->reachable_count == 0) {
+        return;
+    }
+
+    int *order = malloc(sizeof(int) * (graph->blocks_count + 1));
+
+    for (int i = 0; i < graph->reachable_count; i++) {
+        order[graph->postorder[i]] = i;
+    }
+
+    graph->blocks[0].immediate_dominator = 0;
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (int i = graph->reachable_count - 2; i >= 0; i--) {
+            CFG_Block *block = &graph->blocks[graph->postorder[i]];
+            int dominator = CFG_NONE;
+
+            for (int j = 0; j < block->predecessors_count; j++) {
+                int predecessor = block->predecessors[j];
+
+                if (graph->blocks[predecessor].immediate_dominator == CFG_NONE) {
+                    continue;
+                }
+                dominator = dominator == CFG_NONE ?
+                    predecessor :
+                    intersect(graph, order, predecessor, dominator);
+            }
+
+            if (block->immediate_dominator != dominator) {
+                block->immediate_dominator = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    // The entry is its own dominator only while the algorithm runs.
+    graph->blocks[0].immediate_dominator = CFG_NONE;
+
+    free(order);
+}
+
+static int intersect(const CFG_Graph *graph, const int *order, int a, int b)
+{
+    while (a != b) {
+        while (order[a] < order[b]) {
+            a = graph->blocks[a].immediate_dominator;
+        }
+        while (order[b] < order[a]) {
+            b = graph->blocks[b].immediate_dominator;
+        }
+    }
+
+    return a;
+}
+
+// An edge into a block that dominates its source is a back edge. The
+// loop's body is collected walking predecessors back from the source
+// until the header.
+static void find_loops(CFG_Graph *graph)
+{
+    int *stack = malloc(sizeof(int) * (graph->blocks_count + 1));
+
+    for (int source = 0; source < graph->blocks_count; source++) {
+        CFG_Block *block = &graph->blocks[source];
+
+        for (int i = 0; i < block->successors_count; i++) {
+            int header = block->successors[i];
+
+            if (!cfg_dominates(graph, header, source)) {
+                continue;
+            }
+
+            int loop_index = loop_with_header(graph, header);
+            CFG_Loop *loop = &graph->loops[loop_index];
+            int stack_count = 0;
+
+            if (!loop->contains[source]) {
+                loop->contains[source] = true;
+                stack[stack_count++] = source;
+            }
+
+            while (stack_count > 0) {
+                CFG_Block *member = &graph->blocks[stack[--stack_count]];
+
+                for (int j = 0; j < member->predecessors_count; j++) {
+                    int predecessor = member->predecessors[j];
+
+                    if (graph->blocks[predecessor].is_reachable &&
+                        !loop->contains[predecessor]) {
+                        loop->contains[predecessor] = true;
+                        stack[stack_count++] = predecessor;
+                    }
+                }
+            }
+        }
+    }
+
+    free(stack);
+    nest_loops(graph);
+}
+
+static int loop_with_header(CFG_Graph *graph, int header)
+{
+    for (int i = 0; i < graph->loops_count; i++) {
+        if (graph->loops[i].header == header) {
+            return i;
+        }
+    }
+
+    graph->loops = realloc(graph->loops, sizeof(CFG_Loop) * (graph->loops_count + 1));
+
+    CFG_Loop *loop = &graph->loops[graph->loops_count];
+    loop->header = header;
+    loop->parent = CFG_NONE;
+    loop->depth = 0;
+    loop->contains = calloc(graph->blocks_count, sizeof(bool));
+    loop->contains[header] = true;
+    loop->blocks_count = 0;
+
+    return graph->loops_count++;
+}
+
+// Natural loops are either nested or disjoint, so a loop's parent is
+// the smallest other loop containing its header, and a block belongs
+// to the smallest loop containing it.
+static void nest_loops(CFG_Graph *graph)
+{
+    for (int i = 0; i < graph->loops_count; i++) {
+        for (int block = 0; block < graph->blocks_count; block++) {
+            graph->loops[i].blocks_count += graph->loops[i].contains[block];
+        }
+    }
+
+    for (int i = 0; i < graph->loops_count; i++) {
+        CFG_Loop *loop = &graph->loops[i];
+
+        for (int j = 0; j < graph->loops_count; j++) {
+            CFG_Loop *other = &graph->loops[j];
+
+            if (j == i || !other->contains[loop->header]) {
+                continue;
+            }
+
+            loop->depth++;
+            if (loop->parent == CFG_NONE ||
+                other->blocks_count < graph->loops[loop->parent].blocks_count) {
+                loop->parent = j;
+            }
+        }
+        loop->depth++;
+    }
+
+    for (int block = 0; block < graph->blocks_count; block++) {
+        CFG_Block *cfg_block = &graph->blocks[block];
+
+        for (int i = 0; i < graph->loops_count; i++) {
+            CFG_Loop *loop = &graph->loops[i];
+
+            if (!loop->contains[block]) {
+                continue;
+            }
+
+            cfg_block->loop_depth++;
+            if (cfg_block->loop == CFG_NONE ||
+                loop->blocks_count < graph->loops[cfg_block->loop].blocks_count) {
+                cfg_block->loop = i;
+            }
+        }
+    }
+}
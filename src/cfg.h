@@ -0,0 +1,54 @@
+#ifndef CFG_CFG
+#define CFG_CFG
+
+#include <stdbool.h>
+#include "vm-ir.h"
+
+#define CFG_MAX_SUCCESSORS 2
+#define CFG_NONE -1
+
+// Straight-line run of instructions [start, end). Only its first
+// instruction can be jumped to and only its last one can jump.
+typedef struct {
+    int start;
+    int end;
+    int successors[CFG_MAX_SUCCESSORS];
+    int successors_count;
+    int *predecessors;
+    int predecessors_count;
+    bool is_reachable;
+    int immediate_dominator;
+    int loop;
+    int loop_depth;
+} CFG_Block;
+
+// Natural loop: the header plus every block that reaches one of the
+// header's back edges without going through the header. Back edges
+// sharing a header form a single loop.
+typedef struct {
+    int header;
+    int parent;
+    int depth;
+    bool *contains;
+    int blocks_count;
+} CFG_Loop;
+
+// Blocks are numbered in instruction order, so block 0 is the entry.
+// Unreachable blocks have no dominator and belong to no loop.
+typedef struct {
+    CFG_Block *blocks;
+    int blocks_count;
+    int *instruction_blocks;
+    CFG_Loop *loops;
+    int loops_count;
+    int *postorder;
+    int reachable_count;
+} CFG_Graph;
+
+CFG_Graph *cfg_build(const VM_Function *function);
+void cfg_free(CFG_Graph *graph);
+
+bool cfg_dominates(const CFG_Graph *graph, int dominator, int block);
+bool cfg_loop_contains(const CFG_Graph *graph, int loop, int block);
+
+#endif
@@ -1,72 +1,202 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include "code-gen.h"
 #include "file-handler.h"
+#include "hack-asm.h"
 #include "id-table.h"
+#include "licm.h"
 #include "linked-list.h"
-
-#define STR_BUFF_SIZE 10000
-
-static FILE *code_file;
+#include "liveness.h"
+#include "optimizer.h"
+#include "peephole.h"
+#include "stack-depth.h"
+#include "tree-shaker.h"
+#include "vm-ir.h"
+
+#define CG_MAX_MULTIPLY_COST    48
+#define CG_MULTIPLICAND_TEMP    1
+#define CG_PRODUCT_TEMP         2
+#define CG_MIN_DISPATCH_CASES   5
+#define CG_MAX_DISPATCH_LEAF    2
+
+// String literal pooled into a static slot.
+typedef struct {
+    char *literal;
+    int slot;
+} CG_Pooled_string;
+
+// Arm of an if/else-if chain testing a variable against a constant.
+typedef struct {
+    int value;
+    int label;
+    LL_List statements;
+} CG_Dispatch_case;
+
+static CG_Options options;
+static VM_Class *ir;
+static VM_Function *function;
 static char *class_name;
 static char *subroutine_name;
 static Parser_subroutine_dec subroutine_dec;
-static int label_count;
-static short indent_level;
-
-static void gen_subroutine_code(Parser_subroutine_dec subroutine, Parser_class_dec class);
+static CG_Pooled_string *pooled_strings;
+static int pooled_strings_count;
+static int pooled_strings_capacity;
+static int next_pool_slot = -1;
+static VM_Class **program;
+static int program_count;
+static int program_capacity;
+static int statement_line;
+static int output_line = 1;
+
+static void gen_subroutine_code(Parser_subroutine_dec subroutine);
 
 static void gen_statement_code(Parser_statement statement);
 static void gen_do_code(Parser_do_statement do_statement);
 static void gen_let_code(Parser_let_statement let_statement);
 static void gen_if_code(Parser_if_statement if_statement);
 static void gen_while_code(Parser_while_statement while_statement);
+static void gen_branching_if_code(Parser_if_statement if_statement);
+static void gen_rotated_while_code(Parser_while_statement while_statement);
+static void gen_statements_code(LL_List statements);
+static bool gen_dispatch_code(Parser_if_statement if_statement);
+static void gen_dispatch_tree_code(
+    Parser_term_var_usage *var_usage,
+    CG_Dispatch_case *cases,
+    int first,
+    int last,
+    int default_label
+);
+static Parser_term_var_usage *dispatch_case(Parser_expression *conditional, int *value);
+static int compare_dispatch_cases(const void *a, const void *b);
 static void gen_return_code(Parser_return_statement return_statement);
 
 static void gen_expression_code(Parser_expression *expr);
 static void gen_term_code(Parser_term *term);
 static void gen_string_code(char *str);
+static void gen_new_string_code(char *str);
+static void gen_pooled_string_code(char *str);
+static int pool_slot(char *str);
 static void gen_keyword_code(Parser_term_keyword_constant keyword);
 static void gen_var_usage_code(Parser_term_var_usage *var_usage);
-static void gen_subroutine_call_code(Parser_term_subroutine_call call);
+static void gen_subroutine_call_code(Parser_term_subroutine_call call, bool is_statement);
 static void gen_sub_term_code(Parser_sub_term *sub_term);
 static void gen_operator_code(Parser_term_operator operator);
 static void gen_unary_operator_code(Parser_term_operator operator);
-
-static char *idt_category_name(IDT_Category category);
+static bool gen_constant_operation_code(Parser_term_operator operator, Parser_term *term);
+static void gen_multiply_code(int factor);
+static int multiply_cost(int factor);
+static bool term_constant(Parser_term *term, int *value);
+static bool is_boolean_expression(Parser_expression *expr);
+static bool is_boolean_term(Parser_term *term);
+
+static VM_Segment category_segment(IDT_Category category);
 static IDT_Entry *search_var(char *class, char *subroutine, char *name);
-static void unique_label(char *buff);
-
-static void write(const char *str);
+static int unique_label(void);
+static void exit_gen(const char *format, ...);
+
+static void emit_push(VM_Segment segment, int index);
+static void emit_pop(VM_Segment segment, int index);
+static void emit_push_value(int value);
+static void emit_push_constant(const char *integer);
+static void emit_call(const char *class, const char *name, int args_count);
+static void emit_function(const char *name, int locals_count);
+static void emit_label(VM_Opcode opcode, int label);
+static void emit(VM_Opcode opcode);
+
+static void write_class(FILE *file, VM_Class *class_ir);
+static int write_stack_comments(FILE *file, const VM_Class *class_ir);
+static void put(FH_Sink *sink, const char *str);
+
+void cg_set_options(CG_Options cg_options)
+{
+    options = cg_options;
+}
 
 void cg_gen_code(FILE *file, Parser_jack_syntax *ast)
 {
-    code_file = file;
-    class_name = ast->class_dec.name;
-    label_count = 0;
-    indent_level = 0;
-    
-    Parser_class_dec class = ast->class_dec;
+    if (options.optimize) {
+        opt_fold_constants(ast);
+        opt_eliminate_dead_code(ast);
+    }
+
+    VM_Class *class_ir = cg_gen_ir(ast);
 
-    char comment[STR_BUFF_SIZE];
-    sprintf(comment, "// compiled %s.jack", class_name);
-    write(comment);
+    if (options.optimize) {
+        ph_optimize(class_ir);
+        licm_hoist(class_ir);
+        lv_compact_locals(class_ir);
+    }
 
-    if (class.subroutines.head == NULL) {
+    if (options.tree_shake || options.emit_asm) {
+        cg_add_class(class_ir);
         return;
     }
 
+    write_class(file, class_ir);
+    vm_free_class(class_ir);
+}
+
+void cg_add_class(VM_Class *class_ir)
+{
+    if (program_count == program_capacity) {
+        program_capacity = program_capacity == 0 ? 8 : program_capacity * 2;
+        program = realloc(program, sizeof(VM_Class *) * program_capacity);
+    }
+
+    program[program_count++] = class_ir;
+}
+
+void cg_finish(FILE *file)
+{
+    if (options.tree_shake) {
+        ts_shake(program, program_count);
+    }
+
+    if (options.emit_asm) {
+        for (int i = 0; i < program_count && options.analyze_stack; i++) {
+            sd_analyze(program[i]);
+        }
+        ha_write_program(file, program, program_count);
+    } else {
+        for (int i = 0; i < program_count; i++) {
+            if (program[i]->functions_count > 0) {
+                write_class(file, program[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < program_count; i++) {
+        vm_free_class(program[i]);
+    }
+
+    free(program);
+    program = NULL;
+    program_count = 0;
+    program_capacity = 0;
+}
+
+VM_Class *cg_gen_ir(Parser_jack_syntax *ast)
+{
+    class_name = ast->class_dec.name;
+    ir = vm_make_class(class_name);
+    function = NULL;
+    pooled_strings_count = 0;
+    
+    Parser_class_dec class = ast->class_dec;
+
     LL_Node *node = class.subroutines.head;
     while (node != NULL) {
-        gen_subroutine_code(*(Parser_subroutine_dec *)node->data, class);
+        gen_subroutine_code(*(Parser_subroutine_dec *)node->data);
         node = node->next;
     }
+
+    return ir;
 }
 
-static void gen_subroutine_code(Parser_subroutine_dec subroutine, Parser_class_dec class)
+static void gen_subroutine_code(Parser_subroutine_dec subroutine)
 {
-    indent_level = 0;
-    char vm_func[STR_BUFF_SIZE];
-
     short vars_count = 0;
     LL_Node *node = subroutine.vars.head;
     while (node != NULL) {
@@ -80,51 +210,23 @@ static void gen_subroutine_code(Parser_subroutine_dec subroutine, Parser_class_d
         node = node->next;
     }
 
-    sprintf(
-        vm_func, 
-        "function %s.%s %d", 
-        class_name,
-        subroutine.name, 
-        vars_count
-    );
-    write(vm_func);
+    emit_function(subroutine.name, vars_count);
 
     subroutine_name = subroutine.name;
     subroutine_dec = subroutine;
-    indent_level = 1;
 
     if (subroutine.scope == PARSER_FUNC_CONSTRUCTOR) {
-        short fields_count = 0;
-        node = class.vars.head;
-
-        while (node != NULL) {
-            Parser_class_var_dec *class_var = (Parser_class_var_dec *)node->data;
-
-            if (class_var != NULL && class_var->scope == PARSER_VAR_FIELD) {
-                if (class_var->names.count > 1) {
-                    fields_count += class_var->names.count;
-                } else {
-                    fields_count++;
-                }
-            }
-
-            node = node->next;
-        }
+        IDT_Class_Entry *class_entry = idt_class(class_name);
+        short fields_count = class_entry != NULL ? class_entry->fields_count : 0;
 
-        char command_buff[STR_BUFF_SIZE];
-        sprintf(
-            command_buff,
-            "push constant %d",
-            fields_count
-        );
-        write(command_buff);
-        write("call Memory.alloc 1");
-        write("pop pointer 0");
+        emit_push(VM_SEGMENT_CONSTANT, fields_count);
+        emit_call("Memory", "alloc", 1);
+        emit_pop(VM_SEGMENT_POINTER, 0);
     }
 
     if (subroutine.scope == PARSER_FUNC_METHOD) {
-        write("push argument 0");
-        write("pop pointer 0");
+        emit_push(VM_SEGMENT_ARGUMENT, 0);
+        emit_pop(VM_SEGMENT_POINTER, 0);
     }
 
     node = subroutine.statements.head;
@@ -134,8 +236,13 @@ static void gen_subroutine_code(Parser_subroutine_dec subroutine, Parser_class_d
     }
 }
 
+// Instructions are tagged with the line of the innermost statement
+// being generated, so the jumps closing an if or a while belong to it.
 static void gen_statement_code(Parser_statement statement)
 {
+    int enclosing_line = statement_line;
+    statement_line = statement.line;
+
     if (statement.do_statement != NULL) {
         gen_do_code(*statement.do_statement);
 
@@ -151,12 +258,14 @@ static void gen_statement_code(Parser_statement statement)
     } else if (statement.return_statement != NULL) {
         gen_return_code(*statement.return_statement);
     }
+
+    statement_line = enclosing_line;
 }
 
 static void gen_do_code(Parser_do_statement do_statement)
 {
-    gen_subroutine_call_code(do_statement.subroutine_call);
-    write("pop temp 0");
+    gen_subroutine_call_code(do_statement.subroutine_call, true);
+    emit_pop(VM_SEGMENT_TEMP, 0);
 }
 
 static void gen_let_code(Parser_let_statement let_statement)
@@ -169,48 +278,37 @@ static void gen_let_code(Parser_let_statement let_statement)
         let_statement.var_name
     );
     if (entry != NULL) {
-        char command[STR_BUFF_SIZE];
+        VM_Segment segment = category_segment(entry->var->category);
 
         if (let_statement.has_subscript) {
-            sprintf(
-                command, 
-                "push %s %d", 
-                idt_category_name(entry->var->category), 
-                entry->var->index
-            );
-            write(command);
+            emit_push(segment, entry->var->index);
             gen_expression_code(&let_statement.subscript);
-            write("add");
-            write("pop pointer 1");
-            write("pop that 0");
+            emit(VM_ADD);
+            emit_pop(VM_SEGMENT_POINTER, 1);
+            emit_pop(VM_SEGMENT_THAT, 0);
 
         } else {
-            sprintf(
-                command,
-                "pop %s %d",
-                idt_category_name(entry->var->category),
-                entry->var->index
-            );
-            write(command);
+            emit_pop(segment, entry->var->index);
         }
     }
 }
 
 static void gen_if_code(Parser_if_statement if_statement)
 {
-    char else_label_buff[STR_BUFF_SIZE];
-    char end_label_buff[STR_BUFF_SIZE];
-    unique_label(else_label_buff);
-    unique_label(end_label_buff);
+    if (options.optimize) {
+        gen_branching_if_code(if_statement);
+        return;
+    }
+
+    int else_label = unique_label();
+    int end_label = unique_label();
 
     // VM code for computing expression
     gen_expression_code(&if_statement.conditional);
     gen_unary_operator_code(PARSER_TERM_OP_NOT);
 
     // if-goto else_statement (~cond) 
-    char command_buff[STR_BUFF_SIZE];
-    sprintf(command_buff, "if-goto %s", else_label_buff);
-    write(command_buff);
+    emit_label(VM_IF_GOTO, else_label);
 
     // inside if-branch
     LL_Node *statement_node = if_statement.conditional_statements.head;
@@ -219,12 +317,10 @@ static void gen_if_code(Parser_if_statement if_statement)
         statement_node = statement_node->next;
     }
     
-    sprintf(command_buff, "goto %s", end_label_buff);
-    write(command_buff);
+    emit_label(VM_GOTO, end_label);
 
     // inside else-branch
-    sprintf(command_buff, "label %s", else_label_buff);
-    write(command_buff);
+    emit_label(VM_LABEL, else_label);
 
     statement_node = if_statement.else_statements.head;
     while (statement_node != NULL) {
@@ -233,38 +329,36 @@ static void gen_if_code(Parser_if_statement if_statement)
     }
 
     // end if-else marker label
-    sprintf(command_buff, "label %s", end_label_buff);
-    write(command_buff);
+    emit_label(VM_LABEL, end_label);
 }
 
 static void gen_while_code(Parser_while_statement while_statement)
 {
-    char start_buff[STR_BUFF_SIZE];
-    char end_buff[STR_BUFF_SIZE];
-    unique_label(start_buff);
-    unique_label(end_buff);
+    Parser_expression *conditional = &while_statement.conditional;
+    Parser_term *first_term = conditional->terms.head->data;
+
+    // Loops on true or false are left to the dead code and peephole
+    // passes, which reduce them to a single jump or nothing.
+    if (options.optimize &&
+        is_boolean_expression(conditional) &&
+        !(conditional->terms.count == 1 && 
+          first_term->keyword_value != PARSER_TERM_KEYWORD_UNDEFINED)) {
+        gen_rotated_while_code(while_statement);
+        return;
+    }
 
-    char vm_command_buff[STR_BUFF_SIZE];
+    int start_label = unique_label();
+    int end_label = unique_label();
 
     // Mark beginning of while
-    sprintf(
-        vm_command_buff,
-        "label %s",
-        start_buff
-    );
-    write(vm_command_buff);
+    emit_label(VM_LABEL, start_label);
 
     // Gen expression for while ~cond
     gen_expression_code(&while_statement.conditional);
     gen_unary_operator_code(PARSER_TERM_OP_NOT);
 
     // Goto end if ~cond
-    sprintf(
-        vm_command_buff,
-        "if-goto %s",
-        end_buff
-    );
-    write(vm_command_buff);
+    emit_label(VM_IF_GOTO, end_label);
 
     // Statements inside while
     LL_Node *statement_node = while_statement.statements.head;
@@ -274,55 +368,292 @@ static void gen_while_code(Parser_while_statement while_statement)
     }
 
     // Begin next iteration
-    sprintf(
-        vm_command_buff,
-        "goto %s",
-        start_buff
-    );
-    write(vm_command_buff);
+    emit_label(VM_GOTO, start_label);
 
     // Mark end of while
-    sprintf(
-        vm_command_buff,
-        "label %s",
-        end_buff
+    emit_label(VM_LABEL, end_label);
+}
+
+// The taken arm of an if only runs when the condition is exactly true
+// (-1), so branching on the condition itself, which saves the `not`,
+// is only done when it can't be anything but true or false:
+//
+//     cond                        cond
+//     if-goto THEN                not
+//     <else statements>           if-goto END
+//     goto END                    <statements>
+//     label THEN                  label END
+//     <statements>
+//     label END
+//
+// Ifs without else statements take the second shape, which needs no
+// jump over the else arm.
+static void gen_branching_if_code(Parser_if_statement if_statement)
+{
+    if (gen_dispatch_code(if_statement)) {
+        return;
+    }
+
+    int end_label = unique_label();
+
+    if (if_statement.else_statements.count == 0) {
+        gen_expression_code(&if_statement.conditional);
+        gen_unary_operator_code(PARSER_TERM_OP_NOT);
+        emit_label(VM_IF_GOTO, end_label);
+        gen_statements_code(if_statement.conditional_statements);
+        emit_label(VM_LABEL, end_label);
+        return;
+    }
+
+    int branch_label = unique_label();
+    bool is_boolean = is_boolean_expression(&if_statement.conditional);
+
+    gen_expression_code(&if_statement.conditional);
+
+    if (!is_boolean) {
+        gen_unary_operator_code(PARSER_TERM_OP_NOT);
+    }
+    emit_label(VM_IF_GOTO, branch_label);
+
+    gen_statements_code(
+        is_boolean ? if_statement.else_statements : if_statement.conditional_statements
+    );
+    emit_label(VM_GOTO, end_label);
+
+    emit_label(VM_LABEL, branch_label);
+    gen_statements_code(
+        is_boolean ? if_statement.conditional_statements : if_statement.else_statements
     );
-    write(vm_command_buff);
+
+    emit_label(VM_LABEL, end_label);
+}
+
+// Loop with the test at the bottom, so each iteration runs a single
+// if-goto instead of `not`, if-goto and the jump back:
+//
+//     goto TEST
+//     label BODY
+//     <statements>
+//     label TEST
+//     cond
+//     if-goto BODY
+static void gen_rotated_while_code(Parser_while_statement while_statement)
+{
+    int body_label = unique_label();
+    int test_label = unique_label();
+
+    emit_label(VM_GOTO, test_label);
+    emit_label(VM_LABEL, body_label);
+    gen_statements_code(while_statement.statements);
+
+    emit_label(VM_LABEL, test_label);
+    gen_expression_code(&while_statement.conditional);
+    emit_label(VM_IF_GOTO, body_label);
+}
+
+static void gen_statements_code(LL_List statements)
+{
+    LL_Node *statement_node = statements.head;
+
+    while (statement_node != NULL) {
+        gen_statement_code(*(Parser_statement *)statement_node->data);
+        statement_node = statement_node->next;
+    }
+}
+
+// Chains like `if (x = 3) {...} else { if (x = 7) {...} else {...} }`
+// on the same variable are lowered to a balanced tree of `lt` tests
+// on the sorted constants, ending in one or two `eq` tests, followed
+// by the arms' bodies. Shorter chains are cheaper tested in order.
+static bool gen_dispatch_code(Parser_if_statement if_statement)
+{
+    Parser_if_statement *statement = &if_statement;
+    Parser_term_var_usage *var_usage = NULL;
+    CG_Dispatch_case *cases = NULL;
+    int count = 0;
+    LL_List default_statements;
+
+    while (true) {
+        int value;
+        Parser_term_var_usage *tested = dispatch_case(&statement->conditional, &value);
+
+        if (tested == NULL ||
+            (var_usage != NULL && strcmp(tested->var_name, var_usage->var_name) != 0)) {
+            break;
+        }
+        var_usage = tested;
+
+        bool is_duplicate = false;
+        for (int i = 0; i < count; i++) {
+            is_duplicate |= cases[i].value == value;
+        }
+
+        // A repeated constant can never reach its arm.
+        if (!is_duplicate) {
+            cases = realloc(cases, sizeof(CG_Dispatch_case) * (count + 1));
+            cases[count++] = (CG_Dispatch_case){ 
+                value, 
+                unique_label(), 
+                statement->conditional_statements 
+            };
+        }
+
+        default_statements = statement->else_statements;
+
+        Parser_statement *next = default_statements.count == 1 ?
+            (Parser_statement *)default_statements.head->data :
+            NULL;
+
+        if (next == NULL || next->if_statement == NULL) {
+            break;
+        }
+        statement = next->if_statement;
+    }
+
+    if (count < CG_MIN_DISPATCH_CASES) {
+        free(cases);
+        return false;
+    }
+
+    int default_label = unique_label();
+    int end_label = unique_label();
+
+    qsort(cases, count, sizeof(CG_Dispatch_case), compare_dispatch_cases);
+    gen_dispatch_tree_code(var_usage, cases, 0, count - 1, default_label);
+
+    for (int i = 0; i < count; i++) {
+        emit_label(VM_LABEL, cases[i].label);
+        gen_statements_code(cases[i].statements);
+        emit_label(VM_GOTO, end_label);
+    }
+
+    emit_label(VM_LABEL, default_label);
+    gen_statements_code(default_statements);
+    emit_label(VM_LABEL, end_label);
+
+    free(cases);
+
+    return true;
+}
+
+static void gen_dispatch_tree_code(
+    Parser_term_var_usage *var_usage,
+    CG_Dispatch_case *cases,
+    int first,
+    int last,
+    int default_label
+) {
+    if (last - first < CG_MAX_DISPATCH_LEAF) {
+        for (int i = first; i <= last; i++) {
+            gen_var_usage_code(var_usage);
+            emit_push_value(cases[i].value);
+            emit(VM_EQ);
+            emit_label(VM_IF_GOTO, cases[i].label);
+        }
+        emit_label(VM_GOTO, default_label);
+        return;
+    }
+
+    int middle = (first + last + 1) / 2;
+    int lower_label = unique_label();
+
+    gen_var_usage_code(var_usage);
+    emit_push_value(cases[middle].value);
+    emit(VM_LT);
+    emit_label(VM_IF_GOTO, lower_label);
+
+    gen_dispatch_tree_code(var_usage, cases, middle, last, default_label);
+    emit_label(VM_LABEL, lower_label);
+    gen_dispatch_tree_code(var_usage, cases, first, middle - 1, default_label);
+}
+
+// The variable tested by `var = constant` or `constant = var`, or NULL
+// when the condition has another shape.
+static Parser_term_var_usage *dispatch_case(Parser_expression *conditional, int *value)
+{
+    if (conditional->terms.count != 2 ||
+        *(Parser_term_operator *)conditional->operators.head->data != PARSER_TERM_OP_ASSIGN) {
+        return NULL;
+    }
+
+    Parser_term *left = conditional->terms.head->data;
+    Parser_term *right = conditional->terms.head->next->data;
+
+    if (term_constant(left, value)) {
+        Parser_term *swap = left;
+        left = right;
+        right = swap;
+    } else if (!term_constant(right, value)) {
+        return NULL;
+    }
+
+    if (left->var_usage == NULL || left->var_usage->subscript != NULL) {
+        return NULL;
+    }
+
+    return left->var_usage;
+}
+
+static int compare_dispatch_cases(const void *a, const void *b)
+{
+    return ((const CG_Dispatch_case *)a)->value - ((const CG_Dispatch_case *)b)->value;
 }
 
 static void gen_return_code(Parser_return_statement return_statement)
 {
     if (subroutine_dec.scope == PARSER_FUNC_CONSTRUCTOR) {
-        write("push pointer 0");
+        emit_push(VM_SEGMENT_POINTER, 0);
 
     } else if (return_statement.has_expr) {
         gen_expression_code(&return_statement.expression);
 
     } else {
-        write("push constant 0");
+        emit_push(VM_SEGMENT_CONSTANT, 0);
     }
 
-    write("return");
+    emit(VM_RETURN);
 }
 
 static void gen_expression_code(Parser_expression *expr)
 {
     LL_Node *term_node = expr->terms.head;
-    LL_Node *op_node = NULL;
+    LL_Node *op_node = expr->operators.head;
+    int factor;
+    int value;
 
-    while (term_node != NULL) {
-        // push term
-        gen_term_code((Parser_term *)term_node->data);
+    if (term_node == NULL) {
+        return;
+    }
 
+    // c * t yields the same as t * c, which can be strength reduced.
+    if (options.optimize &&
+        op_node != NULL &&
+        *(Parser_term_operator *)op_node->data == PARSER_TERM_OP_MULTIPLICATION &&
+        term_constant((Parser_term *)term_node->data, &factor) &&
+        !term_constant((Parser_term *)term_node->next->data, &value) &&
+        multiply_cost(factor) <= CG_MAX_MULTIPLY_COST) {
+        gen_term_code((Parser_term *)term_node->next->data);
+        gen_multiply_code(factor);
+
+        term_node = term_node->next->next;
+        op_node = op_node->next;
+    } else {
+        // push first term
+        gen_term_code((Parser_term *)term_node->data);
         term_node = term_node->next;
+    }
+
+    while (term_node != NULL) {
+        Parser_term_operator operator = *(Parser_term_operator *)op_node->data;
+        Parser_term *term = (Parser_term *)term_node->data;
 
-        if (op_node == NULL) {
-            op_node = expr->operators.head;
-            continue;
+        if (!options.optimize || !gen_constant_operation_code(operator, term)) {
+            // push term, then apply vm function
+            gen_term_code(term);
+            gen_operator_code(operator);
         }
 
-        // apply vm function
-        gen_operator_code(*(Parser_term_operator *)op_node->data);
+        term_node = term_node->next;
         op_node = op_node->next;
     }
 }
@@ -330,13 +661,7 @@ static void gen_expression_code(Parser_expression *expr)
 static void gen_term_code(Parser_term *term)
 {
     if (term->integer != NULL) {
-        char const_push[STR_BUFF_SIZE];
-        sprintf(
-            const_push, 
-            "push constant %s", 
-            term->integer
-        );
-        write(const_push);
+        emit_push_constant(term->integer);
 
     } else if (term->string != NULL) {
         gen_string_code(term->string);
@@ -348,7 +673,7 @@ static void gen_term_code(Parser_term *term)
         gen_var_usage_code(term->var_usage);
 
     } else if (term->subroutine_call != NULL) {
-        gen_subroutine_call_code(*term->subroutine_call);
+        gen_subroutine_call_code(*term->subroutine_call, false);
 
     } else if (term->parenthesized_expression != NULL) {
         gen_expression_code(term->parenthesized_expression);
@@ -359,41 +684,95 @@ static void gen_term_code(Parser_term *term)
 }
 
 static void gen_string_code(char *str)
+{
+    // "" builds no string object, so it has nothing to pool.
+    if (options.pool_strings && strlen(str) > 2) {
+        gen_pooled_string_code(str);
+    } else {
+        gen_new_string_code(str);
+    }
+}
+
+static void gen_new_string_code(char *str)
 {
     short len = strlen(str);
     short i;
-    char command[STR_BUFF_SIZE];
 
     if (len == 2) { // "" (empty literal)
         return;
     }
 
-    sprintf(command, "push constant %d", len - 2);
-    write(command);
-    write("call String.new 1");
+    emit_push(VM_SEGMENT_CONSTANT, len - 2);
+    emit_call("String", "new", 1);
 
     for (i = 1; i < len - 1; i++) {
         char c = str[i];
-        sprintf(command, "push constant %d", (short)c);
-        write(command);
-        write("call String.appendChar 2");
+        emit_push(VM_SEGMENT_CONSTANT, (short)c);
+        emit_call("String", "appendChar", 2);
     }
 }
 
+// The string is built on first use only and kept in a static slot:
+// later evaluations find the slot set and just push it.
+static void gen_pooled_string_code(char *str)
+{
+    int slot = pool_slot(str);
+    int ready_label = unique_label();
+
+    emit_push(VM_SEGMENT_STATIC, slot);
+    emit_label(VM_IF_GOTO, ready_label);
+    gen_new_string_code(str);
+    emit_pop(VM_SEGMENT_STATIC, slot);
+    emit_label(VM_LABEL, ready_label);
+    emit_push(VM_SEGMENT_STATIC, slot);
+}
+
+// Literals are deduplicated per class. Every class is written to the
+// same VM file, which has a single static segment, so slots are
+// numbered across the project, past the statics of every class.
+static int pool_slot(char *str)
+{
+    for (int i = 0; i < pooled_strings_count; i++) {
+        if (strcmp(pooled_strings[i].literal, str) == 0) {
+            return pooled_strings[i].slot;
+        }
+    }
+
+    if (next_pool_slot < 0) {
+        next_pool_slot = idt_max_statics_count();
+    }
+
+    if (pooled_strings_count == pooled_strings_capacity) {
+        pooled_strings_capacity = pooled_strings_capacity > 0 ? 
+            pooled_strings_capacity * 2 : 
+            16;
+        pooled_strings = realloc(
+            pooled_strings, 
+            sizeof(CG_Pooled_string) * pooled_strings_capacity
+        );
+    }
+
+    CG_Pooled_string *pooled = &pooled_strings[pooled_strings_count++];
+    pooled->literal = str;
+    pooled->slot = next_pool_slot++;
+
+    return pooled->slot;
+}
+
 static void gen_keyword_code(Parser_term_keyword_constant keyword)
 {
     if (keyword == PARSER_TERM_KEYWORD_TRUE) {
-        write("push constant 1");
-        write("neg");
+        emit_push(VM_SEGMENT_CONSTANT, 1);
+        emit(VM_NEG);
 
     } else if (keyword == PARSER_TERM_KEYWORD_FALSE) {
-        write("push constant 0");
+        emit_push(VM_SEGMENT_CONSTANT, 0);
 
     } else if (keyword == PARSER_TERM_KEYWORD_THIS) {
-        write("push pointer 0");
+        emit_push(VM_SEGMENT_POINTER, 0);
 
     } else if (keyword == PARSER_TERM_KEYWORD_NULL) {
-        write("push constant 0");
+        emit_push(VM_SEGMENT_CONSTANT, 0);
     }
 }
 
@@ -405,35 +784,31 @@ static void gen_var_usage_code(Parser_term_var_usage *var_usage)
         var_usage->var_name
     );
     if (entry != NULL) {
-        char push_command[STR_BUFF_SIZE];
-        sprintf(
-            push_command,
-            "push %s %d",
-            idt_category_name(entry->var->category),
-            entry->var->index
-        );
-        write(push_command);
+        emit_push(category_segment(entry->var->category), entry->var->index);
 
         if (var_usage->subscript != NULL) {
             gen_expression_code(var_usage->subscript);
-            write("add");
-            write("pop pointer 1");
-            write("push that 0");
+            emit(VM_ADD);
+            emit_pop(VM_SEGMENT_POINTER, 1);
+            emit_push(VM_SEGMENT_THAT, 0);
         }
     }
 }
 
-static void gen_subroutine_call_code(Parser_term_subroutine_call call)
+// Calls are resolved through the class signatures indexed before
+// code gen: `f()` targets the current class, `x.f()` a method of the
+// type of variable x and `C.f()` a function or constructor of class C.
+// Calls into classes outside the index are assumed to be well formed.
+static void gen_subroutine_call_code(Parser_term_subroutine_call call, bool is_statement)
 {
     char *func_class_name = NULL;
     short params_count = call.param_expressions.count;
+    bool is_method_call = false;
     IDT_Entry *entry = NULL;
-    char call_command[STR_BUFF_SIZE];
 
     if (call.instance_var_name == NULL) {
-        write("push pointer 0");
         func_class_name = class_name;
-        params_count++;
+        is_method_call = true;
     } else {
         entry = search_var(
             class_name, 
@@ -442,35 +817,86 @@ static void gen_subroutine_call_code(Parser_term_subroutine_call call)
         );
 
         if (entry != NULL && entry->var != NULL) {
-            sprintf(
-                call_command,
-                "push %s %d",
-                idt_category_name(entry->var->category),
-                entry->var->index
-            );
-            write(call_command);
-
             func_class_name = entry->var->class_name;
-            params_count++;
+            is_method_call = true;
         } else {
             func_class_name = call.instance_var_name;
         }
     }
 
+    IDT_Subroutine_Entry *signature = idt_subroutine(
+        func_class_name, 
+        call.subroutine_name
+    );
+
+    if (signature == NULL && idt_class(func_class_name) != NULL) {
+        exit_gen(
+            "Subroutine %s.%s is not declared",
+            func_class_name,
+            call.subroutine_name
+        );
+    }
+
+    if (signature != NULL) {
+        if (call.instance_var_name == NULL) {
+            is_method_call = signature->kind == IDT_METHOD;
+
+            if (is_method_call && subroutine_dec.scope == PARSER_FUNC_STATIC) {
+                exit_gen(
+                    "Method %s.%s called from a function",
+                    func_class_name,
+                    call.subroutine_name
+                );
+            }
+
+        } else if (is_method_call != (signature->kind == IDT_METHOD)) {
+            exit_gen(
+                is_method_call ? 
+                    "%s.%s is not a method" : 
+                    "Method %s.%s called without an instance",
+                func_class_name,
+                call.subroutine_name
+            );
+        }
+
+        if (signature->params_count != params_count) {
+            exit_gen(
+                "%s.%s expects %d arguments, got %d",
+                func_class_name,
+                call.subroutine_name,
+                signature->params_count,
+                params_count
+            );
+        }
+
+        if (signature->is_void && !is_statement) {
+            exit_gen(
+                "Void subroutine %s.%s used in an expression",
+                func_class_name,
+                call.subroutine_name
+            );
+        }
+    }
+
+    if (is_method_call) {
+        if (call.instance_var_name == NULL) {
+            emit_push(VM_SEGMENT_POINTER, 0);
+        } else {
+            emit_push(
+                category_segment(entry->var->category), 
+                entry->var->index
+            );
+        }
+        params_count++;
+    }
+
     LL_Node *expression_node = call.param_expressions.head;
     while (expression_node != NULL) {
         gen_expression_code((Parser_expression *)expression_node->data);
         expression_node = expression_node->next;
     }
 
-    sprintf(
-        call_command,
-        "call %s.%s %d",
-        func_class_name,
-        call.subroutine_name,
-        params_count
-    );
-    write(call_command);
+    emit_call(func_class_name, call.subroutine_name, params_count);
 }
 
 static void gen_sub_term_code(Parser_sub_term *sub_term)
@@ -482,44 +908,205 @@ static void gen_sub_term_code(Parser_sub_term *sub_term)
 static void gen_operator_code(Parser_term_operator operator)
 {
     if (operator == PARSER_TERM_OP_ADDITION) {
-        write("add");
+        emit(VM_ADD);
 
     } else if (operator == PARSER_TERM_OP_SUBTRACTION) {
-        write("sub");
+        emit(VM_SUB);
 
     } else if (operator == PARSER_TERM_OP_MULTIPLICATION) {
-        write("call Math.multiply 2");
+        emit_call("Math", "multiply", 2);
 
     } else if (operator == PARSER_TERM_OP_DIVISION) {
-        write("call Math.divide 2");
+        emit_call("Math", "divide", 2);
 
     } else if (operator == PARSER_TERM_OP_GREATER) {
-        write("gt");
+        emit(VM_GT);
 
     } else if (operator == PARSER_TERM_OP_LESSER) {
-        write("lt");
+        emit(VM_LT);
 
     } else if (operator == PARSER_TERM_OP_ASSIGN) {
-        write("eq");
+        emit(VM_EQ);
 
     } else if (operator == PARSER_TERM_OP_AND) {
-        write("and");
+        emit(VM_AND);
 
     } else if (operator == PARSER_TERM_OP_OR) {
-        write("or");
+        emit(VM_OR);
     }
 }
 
 static void gen_unary_operator_code(Parser_term_operator operator)
 {
     if (operator == PARSER_TERM_OP_SUBTRACTION) {
-        write("neg");
+        emit(VM_NEG);
 
     } else if (operator == PARSER_TERM_OP_NOT) {
-        write("not");
+        emit(VM_NOT);
+    }
+}
+
+// Multiplications by constants are inlined as a run of doublings and
+// additions, and divisions by 1 or -1 dropped or negated, instead of
+// calling Math.multiply and Math.divide. Both wrap around like the
+// OS routines. Returns false when the operation wasn't handled.
+static bool gen_constant_operation_code(Parser_term_operator operator, Parser_term *term)
+{
+    int value;
+
+    if (!term_constant(term, &value)) {
+        return false;
+    }
+
+    if (operator == PARSER_TERM_OP_MULTIPLICATION &&
+        multiply_cost(value) <= CG_MAX_MULTIPLY_COST) {
+        gen_multiply_code(value);
+        return true;
+
+    } else if (operator == PARSER_TERM_OP_DIVISION && (value == 1 || value == -1)) {
+        if (value == -1) {
+            emit(VM_NEG);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+// Multiplies the value on top of the stack by a constant, from the
+// factor's highest bit down: the product is doubled for every bit
+// and the multiplicand, kept in a temp, added for every set bit.
+// Doubling goes through another temp, since the VM can't duplicate
+// the top of the stack.
+static void gen_multiply_code(int factor)
+{
+    int magnitude = factor < 0 ? -factor : factor;
+    int bit = 15;
+
+    if (magnitude == 0) {
+        emit_pop(VM_SEGMENT_TEMP, CG_MULTIPLICAND_TEMP);
+        emit_push(VM_SEGMENT_CONSTANT, 0);
+        return;
+    }
+
+    while ((magnitude & (1 << bit)) == 0) {
+        bit--;
+    }
+
+    // Powers of two never add the multiplicand back.
+    if ((magnitude & (magnitude - 1)) != 0) {
+        emit_pop(VM_SEGMENT_TEMP, CG_MULTIPLICAND_TEMP);
+        emit_push(VM_SEGMENT_TEMP, CG_MULTIPLICAND_TEMP);
+    }
+
+    for (bit--; bit >= 0; bit--) {
+        emit_pop(VM_SEGMENT_TEMP, CG_PRODUCT_TEMP);
+        emit_push(VM_SEGMENT_TEMP, CG_PRODUCT_TEMP);
+        emit_push(VM_SEGMENT_TEMP, CG_PRODUCT_TEMP);
+        emit(VM_ADD);
+
+        if (magnitude & (1 << bit)) {
+            emit_push(VM_SEGMENT_TEMP, CG_MULTIPLICAND_TEMP);
+            emit(VM_ADD);
+        }
+    }
+
+    if (factor < 0) {
+        emit(VM_NEG);
     }
 }
 
+// Instructions emitted by gen_multiply_code.
+static int multiply_cost(int factor)
+{
+    int magnitude = factor < 0 ? -factor : factor;
+    int cost = factor < 0 ? 1 : 0;
+    int bits = 0;
+    int set_bits = 0;
+
+    if (magnitude == 0) {
+        return 2;
+    }
+
+    for (int bit = 0; bit < 16; bit++) {
+        if (magnitude & (1 << bit)) {
+            bits = bit + 1;
+            set_bits++;
+        }
+    }
+
+    if (set_bits > 1) {
+        cost += 2;
+    }
+
+    return cost + (bits - 1) * 4 + (set_bits - 1) * 2;
+}
+
+// Integer constants, possibly negated.
+static bool term_constant(Parser_term *term, int *value)
+{
+    if (term->integer != NULL) {
+        *value = atoi(term->integer);
+        return true;
+
+    } else if (term->sub_term != NULL &&
+        term->sub_term->unary_op == PARSER_TERM_OP_SUBTRACTION &&
+        term->sub_term->term.integer != NULL) {
+        *value = -atoi(term->sub_term->term.integer);
+        return true;
+    }
+
+    return false;
+}
+
+// Whether the expression always evaluates to true (-1) or false (0).
+// Operators apply left to right, so the result is boolean after a
+// comparison, and stays so across & and | with boolean terms.
+static bool is_boolean_expression(Parser_expression *expr)
+{
+    LL_Node *term_node = expr->terms.head;
+    LL_Node *operator_node = expr->operators.head;
+    bool is_boolean = is_boolean_term(term_node->data);
+
+    while (operator_node != NULL) {
+        Parser_term_operator operator = *(Parser_term_operator *)operator_node->data;
+        term_node = term_node->next;
+
+        if (operator == PARSER_TERM_OP_LESSER ||
+            operator == PARSER_TERM_OP_GREATER ||
+            operator == PARSER_TERM_OP_ASSIGN) {
+            is_boolean = true;
+
+        } else if (operator == PARSER_TERM_OP_AND || operator == PARSER_TERM_OP_OR) {
+            is_boolean = is_boolean && is_boolean_term(term_node->data);
+
+        } else {
+            is_boolean = false;
+        }
+
+        operator_node = operator_node->next;
+    }
+
+    return is_boolean;
+}
+
+static bool is_boolean_term(Parser_term *term)
+{
+    if (term->keyword_value == PARSER_TERM_KEYWORD_TRUE ||
+        term->keyword_value == PARSER_TERM_KEYWORD_FALSE) {
+        return true;
+
+    } else if (term->parenthesized_expression != NULL) {
+        return is_boolean_expression(term->parenthesized_expression);
+
+    } else if (term->sub_term != NULL) {
+        return term->sub_term->unary_op == PARSER_TERM_OP_NOT &&
+            is_boolean_term(&term->sub_term->term);
+    }
+
+    return false;
+}
+
 static IDT_Entry *search_var(char *class, char *subroutine, char *name)
 {
     IDT_Entry *entry;
@@ -551,44 +1138,134 @@ static IDT_Entry *search_var(char *class, char *subroutine, char *name)
     return NULL;
 }
 
-char *idt_category_name(IDT_Category category)
+static VM_Segment category_segment(IDT_Category category)
 {
     if (category == IDT_STATIC) {
-        return "static";
+        return VM_SEGMENT_STATIC;
 
     } else if (category == IDT_LOCAL) {
-        return "local";
+        return VM_SEGMENT_LOCAL;
 
     } else if (category == IDT_FIELD) {
-        return "this";
+        return VM_SEGMENT_THIS;
+    }
+
+    return VM_SEGMENT_ARGUMENT;
+}
+
+static int unique_label(void)
+{
+    return vm_make_label(ir);
+}
+
+static void exit_gen(const char *format, ...)
+{
+    va_list args;
+
+    printf("In %s.%s\n", class_name, subroutine_name);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    exit(EXIT_FAILURE);
+}
+
+// Emitters append VM instructions to the IR of the function
+// being generated.
+static void emit_push(VM_Segment segment, int index)
+{
+    vm_append(function, (VM_Instruction){ VM_PUSH, segment, index, -1, statement_line });
+}
+
+static void emit_pop(VM_Segment segment, int index)
+{
+    vm_append(function, (VM_Instruction){ VM_POP, segment, index, -1, statement_line });
+}
 
-    } else if (category == IDT_PARAM) {
-        return "argument";
+static void emit_push_value(int value)
+{
+    emit_push(VM_SEGMENT_CONSTANT, abs(value));
+
+    if (value < 0) {
+        emit(VM_NEG);
     }
+}
 
-    return NULL;
+static void emit_push_constant(const char *integer)
+{
+    emit_push(VM_SEGMENT_CONSTANT, atoi(integer));
 }
 
-static void unique_label(char *buff)
+static void emit_call(const char *class, const char *name, int args_count)
 {
-    sprintf(
-        buff,
-        "%s_%d",
-        class_name,
-        label_count
+    vm_append(
+        function,
+        (VM_Instruction){
+            VM_CALL, 0, args_count, vm_symbol(ir, class, name), statement_line
+        }
     );
-    label_count++;
 }
 
-static void write(const char *str)
+static void emit_function(const char *name, int locals_count)
 {
-    if (indent_level > 0) {
-        for (short i = 0; i < indent_level; i++) {
-            fh_write("    ", code_file);
-        }
+    function = vm_add_function(ir, name, locals_count);
+}
+
+static void emit_label(VM_Opcode opcode, int label)
+{
+    vm_append(function, (VM_Instruction){ opcode, 0, label, -1, statement_line });
+}
+
+static void emit(VM_Opcode opcode)
+{
+    vm_append(function, (VM_Instruction){ opcode, 0, 0, -1, statement_line });
+}
+
+// Keeps count of the output lines written so far, which the line map
+// refers to.
+static void write_class(FILE *file, VM_Class *class_ir)
+{
+    if (options.analyze_stack) {
+        sd_analyze(class_ir);
+    }
+
+    if (options.stack_comments) {
+        output_line += write_stack_comments(file, class_ir);
     }
 
-    fh_write(str, code_file);
-    fh_write("\n", code_file);
+    vm_write_class(file, class_ir);
+
+    if (options.line_map != NULL) {
+        output_line += vm_write_line_map(options.line_map, class_ir, output_line);
+    }
 }
 
+// One comment line per function, ahead of the class' code, with the
+// words a call to it takes from the stack besides its callees.
+static int write_stack_comments(FILE *file, const VM_Class *class_ir)
+{
+    FH_Sink *sink = fh_sink(file);
+
+    for (int i = 0; i < class_ir->functions_count; i++) {
+        const VM_Function *function = &class_ir->functions[i];
+        const char *name = class_ir->symbols[function->symbol];
+        int max_depth = sd_max_depth(function);
+
+        put(sink, "// stack ");
+        put(sink, name);
+        put(sink, ": ");
+        fh_sink_int(sink, SD_FRAME_SIZE + function->locals_count + max_depth);
+        put(sink, " words, ");
+        fh_sink_int(sink, function->locals_count);
+        put(sink, " locals, ");
+        fh_sink_int(sink, max_depth);
+        put(sink, " operands\n");
+    }
+
+    return class_ir->functions_count;
+}
+
+static void put(FH_Sink *sink, const char *str)
+{
+    fh_sink_write(sink, str, strlen(str));
+}
@@ -1,4 +1,32 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include "parser.h"
+#include "vm-ir.h"
 
+// optimize enables the AST and peephole passes, pool_strings keeps
+// each string literal in a static slot built on first use instead
+// of allocating it on every evaluation. tree_shake holds back the
+// output until cg_finish, which drops the unreachable subroutines.
+// emit_asm writes the whole program as Hack assembly from cg_finish.
+// When line_map is set, every VM line written out that was compiled
+// from a Jack statement is mapped there to the statement's line.
+// analyze_stack records the stack use of the code written out for
+// sd_stats, stack_comments writes each function's own ahead of its
+// class.
+typedef struct {
+    bool optimize;
+    bool pool_strings;
+    bool tree_shake;
+    bool emit_asm;
+    FILE *line_map;
+    bool analyze_stack;
+    bool stack_comments;
+} CG_Options;
+
+void cg_set_options(CG_Options options);
 void cg_gen_code(FILE *file, Parser_jack_syntax *ast);
+// Adds already compiled code, such as the OS' .vm files, to the
+// program held back for cg_finish.
+void cg_add_class(VM_Class *class_ir);
+void cg_finish(FILE *file);
+VM_Class *cg_gen_ir(Parser_jack_syntax *ast);
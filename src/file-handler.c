@@ -1,8 +1,22 @@
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "file-handler.h"
 
-static bool is_jack_file(const char *path);
+#define FH_SINK_INITIAL_SIZE    65536
+#define FH_SINK_MAX_SIZE        1048576
+#define FH_INDENT_SIZE          4
+#define FH_MAX_INDENT_LEVEL     16
+
+static FH_Sink **sinks;
+static int sinks_count;
+static int sinks_capacity;
+static char indentation[FH_INDENT_SIZE * FH_MAX_INDENT_LEVEL + 1];
+
+static bool has_extension(const char *path, const char *ext);
+static char *proj_file_path(const char *path, const char *name);
+static bool release_sink(FILE *file);
 
 FILE *fh_open_file(const char *path, const bool create)
 {
@@ -11,12 +25,130 @@ FILE *fh_open_file(const char *path, const bool create)
 
 void fh_write(const char *str, FILE *file)
 {
-    fprintf(file, "%s", str);
+    fh_sink_write(fh_sink(file), str, strlen(str));
+}
+
+bool fh_close_file(FILE *file)
+{
+    bool has_written = release_sink(file);
+    return fclose(file) == 0 && has_written;
+}
+
+FH_Sink *fh_sink(FILE *file)
+{
+    for (int i = 0; i < sinks_count; i++) {
+        if (sinks[i]->file == file) {
+            return sinks[i];
+        }
+    }
+
+    if (indentation[0] == '\0') {
+        memset(indentation, ' ', sizeof(indentation) - 1);
+    }
+
+    // Whatever stdio buffered so far must land before the sink's data.
+    fflush(file);
+
+    FH_Sink *sink = malloc(sizeof(FH_Sink));
+    sink->file = file;
+    sink->fd = fileno(file);
+    sink->capacity = FH_SINK_INITIAL_SIZE;
+    sink->buffer = malloc(sink->capacity);
+    sink->length = 0;
+    sink->failed = false;
+
+    if (sinks_count == sinks_capacity) {
+        sinks_capacity = sinks_capacity == 0 ? 8 : sinks_capacity * 2;
+        sinks = realloc(sinks, sizeof(FH_Sink *) * sinks_capacity);
+    }
+    sinks[sinks_count++] = sink;
+
+    return sink;
+}
+
+void fh_sink_write(FH_Sink *sink, const char *str, size_t length)
+{
+    if (sink->length + length > sink->capacity) {
+        if (sink->capacity < FH_SINK_MAX_SIZE) {
+            while (sink->length + length > sink->capacity) {
+                sink->capacity *= 2;
+            }
+            sink->buffer = realloc(sink->buffer, sink->capacity);
+        } else {
+            fh_sink_flush(sink);
+
+            if (length > sink->capacity) {
+                sink->capacity = length;
+                sink->buffer = realloc(sink->buffer, sink->capacity);
+            }
+        }
+    }
+
+    memcpy(sink->buffer + sink->length, str, length);
+    sink->length += length;
 }
 
-void fh_close_file(FILE *file)
+// Formats a decimal integer straight into the sink, without going
+// through printf's format string parsing.
+void fh_sink_int(FH_Sink *sink, int value)
 {
-    fclose(file);
+    char digits[12];
+    int position = sizeof(digits);
+    unsigned int magnitude = value < 0 ? -(unsigned int)value : value;
+
+    do {
+        digits[--position] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0) {
+        digits[--position] = '-';
+    }
+
+    fh_sink_write(sink, digits + position, sizeof(digits) - position);
+}
+
+void fh_sink_indent(FH_Sink *sink, short level)
+{
+    while (level > FH_MAX_INDENT_LEVEL) {
+        fh_sink_write(sink, indentation, FH_INDENT_SIZE * FH_MAX_INDENT_LEVEL);
+        level -= FH_MAX_INDENT_LEVEL;
+    }
+
+    if (level > 0) {
+        fh_sink_write(sink, indentation, FH_INDENT_SIZE * level);
+    }
+}
+
+// A failed write is reported once and the data is dropped, since it
+// can't be written anyway, but the sink stays failed so closing the
+// file tells the caller.
+bool fh_sink_flush(FH_Sink *sink)
+{
+    size_t written = 0;
+
+    while (written < sink->length) {
+        ssize_t count = write(
+            sink->fd, 
+            sink->buffer + written, 
+            sink->length - written
+        );
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count <= 0) {
+            if (!sink->failed) {
+                perror("Couldn't write output");
+            }
+            sink->failed = true;
+            break;
+        }
+        written += count;
+    }
+
+    sink->length = 0;
+
+    return !sink->failed;
 }
 
 File_handler_jack_proj fh_open_proj(const char *path)
@@ -25,10 +157,12 @@ File_handler_jack_proj fh_open_proj(const char *path)
     jack_proj.handle = opendir(path);
     jack_proj.jack_files_count = 0;
     jack_proj.jack_files_paths = NULL;
+    jack_proj.vm_files_count = 0;
+    jack_proj.vm_files_paths = NULL;
     jack_proj.failed = false;
 
     if (jack_proj.handle == NULL) {
-        if (is_jack_file(path)) {
+        if (has_extension(path, ".jack")) {
             jack_proj.jack_files_count = 1;
             jack_proj.jack_files_paths = malloc(sizeof(char *));
             jack_proj.jack_files_paths[0] = (char *)path;
@@ -40,8 +174,14 @@ File_handler_jack_proj fh_open_proj(const char *path)
 
     struct dirent *entry;
     while ((entry = readdir(jack_proj.handle)) != NULL) {
-        if (entry->d_type == DT_REG && is_jack_file(entry->d_name)) {
+        if (entry->d_type != DT_REG) {
+            continue;
+        }
+
+        if (has_extension(entry->d_name, ".jack")) {
             jack_proj.jack_files_count += 1;
+        } else if (has_extension(entry->d_name, ".vm")) {
+            jack_proj.vm_files_count += 1;
         }
     }
 
@@ -53,29 +193,32 @@ File_handler_jack_proj fh_open_proj(const char *path)
     }
 
     jack_proj.jack_files_paths = malloc(sizeof(char *) * jack_proj.jack_files_count);
+    jack_proj.vm_files_paths = malloc(sizeof(char *) * (jack_proj.vm_files_count + 1));
     rewinddir(jack_proj.handle);
     entry = NULL;
-    int i = 0;
+    int jack_index = 0;
+    int vm_index = 0;
 
+    // VM files are listed too, so compiled libraries such as the OS can
+    // be linked in by backends producing a whole program.
     while ((entry = readdir(jack_proj.handle)) != NULL) {
-        if (!is_jack_file(entry->d_name)) {
+        if (entry->d_type != DT_REG) {
             continue;
         }
 
-        int path_size = 2;
-        path_size += strlen(path);
-        path_size += 1; // slash '/'
-        path_size += strlen(entry->d_name);
-        path_size += 1;
+        if (has_extension(entry->d_name, ".jack") && 
+            jack_index < jack_proj.jack_files_count) {
+            jack_proj.jack_files_paths[jack_index++] = proj_file_path(path, entry->d_name);
 
-        char *full_path = malloc(sizeof(char) * path_size);
-        sprintf(full_path, "./%s/%s", path, entry->d_name);
-
-        jack_proj.jack_files_paths[i] = full_path;
-
-        i++;
+        } else if (has_extension(entry->d_name, ".vm") && 
+                   vm_index < jack_proj.vm_files_count) {
+            jack_proj.vm_files_paths[vm_index++] = proj_file_path(path, entry->d_name);
+        }
     }
 
+    jack_proj.jack_files_count = jack_index;
+    jack_proj.vm_files_count = vm_index;
+
     return jack_proj;
 }
 
@@ -87,19 +230,42 @@ void fh_close_proj(File_handler_jack_proj *proj)
     proj->handle = NULL;
 }
 
-static bool is_jack_file(const char *path)
+static bool has_extension(const char *path, const char *ext)
+{
+    size_t path_length = strlen(path);
+    size_t ext_length = strlen(ext);
+
+    return path_length > ext_length && 
+        strcmp(path + path_length - ext_length, ext) == 0;
+}
+
+static char *proj_file_path(const char *path, const char *name)
 {
-    char *ext = ".jack";
-    char *name = (char *)path;
-    char ch;
+    int path_size = 2;
+    path_size += strlen(path);
+    path_size += 1; // slash '/'
+    path_size += strlen(name);
+    path_size += 1;
 
-    while ((ch = *name) != '\0') {
-        if (strcmp(name, ext) == 0) {
-            return true;
+    char *full_path = malloc(sizeof(char) * path_size);
+    sprintf(full_path, "./%s/%s", path, name);
+
+    return full_path;
+}
+
+static bool release_sink(FILE *file)
+{
+    for (int i = 0; i < sinks_count; i++) {
+        if (sinks[i]->file == file) {
+            bool has_written = fh_sink_flush(sinks[i]);
+
+            free(sinks[i]->buffer);
+            free(sinks[i]);
+            sinks[i] = sinks[--sinks_count];
+
+            return has_written;
         }
-        name += 1;
     }
 
-    return false;
+    return true;
 }
-
@@ -7,12 +7,34 @@ typedef struct {
     char *folder_name;
     int jack_files_count;
     char **jack_files_paths;
+    int vm_files_count;
+    char **vm_files_paths;
     bool failed;
 } File_handler_jack_proj;
 
+// Output sink: text written to a file is gathered in a growable
+// in-memory buffer and handed to the OS in large write(2) calls.
+// fh_write goes through the file's sink, which is flushed and
+// released by fh_close_file. failed is set once a write fails.
+typedef struct {
+    FILE *file;
+    int fd;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} FH_Sink;
+
 FILE *fh_open_file(const char *path, const bool create);
 void fh_write(const char *str, FILE *file);
-void fh_close_file(FILE *file);
+// Returns false when anything written to the file was lost.
+bool fh_close_file(FILE *file);
+
+FH_Sink *fh_sink(FILE *file);
+void fh_sink_write(FH_Sink *sink, const char *str, size_t length);
+void fh_sink_int(FH_Sink *sink, int value);
+void fh_sink_indent(FH_Sink *sink, short level);
+bool fh_sink_flush(FH_Sink *sink);
 
 File_handler_jack_proj fh_open_proj(const char *path);
 void fh_close_proj(File_handler_jack_proj *proj);
@@ -0,0 +1,826 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hack-asm.h"
+#include "file-handler.h"
+#include "hash-table.h"
+
+#define HA_STACK_BASE       256
+#define HA_POINTER_BASE     3
+#define HA_TEMP_BASE        5
+#define HA_MAX_STEPS        3
+#define HA_MAX_STEPS_KEEPING_D 8
+
+#define HA_ENTRY_POINT      "Main.main"
+#define HA_BOOTSTRAP        "Sys.init"
+
+// The top of the stack is kept in D whenever possible. While
+// `is_cached` is set, D holds the top and SP points past the value
+// below it, otherwise the whole stack is in memory. Labels, jumps and
+// calls always see the stack in memory; returns leave the returned
+// value in D.
+static FH_Sink *sink;
+static const VM_Class *current_class;
+static bool is_cached;
+static int unique_id;
+static HA_Stats stats;
+
+static void index_functions(HT_Table *table, VM_Class **classes, int count);
+static void check_calls(HT_Table *table, VM_Class **classes, int count);
+static void write_bootstrap(HT_Table *table);
+static void write_call_routine();
+static void write_return_routine();
+static void write_compare_routine();
+static void write_function(const VM_Function *function);
+static int write_instruction(const VM_Instruction *code, int index, int count);
+
+static int write_push(const VM_Instruction *code, int index, int count);
+static void write_pop(VM_Instruction instruction);
+static void write_operation(VM_Opcode opcode);
+static int write_equality_test(const VM_Instruction *code, int index, int count);
+static int write_comparison(const VM_Instruction *code, int index, int count);
+static void write_constant_comparison(VM_Opcode opcode, int value, int label);
+static int write_unary(const VM_Instruction *code, int index, int count);
+static void write_call(VM_Instruction instruction);
+
+static void spill();
+static void load_top();
+static bool select_address(VM_Instruction instruction, bool keeps_d);
+static bool is_operand(VM_Instruction instruction);
+static const char *segment_base(VM_Segment segment);
+static const char *operand_computation(VM_Opcode opcode, bool is_constant);
+static bool is_next(const VM_Instruction *code, int index, int count, VM_Opcode opcode);
+
+static void instruction(const char *text);
+static void address(int value);
+static void address_symbol(const char *symbol);
+static void address_label(int label);
+static void declare_label(int label);
+static void address_unique(const char *prefix, int id);
+static void declare_unique(const char *prefix, int id);
+static void address_static(int index);
+static void put(const char *str);
+
+void ha_write_program(FILE *file, VM_Class **classes, int count)
+{
+    HT_Table table = ht_make_empty_table();
+
+    sink = fh_sink(file);
+    unique_id = 0;
+
+    index_functions(&table, classes, count);
+    check_calls(&table, classes, count);
+
+    write_bootstrap(&table);
+    write_call_routine();
+    write_return_routine();
+    write_compare_routine();
+
+    for (int i = 0; i < count; i++) {
+        current_class = classes[i];
+
+        for (int j = 0; j < classes[i]->functions_count; j++) {
+            const VM_Function *function = &classes[i]->functions[j];
+
+            // Only the first definition of a symbol is ever called.
+            if (ht_value(classes[i]->symbols[function->symbol], &table) == function) {
+                write_function(function);
+            }
+        }
+    }
+
+    for (int i = 0; i < HT_MAX_COUNT; i++) {
+        ll_free(&table.values[i]);
+    }
+}
+
+HA_Stats ha_stats()
+{
+    return stats;
+}
+
+static void index_functions(HT_Table *table, VM_Class **classes, int count)
+{
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < classes[i]->functions_count; j++) {
+            VM_Function *function = &classes[i]->functions[j];
+            char *symbol = classes[i]->symbols[function->symbol];
+
+            if (ht_value(symbol, table) == NULL) {
+                ht_store(symbol, function, table);
+            }
+        }
+    }
+}
+
+static void check_calls(HT_Table *table, VM_Class **classes, int count)
+{
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < classes[i]->functions_count; j++) {
+            VM_Function *function = &classes[i]->functions[j];
+
+            for (int k = 0; k < function->count; k++) {
+                if (function->instructions[k].opcode != VM_CALL) {
+                    continue;
+                }
+
+                char *symbol = classes[i]->symbols[function->instructions[k].symbol];
+
+                if (ht_value(symbol, table) == NULL) {
+                    printf("Undefined subroutine %s\n", symbol);
+                    printf("Add the compiled OS classes (.vm files) to the project folder\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    }
+}
+
+// Sets up the stack and calls Sys.init when the OS is linked in,
+// otherwise Main.main, halting once it returns.
+static void write_bootstrap(HT_Table *table)
+{
+    const char *entry = ht_value(HA_BOOTSTRAP, table) != NULL ? 
+        HA_BOOTSTRAP : 
+        HA_ENTRY_POINT;
+
+    if (ht_value(entry, table) == NULL) {
+        printf("Entry point %s not found\n", HA_ENTRY_POINT);
+        exit(EXIT_FAILURE);
+    }
+
+    put("// bootstrap\n");
+    address(HA_STACK_BASE);
+    instruction("D=A");
+    address_symbol("SP");
+    instruction("M=D");
+    address_symbol("R14");
+    instruction("M=0");
+    address_symbol(entry);
+    instruction("D=A");
+    address_symbol("R13");
+    instruction("M=D");
+    address_symbol("$halt");
+    instruction("D=A");
+    address_symbol("$call");
+    instruction("0;JMP");
+    put("($halt)\n");
+    address_symbol("$halt");
+    instruction("0;JMP");
+}
+
+// D: return address, R13: callee, R14: arguments count. Pushes the
+// caller's frame, repositions ARG and LCL and jumps to the callee.
+static void write_call_routine()
+{
+    const char *saved[] = { NULL, "LCL", "ARG", "THIS", "THAT" };
+
+    put("// call\n($call)\n");
+
+    for (int i = 0; i < 5; i++) {
+        if (saved[i] != NULL) {
+            address_symbol(saved[i]);
+            instruction("D=M");
+        }
+        address_symbol("SP");
+        instruction("AM=M+1");
+        instruction("A=A-1");
+        instruction("M=D");
+    }
+
+    address_symbol("R14");
+    instruction("D=M");
+    address(5);
+    instruction("D=D+A");
+    address_symbol("SP");
+    instruction("D=M-D");
+    address_symbol("ARG");
+    instruction("M=D");
+    address_symbol("SP");
+    instruction("D=M");
+    address_symbol("LCL");
+    instruction("M=D");
+    address_symbol("R13");
+    instruction("A=M");
+    instruction("0;JMP");
+}
+
+// D: returned value. Restores the caller's frame with SP back at the
+// arguments, and returns with the value still in D, which becomes the
+// caller's cached top of the stack.
+static void write_return_routine()
+{
+    const char *restored[] = { "THAT", "THIS", "ARG", "LCL" };
+
+    put("// return\n($return)\n");
+    address_symbol("R13");
+    instruction("M=D");
+    address_symbol("LCL");
+    instruction("D=M");
+    address_symbol("R14");
+    instruction("M=D");
+    address(5);
+    instruction("A=D-A");
+    instruction("D=M");
+    address_symbol("R15");
+    instruction("M=D");
+    address_symbol("ARG");
+    instruction("D=M");
+    address_symbol("SP");
+    instruction("M=D");
+
+    for (int i = 0; i < 4; i++) {
+        address_symbol("R14");
+        instruction("AM=M-1");
+        instruction("D=M");
+        address_symbol(restored[i]);
+        instruction("M=D");
+    }
+
+    address_symbol("R13");
+    instruction("D=M");
+    address_symbol("R15");
+    instruction("A=M");
+    instruction("0;JMP");
+}
+
+// R13 < R14, returning true or false in D to the address in R15.
+// Subtracting only when both have the same sign keeps the result
+// exact where x - y would overflow.
+static void write_compare_routine()
+{
+    put("// less than\n($lt)\n");
+    address_symbol("R13");
+    instruction("D=M");
+    address_symbol("$lt.negative");
+    instruction("D;JLT");
+    address_symbol("R14");
+    instruction("D=M");
+    address_symbol("$false");
+    instruction("D;JLT");
+    address_symbol("$lt.subtract");
+    instruction("0;JMP");
+    put("($lt.negative)\n");
+    address_symbol("R14");
+    instruction("D=M");
+    address_symbol("$true");
+    instruction("D;JGE");
+    put("($lt.subtract)\n");
+    address_symbol("R14");
+    instruction("D=M");
+    address_symbol("R13");
+    instruction("D=M-D");
+    address_symbol("$true");
+    instruction("D;JLT");
+    put("($false)\n");
+    instruction("D=0");
+    address_symbol("R15");
+    instruction("A=M");
+    instruction("0;JMP");
+    put("($true)\n");
+    instruction("D=-1");
+    address_symbol("R15");
+    instruction("A=M");
+    instruction("0;JMP");
+}
+
+static void write_function(const VM_Function *function)
+{
+    const char *symbol = current_class->symbols[function->symbol];
+
+    put("// function ");
+    put(symbol);
+    put("\n(");
+    put(symbol);
+    put(")\n");
+
+    stats.functions++;
+    is_cached = false;
+
+    if (function->locals_count > 0) {
+        address_symbol("SP");
+        instruction("A=M");
+
+        for (int i = 0; i < function->locals_count; i++) {
+            if (i > 0) {
+                instruction("A=A+1");
+            }
+            instruction("M=0");
+        }
+
+        instruction("D=A+1");
+        address_symbol("SP");
+        instruction("M=D");
+    }
+
+    int index = 0;
+
+    while (index < function->count) {
+        index += write_instruction(function->instructions, index, function->count);
+    }
+}
+
+// Writes the instruction at index, possibly fused with the ones after
+// it, and returns how many instructions were consumed.
+static int write_instruction(const VM_Instruction *code, int index, int count)
+{
+    VM_Instruction current = code[index];
+    VM_Opcode opcode = current.opcode;
+
+    if (opcode == VM_PUSH) {
+        return write_push(code, index, count);
+
+    } else if (opcode == VM_POP) {
+        write_pop(current);
+
+    } else if (opcode == VM_ADD || opcode == VM_SUB || 
+               opcode == VM_AND || opcode == VM_OR) {
+        load_top();
+        address_symbol("SP");
+        instruction("AM=M-1");
+        write_operation(opcode);
+
+    } else if (opcode == VM_EQ) {
+        load_top();
+        address_symbol("SP");
+        instruction("AM=M-1");
+        instruction("D=M-D");
+        return 1 + write_equality_test(code, index + 1, count);
+
+    } else if (opcode == VM_LT || opcode == VM_GT) {
+        return write_comparison(code, index, count);
+
+    } else if (opcode == VM_NEG || opcode == VM_NOT) {
+        return write_unary(code, index, count);
+
+    } else if (opcode == VM_LABEL) {
+        spill();
+        declare_label(current.operand);
+
+    } else if (opcode == VM_GOTO) {
+        spill();
+        address_label(current.operand);
+        instruction("0;JMP");
+
+    } else if (opcode == VM_IF_GOTO) {
+        load_top();
+        address_label(current.operand);
+        instruction("D;JNE");
+        is_cached = false;
+
+    } else if (opcode == VM_CALL) {
+        write_call(current);
+
+    } else if (opcode == VM_RETURN) {
+        load_top();
+        address_symbol("$return");
+        instruction("0;JMP");
+        is_cached = false;
+    }
+
+    return 1;
+}
+
+// A push feeding an operation is folded into it as its right operand,
+// and a constant compared and branched on is tested inline.
+static int write_push(const VM_Instruction *code, int index, int count)
+{
+    VM_Instruction current = code[index];
+    bool is_constant = current.segment == VM_SEGMENT_CONSTANT;
+
+    if (index + 1 < count && is_operand(current)) {
+        VM_Opcode next = code[index + 1].opcode;
+        const char *computation = operand_computation(next, is_constant);
+
+        if (computation != NULL) {
+            load_top();
+
+            if (is_constant && current.operand == 1 && 
+                (next == VM_ADD || next == VM_SUB)) {
+                instruction(next == VM_ADD ? "D=D+1" : "D=D-1");
+            } else {
+                if (is_constant) {
+                    address(current.operand);
+                } else {
+                    select_address(current, true);
+                }
+                instruction(computation);
+            }
+
+            if (next == VM_EQ) {
+                return 2 + write_equality_test(code, index + 2, count);
+            }
+            return 2;
+        }
+
+        if (is_constant && 
+            (next == VM_LT || next == VM_GT) && 
+            is_next(code, index + 1, count, VM_IF_GOTO)) {
+            load_top();
+            write_constant_comparison(next, current.operand, code[index + 2].operand);
+            return 3;
+        }
+    }
+
+    spill();
+
+    if (is_constant) {
+        if (current.operand == 0 || current.operand == 1) {
+            instruction(current.operand == 0 ? "D=0" : "D=1");
+        } else {
+            address(current.operand);
+            instruction("D=A");
+        }
+    } else {
+        select_address(current, false);
+        instruction("D=M");
+    }
+
+    is_cached = true;
+
+    return 1;
+}
+
+static void write_pop(VM_Instruction instruction_ir)
+{
+    load_top();
+
+    if (select_address(instruction_ir, true)) {
+        instruction("M=D");
+
+    } else {
+        address_symbol("R13");
+        instruction("M=D");
+        address(instruction_ir.operand);
+        instruction("D=A");
+        address_symbol(segment_base(instruction_ir.segment));
+        instruction("D=D+M");
+        address_symbol("R14");
+        instruction("M=D");
+        address_symbol("R13");
+        instruction("D=M");
+        address_symbol("R14");
+        instruction("A=M");
+        instruction("M=D");
+    }
+
+    is_cached = false;
+}
+
+// D holds the right operand and M the left one.
+static void write_operation(VM_Opcode opcode)
+{
+    if (opcode == VM_ADD) {
+        instruction("D=D+M");
+    } else if (opcode == VM_SUB) {
+        instruction("D=M-D");
+    } else if (opcode == VM_AND) {
+        instruction("D=D&M");
+    } else {
+        instruction("D=D|M");
+    }
+}
+
+// D holds x - y. Branches on it directly when a jump follows, and
+// otherwise turns it into true or false. Returns the instructions
+// consumed after the eq.
+static int write_equality_test(const VM_Instruction *code, int index, int count)
+{
+    if (is_next(code, index - 1, count, VM_IF_GOTO)) {
+        address_label(code[index].operand);
+        instruction("D;JEQ");
+        is_cached = false;
+        return 1;
+    }
+
+    if (is_next(code, index - 1, count, VM_NOT) && 
+        is_next(code, index, count, VM_IF_GOTO)) {
+        address_label(code[index + 1].operand);
+        instruction("D;JNE");
+        is_cached = false;
+        return 2;
+    }
+
+    // D is 0 exactly when equal: !0 is true, !-1 is false.
+    int id = unique_id++;
+    address_unique("$eq", id);
+    instruction("D;JEQ");
+    instruction("D=-1");
+    declare_unique("$eq", id);
+    instruction("D=!D");
+    is_cached = true;
+
+    return 0;
+}
+
+static int write_comparison(const VM_Instruction *code, int index, int count)
+{
+    VM_Opcode opcode = code[index].opcode;
+    int id = unique_id++;
+
+    // x < y is R13 < R14, x > y is R14 < R13.
+    load_top();
+    address_symbol(opcode == VM_LT ? "R14" : "R13");
+    instruction("M=D");
+    address_symbol("SP");
+    instruction("AM=M-1");
+    instruction("D=M");
+    address_symbol(opcode == VM_LT ? "R13" : "R14");
+    instruction("M=D");
+    address_unique("$ret", id);
+    instruction("D=A");
+    address_symbol("R15");
+    instruction("M=D");
+    address_symbol("$lt");
+    instruction("0;JMP");
+    declare_unique("$ret", id);
+    is_cached = true;
+
+    if (is_next(code, index, count, VM_IF_GOTO)) {
+        address_label(code[index + 1].operand);
+        instruction("D;JNE");
+        is_cached = false;
+        return 2;
+    }
+
+    if (is_next(code, index, count, VM_NOT) && 
+        is_next(code, index + 1, count, VM_IF_GOTO)) {
+        address_label(code[index + 2].operand);
+        instruction("D;JEQ");
+        is_cached = false;
+        return 3;
+    }
+
+    return 1;
+}
+
+// D holds x, compared with a constant c >= 0. x - c can't overflow
+// once x is known not to be negative.
+static void write_constant_comparison(VM_Opcode opcode, int value, int label)
+{
+    if (opcode == VM_LT) {
+        address_label(label);
+        instruction("D;JLT");
+
+        if (value > 0) {
+            address(value);
+            instruction("D=D-A");
+            address_label(label);
+            instruction("D;JLT");
+        }
+
+    } else if (value == 0) {
+        address_label(label);
+        instruction("D;JGT");
+
+    } else {
+        int id = unique_id++;
+
+        address_unique("$gt", id);
+        instruction("D;JLT");
+        address(value);
+        instruction("D=D-A");
+        address_label(label);
+        instruction("D;JGT");
+        declare_unique("$gt", id);
+    }
+
+    is_cached = false;
+}
+
+static int write_unary(const VM_Instruction *code, int index, int count)
+{
+    load_top();
+
+    // not x is non zero exactly when x isn't true (-1).
+    if (code[index].opcode == VM_NOT && is_next(code, index, count, VM_IF_GOTO)) {
+        address_label(code[index + 1].operand);
+        instruction("D+1;JNE");
+        is_cached = false;
+        return 2;
+    }
+
+    instruction(code[index].opcode == VM_NEG ? "D=-D" : "D=!D");
+
+    return 1;
+}
+
+static void write_call(VM_Instruction instruction_ir)
+{
+    int id = unique_id++;
+
+    spill();
+
+    if (instruction_ir.operand <= 1) {
+        address_symbol("R14");
+        instruction(instruction_ir.operand == 0 ? "M=0" : "M=1");
+    } else {
+        address(instruction_ir.operand);
+        instruction("D=A");
+        address_symbol("R14");
+        instruction("M=D");
+    }
+
+    address_symbol(current_class->symbols[instruction_ir.symbol]);
+    instruction("D=A");
+    address_symbol("R13");
+    instruction("M=D");
+    address_unique("$ret", id);
+    instruction("D=A");
+    address_symbol("$call");
+    instruction("0;JMP");
+    declare_unique("$ret", id);
+
+    is_cached = true;
+}
+
+static void spill()
+{
+    if (is_cached) {
+        address_symbol("SP");
+        instruction("AM=M+1");
+        instruction("A=A-1");
+        instruction("M=D");
+        is_cached = false;
+    }
+}
+
+static void load_top()
+{
+    if (!is_cached) {
+        address_symbol("SP");
+        instruction("AM=M-1");
+        instruction("D=M");
+        is_cached = true;
+    }
+}
+
+// Points A at the slot. Far slots of the pointer based segments need
+// D for the offset, so they can't be selected when D must be kept.
+static bool select_address(VM_Instruction instruction_ir, bool keeps_d)
+{
+    VM_Segment segment = instruction_ir.segment;
+    int index = instruction_ir.operand;
+
+    if (segment == VM_SEGMENT_STATIC) {
+        address_static(index);
+        return true;
+
+    } else if (segment == VM_SEGMENT_TEMP) {
+        address(HA_TEMP_BASE + index);
+        return true;
+
+    } else if (segment == VM_SEGMENT_POINTER) {
+        address(HA_POINTER_BASE + index);
+        return true;
+    }
+
+    const char *base = segment_base(segment);
+    int max_steps = keeps_d ? HA_MAX_STEPS_KEEPING_D : HA_MAX_STEPS;
+
+    if (base == NULL) {
+        return false;
+
+    } else if (index <= max_steps) {
+        address_symbol(base);
+        instruction(index == 0 ? "A=M" : "A=M+1");
+
+        for (int i = 1; i < index; i++) {
+            instruction("A=A+1");
+        }
+        return true;
+
+    } else if (!keeps_d) {
+        address(index);
+        instruction("D=A");
+        address_symbol(base);
+        instruction("A=D+M");
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_operand(VM_Instruction instruction_ir)
+{
+    VM_Segment segment = instruction_ir.segment;
+
+    return segment == VM_SEGMENT_CONSTANT ||
+        segment == VM_SEGMENT_STATIC ||
+        segment == VM_SEGMENT_TEMP ||
+        segment == VM_SEGMENT_POINTER ||
+        instruction_ir.operand <= HA_MAX_STEPS_KEEPING_D;
+}
+
+static const char *segment_base(VM_Segment segment)
+{
+    if (segment == VM_SEGMENT_LOCAL) {
+        return "LCL";
+    } else if (segment == VM_SEGMENT_ARGUMENT) {
+        return "ARG";
+    } else if (segment == VM_SEGMENT_THIS) {
+        return "THIS";
+    } else if (segment == VM_SEGMENT_THAT) {
+        return "THAT";
+    }
+
+    return NULL;
+}
+
+// Computation applying the operation to D and the operand selected
+// by A, or NULL when the operation takes no such operand.
+static const char *operand_computation(VM_Opcode opcode, bool is_constant)
+{
+    if (opcode == VM_ADD) {
+        return is_constant ? "D=D+A" : "D=D+M";
+    } else if (opcode == VM_SUB || opcode == VM_EQ) {
+        return is_constant ? "D=D-A" : "D=D-M";
+    } else if (opcode == VM_AND) {
+        return is_constant ? "D=D&A" : "D=D&M";
+    } else if (opcode == VM_OR) {
+        return is_constant ? "D=D|A" : "D=D|M";
+    }
+
+    return NULL;
+}
+
+static bool is_next(const VM_Instruction *code, int index, int count, VM_Opcode opcode)
+{
+    return index + 1 < count && code[index + 1].opcode == opcode;
+}
+
+static void instruction(const char *text)
+{
+    put(text);
+    put("\n");
+    stats.instructions++;
+}
+
+static void address(int value)
+{
+    put("@");
+    fh_sink_int(sink, value);
+    put("\n");
+    stats.instructions++;
+}
+
+static void address_symbol(const char *symbol)
+{
+    put("@");
+    put(symbol);
+    put("\n");
+    stats.instructions++;
+}
+
+static void address_label(int label)
+{
+    put("@");
+    put(current_class->name);
+    put("$");
+    fh_sink_int(sink, label);
+    put("\n");
+    stats.instructions++;
+}
+
+static void declare_label(int label)
+{
+    put("(");
+    put(current_class->name);
+    put("$");
+    fh_sink_int(sink, label);
+    put(")\n");
+}
+
+static void address_unique(const char *prefix, int id)
+{
+    put("@");
+    put(prefix);
+    put(".");
+    fh_sink_int(sink, id);
+    put("\n");
+    stats.instructions++;
+}
+
+static void declare_unique(const char *prefix, int id)
+{
+    put("(");
+    put(prefix);
+    put(".");
+    fh_sink_int(sink, id);
+    put(")\n");
+}
+
+static void address_static(int index)
+{
+    put("@");
+    put(current_class->name);
+    put(".");
+    fh_sink_int(sink, index);
+    put("\n");
+    stats.instructions++;
+}
+
+static void put(const char *str)
+{
+    fh_sink_write(sink, str, strlen(str));
+}
@@ -0,0 +1,20 @@
+#ifndef HA_HACK_ASM
+#define HA_HACK_ASM
+
+#include <stdio.h>
+#include "vm-ir.h"
+
+typedef struct {
+    long instructions;
+    long functions;
+} HA_Stats;
+
+// Hack assembly backend: lowers the IR of a whole program, OS
+// included, to a single assembly file, starting with the bootstrap
+// and the shared call, return and comparison routines. Exits when a
+// called subroutine isn't defined by any class.
+void ha_write_program(FILE *file, VM_Class **classes, int count);
+
+HA_Stats ha_stats();
+
+#endif
@@ -0,0 +1,572 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hack-cpu.h"
+#include "hash-table.h"
+
+#define HC_RAM_SIZE             32768
+#define HC_ADDRESS_MASK         (HC_RAM_SIZE - 1)
+#define HC_MAX_ADDRESS          32767
+#define HC_SCREEN               16384
+#define HC_KEYBOARD             24576
+#define HC_FIRST_VARIABLE       16
+#define HC_MAX_LINE_LENGTH      256
+#define HC_BOOTSTRAP            "(bootstrap)"
+
+// Fields of a C-instruction: 111a cccc ccdd djjj.
+#define HC_C_INSTRUCTION        0xE000
+#define HC_IS_C                 0x8000
+#define HC_READS_M              0x1000
+#define HC_ZERO_X               0x0800
+#define HC_NEGATE_X             0x0400
+#define HC_ZERO_Y               0x0200
+#define HC_NEGATE_Y             0x0100
+#define HC_ADD                  0x0080
+#define HC_NEGATE_OUT           0x0040
+#define HC_DEST_A               0x0020
+#define HC_DEST_D               0x0010
+#define HC_DEST_M               0x0008
+#define HC_JUMP_LT              0x0004
+#define HC_JUMP_EQ              0x0002
+#define HC_JUMP_GT              0x0001
+#define HC_JUMP                 0x0007
+
+typedef struct {
+    char *name;
+    int value;
+} HC_Symbol;
+
+typedef struct {
+    const char *mnemonic;
+    unsigned short bits;
+} HC_Code;
+
+// The a bit and the six ALU control bits, as placed in the word.
+static const HC_Code computations[] = {
+    { "0", 0x0A80 },
+    { "1", 0x0FC0 },
+    { "-1", 0x0E80 },
+    { "D", 0x0300 },
+    { "A", 0x0C00 },
+    { "!D", 0x0340 },
+    { "!A", 0x0C40 },
+    { "-D", 0x03C0 },
+    { "-A", 0x0CC0 },
+    { "D+1", 0x07C0 },
+    { "A+1", 0x0DC0 },
+    { "D-1", 0x0380 },
+    { "A-1", 0x0C80 },
+    { "D+A", 0x0080 },
+    { "A+D", 0x0080 },
+    { "D-A", 0x04C0 },
+    { "A-D", 0x01C0 },
+    { "D&A", 0x0000 },
+    { "A&D", 0x0000 },
+    { "D|A", 0x0540 },
+    { "A|D", 0x0540 },
+    { "M", 0x1C00 },
+    { "!M", 0x1C40 },
+    { "-M", 0x1CC0 },
+    { "M+1", 0x1DC0 },
+    { "M-1", 0x1C80 },
+    { "D+M", 0x1080 },
+    { "M+D", 0x1080 },
+    { "D-M", 0x14C0 },
+    { "M-D", 0x11C0 },
+    { "D&M", 0x1000 },
+    { "M&D", 0x1000 },
+    { "D|M", 0x1540 },
+    { "M|D", 0x1540 }
+};
+
+static const HC_Code jumps[] = {
+    { "JGT", 0x0001 },
+    { "JEQ", 0x0002 },
+    { "JGE", 0x0003 },
+    { "JLT", 0x0004 },
+    { "JNE", 0x0005 },
+    { "JLE", 0x0006 },
+    { "JMP", 0x0007 }
+};
+
+static const HC_Symbol predefined_symbols[] = {
+    { "SP", 0 },
+    { "LCL", 1 },
+    { "ARG", 2 },
+    { "THIS", 3 },
+    { "THAT", 4 },
+    { "SCREEN", HC_SCREEN },
+    { "KBD", HC_KEYBOARD }
+};
+
+static unsigned short *rom;
+static int rom_size;
+static short ram[HC_RAM_SIZE];
+static HT_Table symbols;
+static HC_Symbol **symbols_list;
+static int symbols_count;
+static int symbols_capacity;
+static char **lines;
+static int lines_count;
+static int lines_capacity;
+static HC_Function_stats *functions;
+static int *function_addresses;
+static int functions_count;
+static int functions_capacity;
+static int *owners;
+static bool *is_halt;
+static HC_Stats stats;
+
+static bool assemble(FILE *file);
+static bool read_lines(FILE *file);
+static bool encode(const char *line, unsigned short *word);
+static bool find_code(const HC_Code *codes, int count, const char *mnemonic, unsigned short *bits);
+static void clean_line(char *line);
+static void define_symbol(const char *name, int value);
+static HC_Symbol *find_symbol(const char *name);
+static void add_function(const char *name, int address);
+static void map_rom();
+static bool execute(long max_cycles);
+static void collect_stats();
+static int compare_function_stats(const void *a, const void *b);
+static void free_program();
+
+bool hc_run(FILE *file, long max_cycles)
+{
+    memset(ram, 0, sizeof(ram));
+    symbols = ht_make_empty_table();
+    add_function(HC_BOOTSTRAP, 0);
+
+    bool has_halted = assemble(file);
+
+    if (has_halted) {
+        map_rom();
+        has_halted = execute(max_cycles);
+        collect_stats();
+    }
+
+    free_program();
+
+    return has_halted;
+}
+
+short hc_ram(int address)
+{
+    return ram[address & HC_ADDRESS_MASK];
+}
+
+HC_Stats hc_stats()
+{
+    return stats;
+}
+
+// Two passes: labels are bound to the address of the instruction
+// following them, then the instructions are encoded, any other
+// symbol becoming a variable from RAM[16] on.
+static bool assemble(FILE *file)
+{
+    for (int i = 0; i < (int)(sizeof(predefined_symbols) / sizeof(HC_Symbol)); i++) {
+        define_symbol(predefined_symbols[i].name, predefined_symbols[i].value);
+    }
+
+    char name[8];
+    for (int i = 0; i < 16; i++) {
+        sprintf(name, "R%d", i);
+        define_symbol(name, i);
+    }
+
+    if (!read_lines(file)) {
+        return false;
+    }
+
+    rom = malloc(sizeof(unsigned short) * (lines_count + 1));
+    rom_size = lines_count;
+    int next_variable = HC_FIRST_VARIABLE;
+
+    for (int i = 0; i < lines_count; i++) {
+        char *line = lines[i];
+
+        if (line[0] != '@') {
+            if (!encode(line, &rom[i])) {
+                printf("Invalid instruction %s\n", line);
+                return false;
+            }
+            continue;
+        }
+
+        char *value = line + 1;
+
+        if (isdigit(value[0])) {
+            int address = atoi(value);
+
+            if (address > HC_MAX_ADDRESS) {
+                printf("Invalid address %s\n", line);
+                return false;
+            }
+            rom[i] = address;
+            continue;
+        }
+
+        HC_Symbol *symbol = find_symbol(value);
+
+        if (symbol == NULL) {
+            define_symbol(value, next_variable++);
+            symbol = find_symbol(value);
+        }
+        rom[i] = symbol->value;
+    }
+
+    return true;
+}
+
+static bool read_lines(FILE *file)
+{
+    char line[HC_MAX_LINE_LENGTH];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        clean_line(line);
+
+        if (line[0] == '\0') {
+            continue;
+        }
+
+        if (line[0] == '(') {
+            size_t length = strlen(line);
+
+            if (length < 3 || line[length - 1] != ')') {
+                printf("Invalid label %s\n", line);
+                return false;
+            }
+
+            line[length - 1] = '\0';
+            char *label = line + 1;
+
+            if (find_symbol(label) != NULL) {
+                printf("Label %s is defined twice\n", label);
+                return false;
+            }
+
+            define_symbol(label, lines_count);
+
+            if (strchr(label, '$') == NULL) {
+                add_function(label, lines_count);
+            }
+            continue;
+        }
+
+        if (lines_count == lines_capacity) {
+            lines_capacity = lines_capacity == 0 ? 1024 : lines_capacity * 2;
+            lines = realloc(lines, sizeof(char *) * lines_capacity);
+        }
+        lines[lines_count++] = strdup(line);
+    }
+
+    return true;
+}
+
+static bool encode(const char *line, unsigned short *word)
+{
+    char buffer[HC_MAX_LINE_LENGTH];
+    strcpy(buffer, line);
+
+    char *computation = buffer;
+    char *jump = strchr(buffer, ';');
+    char *equals = strchr(buffer, '=');
+    unsigned short bits = HC_C_INSTRUCTION;
+    unsigned short code;
+
+    if (jump != NULL) {
+        *jump++ = '\0';
+
+        if (!find_code(jumps, sizeof(jumps) / sizeof(HC_Code), jump, &code)) {
+            return false;
+        }
+        bits |= code;
+    }
+
+    if (equals != NULL) {
+        *equals = '\0';
+
+        for (char *dest = buffer; *dest != '\0'; dest++) {
+            if (*dest == 'A') {
+                bits |= HC_DEST_A;
+            } else if (*dest == 'D') {
+                bits |= HC_DEST_D;
+            } else if (*dest == 'M') {
+                bits |= HC_DEST_M;
+            } else {
+                return false;
+            }
+        }
+        computation = equals + 1;
+    }
+
+    if (!find_code(computations, sizeof(computations) / sizeof(HC_Code), computation, &code)) {
+        return false;
+    }
+
+    *word = bits | code;
+
+    return true;
+}
+
+static bool find_code(const HC_Code *codes, int count, const char *mnemonic, unsigned short *bits)
+{
+    for (int i = 0; i < count; i++) {
+        if (strcmp(codes[i].mnemonic, mnemonic) == 0) {
+            *bits = codes[i].bits;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Drops comments and every whitespace.
+static void clean_line(char *line)
+{
+    char *comment = strstr(line, "//");
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+
+    int length = 0;
+
+    for (char *c = line; *c != '\0'; c++) {
+        if (!isspace((unsigned char)*c)) {
+            line[length++] = *c;
+        }
+    }
+    line[length] = '\0';
+}
+
+// The table keeps the key pointer, which the symbol itself owns.
+static void define_symbol(const char *name, int value)
+{
+    if (symbols_count == symbols_capacity) {
+        symbols_capacity = symbols_capacity == 0 ? 256 : symbols_capacity * 2;
+        symbols_list = realloc(symbols_list, sizeof(HC_Symbol *) * symbols_capacity);
+    }
+
+    HC_Symbol *symbol = malloc(sizeof(HC_Symbol));
+    symbol->name = strdup(name);
+    symbol->value = value;
+
+    symbols_list[symbols_count++] = symbol;
+    ht_store(symbol->name, symbol, &symbols);
+}
+
+static HC_Symbol *find_symbol(const char *name)
+{
+    return ht_value(name, &symbols);
+}
+
+static void add_function(const char *name, int address)
+{
+    if (functions_count == functions_capacity) {
+        functions_capacity = functions_capacity == 0 ? 64 : functions_capacity * 2;
+        functions = realloc(functions, sizeof(HC_Function_stats) * functions_capacity);
+        function_addresses = realloc(function_addresses, sizeof(int) * functions_capacity);
+    }
+
+    functions[functions_count] = (HC_Function_stats){ strdup(name), 0, 0 };
+    function_addresses[functions_count] = address;
+    functions_count++;
+}
+
+// Maps each address to the function whose code it belongs to, -1
+// before the first function, and flags the halting loops: @k at
+// address k followed by an unconditional jump.
+static void map_rom()
+{
+    owners = malloc(sizeof(int) * (rom_size + 1));
+    is_halt = calloc(rom_size + 1, sizeof(bool));
+
+    int function = -1;
+    int next = 1;
+
+    for (int i = 0; i < rom_size; i++) {
+        while (next < functions_count && function_addresses[next] <= i) {
+            function = next++;
+        }
+        owners[i] = function;
+
+        if (i + 1 < rom_size &&
+            rom[i] == i &&
+            (rom[i + 1] & HC_JUMP) == HC_JUMP &&
+            (rom[i + 1] & HC_IS_C)) {
+            is_halt[i] = true;
+        }
+    }
+}
+
+static bool execute(long max_cycles)
+{
+    int pc = 0;
+    short a = 0;
+    short d = 0;
+    int function = 0;
+    int previous_owner = -1;
+    long cycles = 0;
+
+    while (pc < rom_size && !is_halt[pc]) {
+        if (cycles == max_cycles) {
+            printf("The program didn't halt within %ld cycles\n", max_cycles);
+            stats.cycles = cycles;
+            return false;
+        }
+
+        int owner = owners[pc];
+
+        // Calls arrive at the entry from other code, while loops
+        // starting at the entry come back from within.
+        if (owner >= 0) {
+            if (owner != previous_owner && function_addresses[owner] == pc) {
+                functions[owner].calls++;
+            }
+            function = owner;
+        }
+        previous_owner = owner;
+
+        functions[function].cycles++;
+        cycles++;
+
+        unsigned short instruction = rom[pc];
+
+        if (!(instruction & HC_IS_C)) {
+            a = instruction;
+            pc++;
+            continue;
+        }
+
+        int x = d;
+        int y = instruction & HC_READS_M ? ram[a & HC_ADDRESS_MASK] : a;
+
+        if (instruction & HC_ZERO_X) {
+            x = 0;
+        }
+        if (instruction & HC_NEGATE_X) {
+            x = ~x;
+        }
+        if (instruction & HC_ZERO_Y) {
+            y = 0;
+        }
+        if (instruction & HC_NEGATE_Y) {
+            y = ~y;
+        }
+
+        int out = instruction & HC_ADD ? x + y : x & y;
+
+        if (instruction & HC_NEGATE_OUT) {
+            out = ~out;
+        }
+
+        short result = (short)out;
+        int target = a & HC_ADDRESS_MASK;
+
+        // Registers load at the end of the cycle: M and the jump
+        // target both use the A the instruction started with.
+        if ((instruction & HC_DEST_M) && target != HC_KEYBOARD) {
+            ram[target] = result;
+        }
+        if (instruction & HC_DEST_A) {
+            a = result;
+        }
+        if (instruction & HC_DEST_D) {
+            d = result;
+        }
+
+        if (((instruction & HC_JUMP_LT) && result < 0) ||
+            ((instruction & HC_JUMP_EQ) && result == 0) ||
+            ((instruction & HC_JUMP_GT) && result > 0)) {
+            pc = target;
+        } else {
+            pc++;
+        }
+    }
+
+    stats.cycles = cycles;
+
+    return true;
+}
+
+static void collect_stats()
+{
+    for (int i = 0; i < stats.functions_count; i++) {
+        free(stats.functions[i].name);
+    }
+    free(stats.functions);
+
+    stats.functions = malloc(sizeof(HC_Function_stats) * (functions_count + 1));
+    stats.functions_count = 0;
+    stats.rom_size = rom_size;
+
+    for (int i = 0; i < functions_count; i++) {
+        if (functions[i].cycles > 0) {
+            stats.functions[stats.functions_count++] = (HC_Function_stats){
+                strdup(functions[i].name),
+                functions[i].calls,
+                functions[i].cycles
+            };
+        }
+    }
+
+    qsort(
+        stats.functions,
+        stats.functions_count,
+        sizeof(HC_Function_stats),
+        compare_function_stats
+    );
+}
+
+static int compare_function_stats(const void *a, const void *b)
+{
+    const HC_Function_stats *first = a;
+    const HC_Function_stats *second = b;
+
+    if (first->cycles != second->cycles) {
+        return first->cycles < second->cycles ? 1 : -1;
+    }
+
+    return strcmp(first->name, second->name);
+}
+
+static void free_program()
+{
+    for (int i = 0; i < HT_MAX_COUNT; i++) {
+        ll_free(&symbols.values[i]);
+    }
+
+    for (int i = 0; i < symbols_count; i++) {
+        free(symbols_list[i]->name);
+        free(symbols_list[i]);
+    }
+
+    for (int i = 0; i < lines_count; i++) {
+        free(lines[i]);
+    }
+
+    for (int i = 0; i < functions_count; i++) {
+        free(functions[i].name);
+    }
+
+    free(symbols_list);
+    free(lines);
+    free(functions);
+    free(function_addresses);
+    free(rom);
+    free(owners);
+    free(is_halt);
+
+    symbols_list = NULL;
+    lines = NULL;
+    functions = NULL;
+    function_addresses = NULL;
+    rom = NULL;
+    owners = NULL;
+    is_halt = NULL;
+    symbols_count = symbols_capacity = 0;
+    lines_count = lines_capacity = 0;
+    functions_count = functions_capacity = 0;
+    rom_size = 0;
+}
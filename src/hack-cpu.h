@@ -0,0 +1,40 @@
+#ifndef HC_HACK_CPU
+#define HC_HACK_CPU
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define HC_MAX_CYCLES   4000000000L
+
+typedef struct {
+    char *name;
+    long calls;
+    long cycles;
+} HC_Function_stats;
+
+// Profile of the last run. Every cycle is charged to the function
+// whose code is running, and code before the first function label,
+// like the call and return routines, to the function that jumped
+// into it. The functions are sorted by cycles.
+typedef struct {
+    long cycles;
+    int rom_size;
+    HC_Function_stats *functions;
+    int functions_count;
+} HC_Stats;
+
+// Hack CPU simulator: assembles the file and runs it from address 0
+// until it halts, by jumping to the very instruction that jumps, or
+// until max_cycles. Functions are recognized by labels without a $,
+// as both this compiler and the standard VM translator name them.
+// The keyboard is never pressed and the screen is plain memory.
+// Returns false after printing the error when the file can't be
+// assembled or the program doesn't halt in time.
+bool hc_run(FILE *file, long max_cycles);
+
+// RAM as left by the last run.
+short hc_ram(int address);
+
+HC_Stats hc_stats();
+
+#endif
@@ -7,7 +7,9 @@ typedef struct {
     void *data;
 } HT_Entry;
 
-LL_Node *ht_node(const char *key, const HT_Table *table);
+LL_Node *ht_node(const char *key, const HT_Table *table, int *probes);
+static void ht_count_lookup(HT_Counters *counters, bool hit, int probes);
+static int ht_histogram_slot(long value);
 
 int ht_hash(const char *key)
 {
@@ -30,6 +32,7 @@ HT_Table ht_make_empty_table()
     for (short i = 0; i < HT_MAX_COUNT; i++) {
         table.values[i] = ll_make_empty_list();
     }
+    table.counters = NULL;
 
     return table;
 }
@@ -40,7 +43,7 @@ void ht_store(
     HT_Table *table
 ) {
     short index = ht_hash(key);
-    LL_Node *node = ht_node(key, table);
+    LL_Node *node = ht_node(key, table, NULL);
 
     HT_Entry entry;
     entry.key = (char *)key;
@@ -60,7 +63,12 @@ void ht_store(
 
 void *ht_value(const char *key, const HT_Table *table)
 {
-    LL_Node *node = ht_node(key, table);
+    int probes = 0;
+    LL_Node *node = ht_node(key, table, &probes);
+
+    if (table->counters != NULL) {
+        ht_count_lookup(table->counters, node != NULL, probes);
+    }
     
     if (node == NULL) {
         return NULL;
@@ -71,7 +79,8 @@ void *ht_value(const char *key, const HT_Table *table)
 
 LL_Node *ht_node(
     const char *key, 
-    const HT_Table *table
+    const HT_Table *table,
+    int *probes
 ) {
     short index = ht_hash(key);
     LL_List list = table->values[index];
@@ -84,6 +93,9 @@ LL_Node *ht_node(
 
     while (node != NULL) {
         HT_Entry entry = *(HT_Entry *)node->data;
+        if (probes != NULL) {
+            (*probes)++;
+        }
         if (strcmp(key, entry.key) == 0) {
             return node;
         }
@@ -93,3 +105,63 @@ LL_Node *ht_node(
     return NULL;
 }
 
+void ht_enable_stats(HT_Table *table)
+{
+    if (table->counters == NULL) {
+        table->counters = calloc(1, sizeof(HT_Counters));
+    }
+}
+
+HT_Stats ht_stats(const HT_Table *table)
+{
+    HT_Stats stats;
+    memset(&stats, 0, sizeof(HT_Stats));
+    stats.buckets = HT_MAX_COUNT;
+
+    for (short i = 0; i < HT_MAX_COUNT; i++) {
+        int chain = table->values[i].count;
+
+        if (chain > 0) {
+            stats.buckets_used++;
+            stats.entries += chain;
+        }
+        if (chain > stats.max_chain) {
+            stats.max_chain = chain;
+        }
+        stats.chains_histogram[ht_histogram_slot(chain)]++;
+    }
+
+    if (stats.buckets_used > 0) {
+        stats.mean_chain = (double)stats.entries / stats.buckets_used;
+    }
+    stats.load_factor = (double)stats.entries / stats.buckets;
+
+    if (table->counters != NULL) {
+        stats.has_counters = true;
+        stats.counters = *table->counters;
+    }
+
+    return stats;
+}
+
+static void ht_count_lookup(HT_Counters *counters, bool hit, int probes)
+{
+    counters->lookups++;
+    counters->probes += probes;
+
+    if (hit) {
+        counters->hits++;
+    } else {
+        counters->misses++;
+    }
+
+    if (probes > counters->max_probes) {
+        counters->max_probes = probes;
+    }
+    counters->probes_histogram[ht_histogram_slot(probes)]++;
+}
+
+static int ht_histogram_slot(long value)
+{
+    return value < HT_HISTOGRAM_SIZE - 1 ? value : HT_HISTOGRAM_SIZE - 1;
+}
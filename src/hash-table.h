@@ -5,15 +5,46 @@
 #include "linked-list.h"
 
 #define HT_MAX_COUNT 500
+#define HT_HISTOGRAM_SIZE 8
+
+// Lookup counters, only allocated once stats are enabled
+// for a table, so untracked tables pay nothing for them.
+typedef struct {
+    long lookups;
+    long hits;
+    long misses;
+    long probes;
+    long max_probes;
+    long probes_histogram[HT_HISTOGRAM_SIZE];
+} HT_Counters;
 
 typedef struct {
     LL_List values[HT_MAX_COUNT];
+    HT_Counters *counters;
 } HT_Table;
 
+// Snapshot of the table's shape plus its lookup counters.
+// The last histogram slot accumulates every length that
+// doesn't fit in the previous ones.
+typedef struct {
+    int entries;
+    int buckets;
+    int buckets_used;
+    int max_chain;
+    double mean_chain;
+    double load_factor;
+    long chains_histogram[HT_HISTOGRAM_SIZE];
+    bool has_counters;
+    HT_Counters counters;
+} HT_Stats;
+
 HT_Table ht_make_empty_table();
 
 void ht_store(const char *key, const void *data,  HT_Table *table);
 
 void *ht_value(const char *key, const HT_Table *table);
 
+void ht_enable_stats(HT_Table *table);
+HT_Stats ht_stats(const HT_Table *table);
+
 #endif
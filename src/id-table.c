@@ -1,16 +1,131 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "id-table.h"
 #include "hash-table.h"
+#include "pool.h"
+
+#define IDT_REGISTRY_SHARDS 64
 
 static HT_Table *table = NULL;
+static PL_Pool *entries_pool = NULL;
+static PL_Pool *vars_pool = NULL;
+
+// Class registry. Each class is an immutable table holding its
+// entry and its subroutines, indexed by an open addressing hash.
+// Classes are spread over shards; a shard publishes an immutable
+// snapshot of its classes through an atomic pointer, so lookups
+// never lock. Writers serialize on the shard's lock, copy the
+// snapshot with their change applied and publish the copy.
+// Replaced snapshots and tables are never freed, which keeps any
+// pointer handed to a reader valid.
+typedef struct {
+    uint32_t hash;
+    IDT_Class_Entry class;
+    int subroutines_count;
+    int slots_count;
+    IDT_Subroutine_Entry *subroutines;
+    int *slots;
+} IDT_Class_Table;
+
+typedef struct {
+    int count;
+    IDT_Class_Table *classes[];
+} IDT_Shard_snapshot;
+
+typedef struct {
+    pthread_mutex_t lock;
+    _Atomic(IDT_Shard_snapshot *) snapshot;
+} IDT_Shard;
+
+static IDT_Shard shards[IDT_REGISTRY_SHARDS];
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+static _Atomic int max_statics_count = 0;
+
+typedef struct {
+    char *class_name;
+    char *name;
+    IDT_Subroutine_Kind kind;
+    int params_count;
+    bool is_void;
+} IDT_Os_Signature;
+
+// The Jack OS API, so calls into it can be resolved and checked
+// like calls into the project's own classes.
+static const IDT_Os_Signature os_signatures[] = {
+    { "Math", "init", IDT_FUNCTION, 0, true },
+    { "Math", "abs", IDT_FUNCTION, 1, false },
+    { "Math", "multiply", IDT_FUNCTION, 2, false },
+    { "Math", "divide", IDT_FUNCTION, 2, false },
+    { "Math", "min", IDT_FUNCTION, 2, false },
+    { "Math", "max", IDT_FUNCTION, 2, false },
+    { "Math", "sqrt", IDT_FUNCTION, 1, false },
+    { "String", "new", IDT_CONSTRUCTOR, 1, false },
+    { "String", "dispose", IDT_METHOD, 0, true },
+    { "String", "length", IDT_METHOD, 0, false },
+    { "String", "charAt", IDT_METHOD, 1, false },
+    { "String", "setCharAt", IDT_METHOD, 2, true },
+    { "String", "appendChar", IDT_METHOD, 1, false },
+    { "String", "eraseLastChar", IDT_METHOD, 0, true },
+    { "String", "intValue", IDT_METHOD, 0, false },
+    { "String", "setInt", IDT_METHOD, 1, true },
+    { "String", "backSpace", IDT_FUNCTION, 0, false },
+    { "String", "doubleQuote", IDT_FUNCTION, 0, false },
+    { "String", "newLine", IDT_FUNCTION, 0, false },
+    { "Array", "new", IDT_FUNCTION, 1, false },
+    { "Array", "dispose", IDT_METHOD, 0, true },
+    { "Output", "init", IDT_FUNCTION, 0, true },
+    { "Output", "moveCursor", IDT_FUNCTION, 2, true },
+    { "Output", "printChar", IDT_FUNCTION, 1, true },
+    { "Output", "printString", IDT_FUNCTION, 1, true },
+    { "Output", "printInt", IDT_FUNCTION, 1, true },
+    { "Output", "println", IDT_FUNCTION, 0, true },
+    { "Output", "backSpace", IDT_FUNCTION, 0, true },
+    { "Screen", "init", IDT_FUNCTION, 0, true },
+    { "Screen", "clearScreen", IDT_FUNCTION, 0, true },
+    { "Screen", "setColor", IDT_FUNCTION, 1, true },
+    { "Screen", "drawPixel", IDT_FUNCTION, 2, true },
+    { "Screen", "drawLine", IDT_FUNCTION, 4, true },
+    { "Screen", "drawRectangle", IDT_FUNCTION, 4, true },
+    { "Screen", "drawCircle", IDT_FUNCTION, 3, true },
+    { "Keyboard", "init", IDT_FUNCTION, 0, true },
+    { "Keyboard", "keyPressed", IDT_FUNCTION, 0, false },
+    { "Keyboard", "readChar", IDT_FUNCTION, 0, false },
+    { "Keyboard", "readLine", IDT_FUNCTION, 1, false },
+    { "Keyboard", "readInt", IDT_FUNCTION, 1, false },
+    { "Memory", "init", IDT_FUNCTION, 0, true },
+    { "Memory", "peek", IDT_FUNCTION, 1, false },
+    { "Memory", "poke", IDT_FUNCTION, 2, true },
+    { "Memory", "alloc", IDT_FUNCTION, 1, false },
+    { "Memory", "deAlloc", IDT_FUNCTION, 1, true },
+    { "Sys", "init", IDT_FUNCTION, 0, true },
+    { "Sys", "halt", IDT_FUNCTION, 0, true },
+    { "Sys", "error", IDT_FUNCTION, 1, true },
+    { "Sys", "wait", IDT_FUNCTION, 1, true }
+};
+
+static char *subroutine_key(const char *class_name, const char *name);
+static void registry_init();
+static uint32_t registry_hash(const char *str);
+static IDT_Class_Table *registry_class(const char *name, uint32_t hash);
+static IDT_Class_Table *make_class_table(
+    const IDT_Class_Entry *class,
+    const IDT_Subroutine_Entry *subroutines,
+    int subroutines_count
+);
+static void publish_class(IDT_Class_Table *class_table);
 
 void idt_init()
 {
     if (table == NULL) {
         table = malloc(sizeof(HT_Table));
         *table = ht_make_empty_table();
+
+        entries_pool = pl_make_typed_pool(IDT_Entry);
+        vars_pool = pl_make_typed_pool(IDT_Var_Entry);
     }
 }
 
@@ -22,8 +137,8 @@ void idt_store_var(
 ) {
     idt_init();
 
-    IDT_Entry *entry = malloc(sizeof(IDT_Entry));
-    IDT_Var_Entry *var = malloc(sizeof(IDT_Var_Entry));
+    IDT_Entry *entry = pl_alloc(entries_pool);
+    IDT_Var_Entry *var = pl_alloc(vars_pool);
     var->category = category;
     var->key = (char *)key;
     var->index = index;
@@ -34,21 +149,141 @@ void idt_store_var(
 }
 
 void idt_store_subroutine(
-    const char *key,
+    const char *class_name,
+    const char *name,
+    IDT_Subroutine_Kind kind,
+    int params_count,
     const bool is_void
 ) {
-    idt_init();
+    pthread_once(&registry_once, registry_init);
 
-    IDT_Entry *entry = malloc(sizeof(IDT_Entry));
-    IDT_Subroutine_Entry *subroutine = malloc(sizeof(IDT_Subroutine_Entry));
-    subroutine->key = (char *)key;
-    subroutine->is_void = (bool)is_void;
-    entry->subroutine = subroutine;
+    uint32_t hash = registry_hash(class_name);
+    IDT_Shard *shard = &shards[hash % IDT_REGISTRY_SHARDS];
 
-    ht_store(key, (void *)entry, table);
+    pthread_mutex_lock(&shard->lock);
+
+    IDT_Class_Table *current = registry_class(class_name, hash);
+    IDT_Class_Entry class = { (char *)class_name, 0, 0 };
+    int count = 0;
+
+    if (current != NULL) {
+        class = current->class;
+        count = current->subroutines_count;
+    }
+
+    IDT_Subroutine_Entry subroutines[count + 1];
+    int replaced = -1;
+
+    for (int i = 0; i < count; i++) {
+        subroutines[i] = current->subroutines[i];
+
+        if (strcmp(subroutines[i].name, name) == 0) {
+            replaced = i;
+        }
+    }
+
+    IDT_Subroutine_Entry subroutine;
+    subroutine.key = NULL;
+    subroutine.class_name = (char *)class_name;
+    subroutine.name = (char *)name;
+    subroutine.kind = kind;
+    subroutine.params_count = params_count;
+    subroutine.is_void = (bool)is_void;
+
+    if (replaced >= 0) {
+        subroutines[replaced] = subroutine;
+    } else {
+        subroutines[count] = subroutine;
+        count++;
+    }
+
+    publish_class(make_class_table(&class, subroutines, count));
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void idt_store_class(
+    const char *name,
+    int fields_count,
+    int statics_count
+) {
+    pthread_once(&registry_once, registry_init);
+
+    uint32_t hash = registry_hash(name);
+    IDT_Shard *shard = &shards[hash % IDT_REGISTRY_SHARDS];
+
+    pthread_mutex_lock(&shard->lock);
+
+    IDT_Class_Table *current = registry_class(name, hash);
+    IDT_Class_Entry class = { (char *)name, fields_count, statics_count };
+
+    publish_class(make_class_table(
+        &class, 
+        current != NULL ? current->subroutines : NULL, 
+        current != NULL ? current->subroutines_count : 0
+    ));
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void idt_store_class_signatures(
+    const char *name,
+    int fields_count,
+    int statics_count,
+    const IDT_Subroutine_Entry *subroutines,
+    int subroutines_count
+) {
+    pthread_once(&registry_once, registry_init);
+
+    IDT_Shard *shard = &shards[registry_hash(name) % IDT_REGISTRY_SHARDS];
+    IDT_Class_Entry class = { (char *)name, fields_count, statics_count };
+
+    IDT_Class_Table *class_table = make_class_table(
+        &class, 
+        subroutines, 
+        subroutines_count
+    );
+
+    pthread_mutex_lock(&shard->lock);
+    publish_class(class_table);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void idt_store_os_signatures()
+{
+    int count = sizeof(os_signatures) / sizeof(IDT_Os_Signature);
+    IDT_Subroutine_Entry subroutines[count];
+    int first = 0;
+
+    for (int i = 0; i < count; i++) {
+        IDT_Os_Signature signature = os_signatures[i];
+
+        subroutines[i].key = NULL;
+        subroutines[i].class_name = signature.class_name;
+        subroutines[i].name = signature.name;
+        subroutines[i].kind = signature.kind;
+        subroutines[i].params_count = signature.params_count;
+        subroutines[i].is_void = signature.is_void;
+
+        bool is_last = i == count - 1 || 
+            strcmp(signature.class_name, os_signatures[i + 1].class_name) != 0;
+
+        if (is_last) {
+            idt_store_class_signatures(
+                signature.class_name, 
+                0, 
+                0, 
+                &subroutines[first], 
+                i - first + 1
+            );
+            first = i + 1;
+        }
+    }
 }
 
 IDT_Entry *idt_entry(const char *key) {
+    idt_init();
+
     void *data = ht_value(key, table);
 
     if (data == NULL) {
@@ -58,3 +293,200 @@ IDT_Entry *idt_entry(const char *key) {
     return (IDT_Entry *)data;
 }
 
+IDT_Subroutine_Entry *idt_subroutine(const char *class_name, const char *name)
+{
+    pthread_once(&registry_once, registry_init);
+
+    IDT_Class_Table *class_table = registry_class(
+        class_name, 
+        registry_hash(class_name)
+    );
+
+    if (class_table == NULL || class_table->subroutines_count == 0) {
+        return NULL;
+    }
+
+    int mask = class_table->slots_count - 1;
+    int slot = registry_hash(name) & mask;
+
+    while (class_table->slots[slot] >= 0) {
+        IDT_Subroutine_Entry *subroutine = 
+            &class_table->subroutines[class_table->slots[slot]];
+
+        if (strcmp(subroutine->name, name) == 0) {
+            return subroutine;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return NULL;
+}
+
+IDT_Class_Entry *idt_class(const char *name)
+{
+    pthread_once(&registry_once, registry_init);
+
+    IDT_Class_Table *class_table = registry_class(name, registry_hash(name));
+
+    if (class_table == NULL) {
+        return NULL;
+    }
+
+    return &class_table->class;
+}
+
+int idt_max_statics_count()
+{
+    return atomic_load(&max_statics_count);
+}
+
+void idt_enable_stats()
+{
+    idt_init();
+    ht_enable_stats(table);
+}
+
+HT_Stats idt_stats()
+{
+    idt_init();
+    return ht_stats(table);
+}
+
+static char *subroutine_key(const char *class_name, const char *name)
+{
+    char *key = malloc(strlen(class_name) + strlen(name) + 2);
+    sprintf(key, "%s.%s", class_name, name);
+    return key;
+}
+
+static void registry_init()
+{
+    for (int i = 0; i < IDT_REGISTRY_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        atomic_init(&shards[i].snapshot, NULL);
+    }
+}
+
+// FNV-1a
+static uint32_t registry_hash(const char *str)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*str != '\0') {
+        hash ^= (unsigned char)*str;
+        hash *= 16777619u;
+        str++;
+    }
+
+    return hash;
+}
+
+static IDT_Class_Table *registry_class(const char *name, uint32_t hash)
+{
+    IDT_Shard *shard = &shards[hash % IDT_REGISTRY_SHARDS];
+    IDT_Shard_snapshot *snapshot = atomic_load_explicit(
+        &shard->snapshot, 
+        memory_order_acquire
+    );
+
+    if (snapshot == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < snapshot->count; i++) {
+        IDT_Class_Table *class_table = snapshot->classes[i];
+
+        if (class_table->hash == hash && strcmp(class_table->class.key, name) == 0) {
+            return class_table;
+        }
+    }
+
+    return NULL;
+}
+
+// Builds the class and its subroutines index in one allocation.
+static IDT_Class_Table *make_class_table(
+    const IDT_Class_Entry *class,
+    const IDT_Subroutine_Entry *subroutines,
+    int subroutines_count
+) {
+    int slots_count = 1;
+    while (slots_count < subroutines_count * 2) {
+        slots_count *= 2;
+    }
+
+    IDT_Class_Table *class_table = malloc(
+        sizeof(IDT_Class_Table) +
+        sizeof(IDT_Subroutine_Entry) * subroutines_count +
+        sizeof(int) * slots_count
+    );
+    class_table->hash = registry_hash(class->key);
+    class_table->class = *class;
+    class_table->subroutines_count = subroutines_count;
+    class_table->slots_count = slots_count;
+    class_table->subroutines = (IDT_Subroutine_Entry *)(class_table + 1);
+    class_table->slots = (int *)(class_table->subroutines + subroutines_count);
+
+    int mask = slots_count - 1;
+    for (int i = 0; i < slots_count; i++) {
+        class_table->slots[i] = -1;
+    }
+
+    for (int i = 0; i < subroutines_count; i++) {
+        IDT_Subroutine_Entry subroutine = subroutines[i];
+        subroutine.class_name = class->key;
+        if (subroutine.key == NULL) {
+            subroutine.key = subroutine_key(class->key, subroutine.name);
+        }
+        class_table->subroutines[i] = subroutine;
+
+        int slot = registry_hash(subroutine.name) & mask;
+        while (class_table->slots[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        class_table->slots[slot] = i;
+    }
+
+    return class_table;
+}
+
+// Must be called holding the lock of the class's shard.
+static void publish_class(IDT_Class_Table *class_table)
+{
+    IDT_Shard *shard = &shards[class_table->hash % IDT_REGISTRY_SHARDS];
+    IDT_Shard_snapshot *current = atomic_load_explicit(
+        &shard->snapshot, 
+        memory_order_relaxed
+    );
+    int count = current != NULL ? current->count : 0;
+
+    IDT_Shard_snapshot *snapshot = malloc(
+        sizeof(IDT_Shard_snapshot) + sizeof(IDT_Class_Table *) * (count + 1)
+    );
+    snapshot->count = 0;
+
+    for (int i = 0; i < count; i++) {
+        IDT_Class_Table *other = current->classes[i];
+
+        if (other->hash == class_table->hash && 
+            strcmp(other->class.key, class_table->class.key) == 0) {
+            continue;
+        }
+        snapshot->classes[snapshot->count] = other;
+        snapshot->count++;
+    }
+
+    snapshot->classes[snapshot->count] = class_table;
+    snapshot->count++;
+
+    atomic_store_explicit(&shard->snapshot, snapshot, memory_order_release);
+
+    int statics_count = atomic_load(&max_statics_count);
+    while (class_table->class.statics_count > statics_count &&
+        !atomic_compare_exchange_weak(
+            &max_statics_count, 
+            &statics_count, 
+            class_table->class.statics_count
+        )) {
+    }
+}
@@ -2,6 +2,7 @@
 #define ID_TABLE
 
 #include <stdbool.h>
+#include "hash-table.h"
 
 typedef enum {
     IDT_STATIC,
@@ -17,14 +18,29 @@ typedef struct {
     IDT_Category category;
 } IDT_Var_Entry;
 
+typedef enum {
+    IDT_FUNCTION,
+    IDT_METHOD,
+    IDT_CONSTRUCTOR
+} IDT_Subroutine_Kind;
+
 typedef struct {
     char *key;
+    char *class_name;
+    char *name;
+    IDT_Subroutine_Kind kind;
+    int params_count;
     bool is_void;
 } IDT_Subroutine_Entry;
 
+typedef struct {
+    char *key;
+    int fields_count;
+    int statics_count;
+} IDT_Class_Entry;
+
 typedef struct {
     IDT_Var_Entry *var;
-    IDT_Subroutine_Entry *subroutine;
 } IDT_Entry;
 
 void idt_store_var(
@@ -33,10 +49,35 @@ void idt_store_var(
     int index, 
     IDT_Category category
 );
+// Classes and subroutines live in a registry whose lookups take no
+// lock and may run concurrently with stores from other threads.
 void idt_store_subroutine(
-    const char *key,
+    const char *class_name,
+    const char *name,
+    IDT_Subroutine_Kind kind,
+    int params_count,
     const bool is_void
 );
+void idt_store_class(
+    const char *name,
+    int fields_count,
+    int statics_count
+);
+void idt_store_class_signatures(
+    const char *name,
+    int fields_count,
+    int statics_count,
+    const IDT_Subroutine_Entry *subroutines,
+    int subroutines_count
+);
+void idt_store_os_signatures();
 IDT_Entry *idt_entry(const char *key);
+IDT_Subroutine_Entry *idt_subroutine(const char *class_name, const char *name);
+IDT_Class_Entry *idt_class(const char *name);
+// Largest statics count among the stored classes.
+int idt_max_statics_count();
+
+void idt_enable_stats();
+HT_Stats idt_stats();
 
 #endif
@@ -0,0 +1,371 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "licm.h"
+#include "cfg.h"
+
+// Hoisting costs the expression plus a pop once, and saves all but a
+// push on every iteration, so shorter expressions aren't worth it on
+// loops running only a few times.
+#define LICM_MIN_LENGTH 3
+
+// Value on the stack while scanning a block: the instructions
+// [start, end] computing it, whether all of them are invariant and
+// how many of them are operations rather than pushes.
+typedef struct {
+    int start;
+    int end;
+    bool is_invariant;
+    int operations;
+} LICM_Value;
+
+// Instructions [start, end] get replaced by a push of local.
+typedef struct {
+    int start;
+    int end;
+    int local;
+    bool is_first;
+} LICM_Hoist;
+
+// What a loop may change.
+typedef struct {
+    VM_Instruction *pops;
+    int pops_count;
+    bool has_call;
+    bool writes_that;
+    bool writes_this_pointer;
+} LICM_Writes;
+
+static LICM_Stats stats;
+
+static bool hoist_function(VM_Function *function);
+static bool hoist_loop(VM_Function *function, CFG_Graph *graph, int loop);
+static int insertion_point(VM_Function *function, CFG_Graph *graph, int loop);
+static LICM_Writes loop_writes(VM_Function *function, CFG_Graph *graph, int loop);
+static int find_hoists(VM_Function *function, CFG_Block *block, LICM_Writes *writes, LICM_Hoist *hoists, int count);
+static int add_hoist(LICM_Value value, LICM_Hoist *hoists, int count);
+static bool is_invariant(VM_Instruction instruction, LICM_Writes *writes);
+static bool is_popped(VM_Segment segment, int index, LICM_Writes *writes);
+static void assign_locals(VM_Function *function, LICM_Hoist *hoists, int count);
+static void rewrite(VM_Function *function, LICM_Hoist *hoists, int count, int insertion);
+static int compare_hoists(const void *a, const void *b);
+
+void licm_hoist(VM_Class *class)
+{
+    for (int i = 0; i < class->functions_count; i++) {
+        while (hoist_function(&class->functions[i])) {
+        }
+    }
+}
+
+LICM_Stats licm_stats()
+{
+    return stats;
+}
+
+// Hoists out of the innermost loop that has something to hoist. The
+// graph is rebuilt after every change, so code hoisted into an outer
+// loop gets its own chance to move further out.
+static bool hoist_function(VM_Function *function)
+{
+    CFG_Graph *graph = cfg_build(function);
+    bool changed = false;
+
+    for (int depth = graph->loops_count; depth > 0 && !changed; depth--) {
+        for (int loop = 0; loop < graph->loops_count && !changed; loop++) {
+            if (graph->loops[loop].depth == depth) {
+                changed = hoist_loop(function, graph, loop);
+            }
+        }
+    }
+
+    cfg_free(graph);
+
+    return changed;
+}
+
+static bool hoist_loop(VM_Function *function, CFG_Graph *graph, int loop)
+{
+    int insertion = insertion_point(function, graph, loop);
+
+    if (insertion < 0) {
+        return false;
+    }
+
+    LICM_Writes writes = loop_writes(function, graph, loop);
+    LICM_Hoist *hoists = malloc(sizeof(LICM_Hoist) * (function->count + 1));
+    int count = 0;
+
+    for (int block = 0; block < graph->blocks_count; block++) {
+        if (cfg_loop_contains(graph, loop, block)) {
+            count = find_hoists(function, &graph->blocks[block], &writes, hoists, count);
+        }
+    }
+
+    if (count > 0) {
+        qsort(hoists, count, sizeof(LICM_Hoist), compare_hoists);
+        assign_locals(function, hoists, count);
+        rewrite(function, hoists, count, insertion);
+    }
+
+    free(writes.pops);
+    free(hoists);
+
+    return count > 0;
+}
+
+// Hoisted code goes at the end of the only block entering the loop
+// from outside, before its jump to the header. That block must lead
+// nowhere else. A loop starting the function is entered on the first
+// instruction instead.
+static int insertion_point(VM_Function *function, CFG_Graph *graph, int loop)
+{
+    int header = graph->loops[loop].header;
+    CFG_Block *header_block = &graph->blocks[header];
+    int entry = CFG_NONE;
+
+    for (int i = 0; i < header_block->predecessors_count; i++) {
+        int predecessor = header_block->predecessors[i];
+
+        if (cfg_loop_contains(graph, loop, predecessor) ||
+            !graph->blocks[predecessor].is_reachable) {
+            continue;
+        }
+        if (entry != CFG_NONE) {
+            return CFG_NONE;
+        }
+        entry = predecessor;
+    }
+
+    if (entry == CFG_NONE) {
+        return header == 0 ? 0 : CFG_NONE;
+    }
+
+    CFG_Block *entry_block = &graph->blocks[entry];
+
+    if (entry_block->successors_count != 1) {
+        return CFG_NONE;
+    }
+
+    VM_Opcode last = function->instructions[entry_block->end - 1].opcode;
+
+    return last == VM_GOTO ? entry_block->end - 1 : entry_block->end;
+}
+
+static LICM_Writes loop_writes(VM_Function *function, CFG_Graph *graph, int loop)
+{
+    LICM_Writes writes = { malloc(sizeof(VM_Instruction) * (function->count + 1)), 0 };
+
+    for (int block = 0; block < graph->blocks_count; block++) {
+        if (!cfg_loop_contains(graph, loop, block)) {
+            continue;
+        }
+
+        for (int i = graph->blocks[block].start; i < graph->blocks[block].end; i++) {
+            VM_Instruction instruction = function->instructions[i];
+
+            if (instruction.opcode == VM_CALL) {
+                writes.has_call = true;
+
+            } else if (instruction.opcode == VM_POP) {
+                writes.pops[writes.pops_count++] = instruction;
+                writes.writes_that |= instruction.segment == VM_SEGMENT_THAT;
+                writes.writes_this_pointer |= 
+                    instruction.segment == VM_SEGMENT_POINTER && instruction.operand == 0;
+            }
+        }
+    }
+
+    return writes;
+}
+
+// Replays the block's stack effects. An invariant value is hoisted
+// once something that isn't invariant consumes it, which makes it the
+// largest invariant expression around that spot. Values crossing
+// block boundaries are never hoisted.
+static int find_hoists(VM_Function *function, CFG_Block *block, LICM_Writes *writes, LICM_Hoist *hoists, int count)
+{
+    LICM_Value *stack = malloc(sizeof(LICM_Value) * (block->end - block->start + 1));
+    LICM_Value unknown = { CFG_NONE, CFG_NONE, false, 0 };
+    int stack_count = 0;
+
+    for (int i = block->start; i < block->end; i++) {
+        VM_Instruction instruction = function->instructions[i];
+        VM_Opcode opcode = instruction.opcode;
+
+        if (opcode == VM_PUSH) {
+            stack[stack_count++] = (LICM_Value){ i, i, is_invariant(instruction, writes), 0 };
+
+        } else if (opcode == VM_NEG || opcode == VM_NOT) {
+            if (stack_count > 0) {
+                stack[stack_count - 1].end = i;
+                stack[stack_count - 1].operations++;
+            }
+
+        } else if (opcode == VM_ADD || opcode == VM_SUB ||
+                   opcode == VM_AND || opcode == VM_OR ||
+                   opcode == VM_EQ || opcode == VM_LT || opcode == VM_GT) {
+            LICM_Value right = stack_count > 0 ? stack[--stack_count] : unknown;
+            LICM_Value left = stack_count > 0 ? stack[--stack_count] : unknown;
+            LICM_Value result = { left.start, i, false, 0 };
+
+            if (left.is_invariant && right.is_invariant) {
+                result.is_invariant = true;
+                result.operations = left.operations + right.operations + 1;
+            } else {
+                count = add_hoist(left, hoists, count);
+                count = add_hoist(right, hoists, count);
+            }
+
+            stack[stack_count++] = result;
+
+        } else {
+            int consumed = 0;
+
+            if (opcode == VM_CALL) {
+                consumed = instruction.operand;
+            } else if (opcode == VM_POP || opcode == VM_IF_GOTO || opcode == VM_RETURN) {
+                consumed = 1;
+            }
+
+            for (int j = 0; j < consumed && stack_count > 0; j++) {
+                count = add_hoist(stack[--stack_count], hoists, count);
+            }
+
+            if (opcode == VM_CALL) {
+                stack[stack_count++] = (LICM_Value){ i, i, false, 0 };
+            }
+        }
+    }
+
+    free(stack);
+
+    return count;
+}
+
+static int add_hoist(LICM_Value value, LICM_Hoist *hoists, int count)
+{
+    if (value.is_invariant &&
+        value.operations > 0 &&
+        value.end - value.start + 1 >= LICM_MIN_LENGTH) {
+        hoists[count++] = (LICM_Hoist){ value.start, value.end, CFG_NONE, false };
+    }
+
+    return count;
+}
+
+// Statics and fields can be changed by callees and, through aliasing,
+// by writes to THAT, so they only count when the loop does neither.
+static bool is_invariant(VM_Instruction instruction, LICM_Writes *writes)
+{
+    VM_Segment segment = instruction.segment;
+    bool is_memory_stable = !writes->has_call && !writes->writes_that;
+
+    if (segment == VM_SEGMENT_CONSTANT) {
+        return true;
+
+    } else if (segment == VM_SEGMENT_LOCAL || segment == VM_SEGMENT_ARGUMENT) {
+        return !is_popped(segment, instruction.operand, writes);
+
+    } else if (segment == VM_SEGMENT_STATIC) {
+        return is_memory_stable && !is_popped(segment, instruction.operand, writes);
+
+    } else if (segment == VM_SEGMENT_THIS) {
+        return is_memory_stable && 
+            !writes->writes_this_pointer && 
+            !is_popped(segment, instruction.operand, writes);
+    }
+
+    return false;
+}
+
+static bool is_popped(VM_Segment segment, int index, LICM_Writes *writes)
+{
+    for (int i = 0; i < writes->pops_count; i++) {
+        if (writes->pops[i].segment == segment && writes->pops[i].operand == index) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Identical expressions share the local of the first one.
+static void assign_locals(VM_Function *function, LICM_Hoist *hoists, int count)
+{
+    for (int i = 0; i < count; i++) {
+        int length = hoists[i].end - hoists[i].start + 1;
+
+        for (int j = 0; j < i && hoists[i].local == CFG_NONE; j++) {
+            if (hoists[j].end - hoists[j].start + 1 == length &&
+                vm_same_code(
+                    function->instructions + hoists[i].start,
+                    function->instructions + hoists[j].start,
+                    length
+                )) {
+                hoists[i].local = hoists[j].local;
+            }
+        }
+
+        if (hoists[i].local == CFG_NONE) {
+            hoists[i].local = function->locals_count++;
+            hoists[i].is_first = true;
+            stats.hoisted_expressions++;
+        }
+        stats.hoisted_instructions += length;
+    }
+}
+
+static void rewrite(VM_Function *function, LICM_Hoist *hoists, int count, int insertion)
+{
+    VM_Instruction *code = function->instructions;
+    int capacity = function->count + count;
+
+    for (int i = 0; i < count; i++) {
+        capacity += hoists[i].end - hoists[i].start + 1;
+    }
+
+    VM_Instruction *rewritten = malloc(sizeof(VM_Instruction) * capacity);
+    int length = 0;
+    int next = 0;
+
+    for (int i = 0; i < function->count; i++) {
+        if (i == insertion) {
+            for (int j = 0; j < count; j++) {
+                if (!hoists[j].is_first) {
+                    continue;
+                }
+
+                for (int k = hoists[j].start; k <= hoists[j].end; k++) {
+                    rewritten[length++] = code[k];
+                }
+                rewritten[length++] = 
+                    (VM_Instruction){
+                        VM_POP, VM_SEGMENT_LOCAL, hoists[j].local, -1, code[hoists[j].end].line
+                    };
+            }
+        }
+
+        if (next < count && i == hoists[next].start) {
+            rewritten[length++] = 
+                (VM_Instruction){
+                    VM_PUSH, VM_SEGMENT_LOCAL, hoists[next].local, -1, code[hoists[next].start].line
+                };
+            i = hoists[next].end;
+            next++;
+            continue;
+        }
+
+        rewritten[length++] = code[i];
+    }
+
+    free(function->instructions);
+    function->instructions = rewritten;
+    function->count = length;
+    function->capacity = capacity;
+}
+
+static int compare_hoists(const void *a, const void *b)
+{
+    return ((const LICM_Hoist *)a)->start - ((const LICM_Hoist *)b)->start;
+}
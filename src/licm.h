@@ -0,0 +1,18 @@
+#ifndef LICM_LICM
+#define LICM_LICM
+
+#include "vm-ir.h"
+
+typedef struct {
+    long hoisted_expressions;
+    long hoisted_instructions;
+} LICM_Stats;
+
+// Loop-invariant code motion: expressions inside a loop that only
+// read slots the loop never writes are computed once before the loop
+// into a new local, which the loop pushes instead.
+void licm_hoist(VM_Class *class);
+
+LICM_Stats licm_stats();
+
+#endif
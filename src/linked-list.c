@@ -1,5 +1,27 @@
 #include <stdlib.h>
 #include "linked-list.h"
+#include "pool.h"
+
+#define LL_POOL_ALIGN       16
+#define LL_POOL_CLASSES     8
+
+// Node pools, one per payload size class (multiples of
+// LL_POOL_ALIGN bytes). Bigger payloads always go through malloc.
+static bool is_pool_enabled = false;
+static PL_Pool *node_pools[LL_POOL_CLASSES];
+static const char *node_pools_names[LL_POOL_CLASSES] = {
+    "LL_Node+16",
+    "LL_Node+32",
+    "LL_Node+48",
+    "LL_Node+64",
+    "LL_Node+80",
+    "LL_Node+96",
+    "LL_Node+112",
+    "LL_Node+128"
+};
+
+static LL_Node *ll_pool_node(size_t data_size);
+static size_t ll_node_size(size_t data_size);
 
 LL_List ll_make_empty_list()
 {
@@ -22,10 +44,19 @@ LL_List ll_make_list(size_t head_data_size)
 
 LL_Node *ll_make_node(size_t data_size)
 {
-    LL_Node *node;
+    LL_Node *node = NULL;
 
-    node = malloc(sizeof(LL_Node));
-    node->data = malloc(data_size);
+    if (is_pool_enabled) {
+        node = ll_pool_node(data_size);
+    }
+
+    if (node == NULL) {
+        node = malloc(ll_node_size(data_size));
+        node->size = data_size;
+        node->is_pooled = false;
+    }
+
+    node->data = node->payload;
     node->next = NULL;
 
     return node;
@@ -51,6 +82,17 @@ void ll_append(LL_Node *node, LL_List *list)
     list->count++;
 }
 
+void ll_free_node(LL_Node *node)
+{
+    if (!node->is_pooled) {
+        free(node);
+        return;
+    }
+
+    int size_class = (node->size - 1) / LL_POOL_ALIGN;
+    pl_free(node_pools[size_class], node);
+}
+
 void ll_free(LL_List *list)
 {
     LL_Node *node = NULL;
@@ -60,8 +102,7 @@ void ll_free(LL_List *list)
 
     while (node != NULL) {
         next = node->next;
-        free(node->data);
-        free(node);
+        ll_free_node(node);
         node = next;
     }
 
@@ -69,3 +110,47 @@ void ll_free(LL_List *list)
     list->tail = NULL;
 }
 
+void ll_enable_pool()
+{
+    for (int i = 0; i < LL_POOL_CLASSES; i++) {
+        if (node_pools[i] == NULL) {
+            node_pools[i] = pl_make_pool(
+                node_pools_names[i],
+                ll_node_size((i + 1) * LL_POOL_ALIGN)
+            );
+        }
+    }
+    is_pool_enabled = true;
+}
+
+void ll_release_pool()
+{
+    for (int i = 0; i < LL_POOL_CLASSES; i++) {
+        if (node_pools[i] != NULL) {
+            pl_release(node_pools[i]);
+        }
+    }
+    is_pool_enabled = false;
+}
+
+static LL_Node *ll_pool_node(size_t data_size)
+{
+    if (data_size == 0 || data_size > LL_POOL_CLASSES * LL_POOL_ALIGN) {
+        return NULL;
+    }
+
+    int size_class = (data_size - 1) / LL_POOL_ALIGN;
+
+    LL_Node *node = pl_alloc(node_pools[size_class]);
+    node->size = (size_class + 1) * LL_POOL_ALIGN;
+    node->is_pooled = true;
+
+    return node;
+}
+
+static size_t ll_node_size(size_t data_size)
+{
+    size_t size = sizeof(LL_Node) + data_size;
+    size_t align = _Alignof(LL_Node);
+    return (size + align - 1) / align * align;
+}
@@ -1,6 +1,9 @@
 #ifndef LL_LIST
 #define LL_LIST
 
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef struct LL_List LL_List;
 typedef struct LL_Node LL_Node;
 
@@ -10,9 +13,14 @@ struct LL_List {
     int count;
 };
 
+// Nodes carry their payload inline, right after the header, so a
+// node is a single allocation. `data` always points at `payload`.
 struct LL_Node {
     void *data;
     LL_Node *next;
+    unsigned int size;
+    bool is_pooled;
+    _Alignas(max_align_t) unsigned char payload[];
 };
 
 LL_List ll_make_empty_list();
@@ -21,6 +29,10 @@ LL_Node *ll_make_node(size_t data_size);
 LL_Node *ll_tail(LL_Node *node);
 
 void ll_append(LL_Node *node, LL_List *list);
+void ll_free_node(LL_Node *node);
 void ll_free(LL_List *list);
 
+void ll_enable_pool();
+void ll_release_pool();
+
 #endif
@@ -0,0 +1,227 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "liveness.h"
+
+#define LV_WORD_BITS 64
+
+static LV_Stats stats;
+
+static void compact_function(VM_Function *function, int *label_positions);
+static void compute_liveness(VM_Function *function, int *label_positions, uint64_t *live_in, int words);
+static void add_successor(uint64_t *live_out, const uint64_t *live_in, int successor, int words);
+static void add_interferences(bool *interferes, int locals, const uint64_t *live, int local);
+static int assign_slots(bool *interferes, const bool *is_used, int locals, int *slots);
+static bool is_local(VM_Instruction instruction, VM_Opcode opcode);
+static bool has_bit(const uint64_t *set, int bit);
+static void set_bit(uint64_t *set, int bit);
+static void clear_bit(uint64_t *set, int bit);
+
+void lv_compact_locals(VM_Class *class)
+{
+    int *label_positions = malloc(sizeof(int) * (class->labels_count + 1));
+
+    for (int i = 0; i < class->functions_count; i++) {
+        compact_function(&class->functions[i], label_positions);
+    }
+
+    free(label_positions);
+}
+
+LV_Stats lv_stats()
+{
+    return stats;
+}
+
+static void compact_function(VM_Function *function, int *label_positions)
+{
+    int locals = function->locals_count;
+    stats.declared_locals += locals;
+
+    if (locals == 0 || function->count == 0) {
+        stats.allocated_slots += locals;
+        return;
+    }
+
+    int words = (locals + LV_WORD_BITS - 1) / LV_WORD_BITS;
+    uint64_t *live_in = calloc((size_t)function->count * words, sizeof(uint64_t));
+    uint64_t *live_out = malloc(sizeof(uint64_t) * words);
+    bool *interferes = calloc((size_t)locals * locals, sizeof(bool));
+    bool *is_used = calloc(locals, sizeof(bool));
+    int *slots = malloc(sizeof(int) * locals);
+
+    compute_liveness(function, label_positions, live_in, words);
+
+    // Every local starts out as 0, so the ones read before being
+    // written are all defined together on entry.
+    for (int local = 0; local < locals; local++) {
+        if (has_bit(live_in, local)) {
+            add_interferences(interferes, locals, live_in, local);
+        }
+    }
+
+    for (int i = 0; i < function->count; i++) {
+        VM_Instruction instruction = function->instructions[i];
+
+        if (is_local(instruction, VM_PUSH)) {
+            is_used[instruction.operand] = true;
+
+        } else if (is_local(instruction, VM_POP)) {
+            is_used[instruction.operand] = true;
+
+            // A store clobbers its slot, so the local can't share it
+            // with anything still live after the store, even when the
+            // stored value itself is never read.
+            memset(live_out, 0, sizeof(uint64_t) * words);
+            if (i + 1 < function->count) {
+                add_successor(live_out, live_in, i + 1, words);
+            }
+            add_interferences(interferes, locals, live_out, instruction.operand);
+        }
+    }
+
+    function->locals_count = assign_slots(interferes, is_used, locals, slots);
+    stats.allocated_slots += function->locals_count;
+
+    for (int i = 0; i < function->count; i++) {
+        VM_Instruction *instruction = &function->instructions[i];
+
+        if (is_local(*instruction, VM_PUSH) || is_local(*instruction, VM_POP)) {
+            instruction->operand = slots[instruction->operand];
+        }
+    }
+
+    free(live_in);
+    free(live_out);
+    free(interferes);
+    free(is_used);
+    free(slots);
+}
+
+// Backward dataflow over single instructions, repeated until no live
+// set grows. live_in holds `words` words per instruction.
+static void compute_liveness(VM_Function *function, int *label_positions, uint64_t *live_in, int words)
+{
+    VM_Instruction *code = function->instructions;
+    uint64_t *live_out = malloc(sizeof(uint64_t) * words);
+    bool changed = true;
+
+    for (int i = 0; i < function->count; i++) {
+        if (code[i].opcode == VM_LABEL) {
+            label_positions[code[i].operand] = i;
+        }
+    }
+
+    while (changed) {
+        changed = false;
+
+        for (int i = function->count - 1; i >= 0; i--) {
+            VM_Opcode opcode = code[i].opcode;
+            uint64_t *live = live_in + (size_t)i * words;
+
+            memset(live_out, 0, sizeof(uint64_t) * words);
+
+            if (opcode == VM_GOTO || opcode == VM_IF_GOTO) {
+                add_successor(live_out, live_in, label_positions[code[i].operand], words);
+            }
+            if (opcode != VM_GOTO && opcode != VM_RETURN && i + 1 < function->count) {
+                add_successor(live_out, live_in, i + 1, words);
+            }
+
+            if (is_local(code[i], VM_POP)) {
+                clear_bit(live_out, code[i].operand);
+            } else if (is_local(code[i], VM_PUSH)) {
+                set_bit(live_out, code[i].operand);
+            }
+
+            for (int word = 0; word < words; word++) {
+                if ((live[word] | live_out[word]) != live[word]) {
+                    live[word] |= live_out[word];
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    free(live_out);
+}
+
+static void add_successor(uint64_t *live_out, const uint64_t *live_in, int successor, int words)
+{
+    const uint64_t *live = live_in + (size_t)successor * words;
+
+    for (int word = 0; word < words; word++) {
+        live_out[word] |= live[word];
+    }
+}
+
+static void add_interferences(bool *interferes, int locals, const uint64_t *live, int local)
+{
+    for (int other = 0; other < locals; other++) {
+        if (other != local && has_bit(live, other)) {
+            interferes[local * locals + other] = true;
+            interferes[other * locals + local] = true;
+        }
+    }
+}
+
+// Greedy coloring in declaration order: each used local takes the
+// lowest slot not held by a local it interferes with. Returns how
+// many slots were needed.
+static int assign_slots(bool *interferes, const bool *is_used, int locals, int *slots)
+{
+    bool *is_taken = malloc(sizeof(bool) * locals);
+    int slots_count = 0;
+
+    for (int local = 0; local < locals; local++) {
+        slots[local] = -1;
+
+        if (!is_used[local]) {
+            continue;
+        }
+
+        memset(is_taken, 0, sizeof(bool) * locals);
+
+        for (int other = 0; other < local; other++) {
+            if (slots[other] >= 0 && interferes[local * locals + other]) {
+                is_taken[slots[other]] = true;
+            }
+        }
+
+        int slot = 0;
+        while (is_taken[slot]) {
+            slot++;
+        }
+
+        slots[local] = slot;
+        if (slot + 1 > slots_count) {
+            slots_count = slot + 1;
+        }
+    }
+
+    free(is_taken);
+
+    return slots_count;
+}
+
+static bool is_local(VM_Instruction instruction, VM_Opcode opcode)
+{
+    return instruction.opcode == opcode &&
+        instruction.segment == VM_SEGMENT_LOCAL;
+}
+
+static bool has_bit(const uint64_t *set, int bit)
+{
+    return (set[bit / LV_WORD_BITS] >> (bit % LV_WORD_BITS)) & 1;
+}
+
+static void set_bit(uint64_t *set, int bit)
+{
+    set[bit / LV_WORD_BITS] |= (uint64_t)1 << (bit % LV_WORD_BITS);
+}
+
+static void clear_bit(uint64_t *set, int bit)
+{
+    set[bit / LV_WORD_BITS] &= ~((uint64_t)1 << (bit % LV_WORD_BITS));
+}
@@ -0,0 +1,18 @@
+#ifndef LV_LIVENESS
+#define LV_LIVENESS
+
+#include "vm-ir.h"
+
+typedef struct {
+    long declared_locals;
+    long allocated_slots;
+} LV_Stats;
+
+// Local slot compaction: the liveness of every local is computed over
+// the function's control flow, then locals that are never used are
+// dropped and locals whose lifetimes don't overlap share a slot.
+void lv_compact_locals(VM_Class *class);
+
+LV_Stats lv_stats();
+
+#endif
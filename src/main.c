@@ -1,9 +1,22 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "file-handler.h"
 #include "parser.h"
 #include "code-gen.h"
+#include "hack-asm.h"
+#include "hack-cpu.h"
+#include "id-table.h"
+#include "licm.h"
+#include "linked-list.h"
+#include "liveness.h"
+#include "optimizer.h"
+#include "peephole.h"
+#include "pool.h"
+#include "stack-depth.h"
+#include "tree-shaker.h"
+#include "vm-interpreter.h"
 
 #define SUCCESS_CODE    0
 #define ERROR_CODE      -1
@@ -11,18 +24,58 @@
 
 static FILE *jack_file_handle       = NULL;
 static FILE *code_file_handle       = NULL;
+static FILE *line_map_handle        = NULL;
+static bool print_stats             = false;
+static bool optimize                = false;
+static bool pool_strings            = false;
+static bool tree_shake              = false;
+static bool emit_asm                = false;
+static bool run                     = false;
+static bool simulate                = false;
+static bool line_map                = false;
+static bool stack_depth             = false;
+static bool stack_comments          = false;
 
+static int parse_options(int argc, char **argv);
 static int open_jack_file(const char *path);
 static int create_output_file(char *path);
+static int create_line_map_file(const char *output_path);
+static int load_vm_files(File_handler_jack_proj proj);
+static bool has_jack_file(File_handler_jack_proj proj, const char *vm_path);
+static int run_program(const char *path);
+static int simulate_program(const char *path);
+static void print_id_table_stats();
+static void print_histogram(const char *title, const long *histogram);
+static void print_pools_stats();
+static void print_optimizer_stats();
+static void print_peephole_stats();
+static void print_licm_stats();
+static void print_liveness_stats();
+static void print_tree_shaker_stats();
+static void print_hack_asm_stats();
+static void print_run_stats();
+static void print_simulation_stats();
+static void print_stack_depth_stats();
 
 int main(int argc, char **argv)
 {
     if (argc < ARGS_NUM) {
         printf("Invalid project folder argument\n");
-        printf("Usage: JackAnalyzer jack_proj_path vm_output_file_path\n");
+        printf("Usage: JackAnalyzer jack_proj_path vm_output_file_path [--stats] [-O] [--pool-strings] [--tree-shake] [--asm] [--run] [--simulate] [--line-map] [--stack-depth] [--stack-comments]\n");
         return ERROR_CODE;
     }
 
+    if (parse_options(argc, argv) == ERROR_CODE) {
+        return ERROR_CODE;
+    }
+
+    if (print_stats) {
+        idt_enable_stats();
+        pl_enable_debug();
+    }
+
+    ll_enable_pool();
+
     File_handler_jack_proj proj = fh_open_proj(argv[1]);
 
     if (proj.failed) {
@@ -34,6 +87,31 @@ int main(int argc, char **argv)
         return ERROR_CODE;
     }
 
+    if (line_map && create_line_map_file(argv[2]) == ERROR_CODE) {
+        return ERROR_CODE;
+    }
+
+    cg_set_options((CG_Options){ 
+        .optimize = optimize, 
+        .pool_strings = pool_strings,
+        .tree_shake = tree_shake,
+        .emit_asm = emit_asm,
+        .line_map = line_map_handle,
+        .analyze_stack = stack_depth,
+        .stack_comments = stack_comments
+    });
+
+    idt_store_os_signatures();
+
+    for (int i = 0; i < proj.jack_files_count; i++) {
+        if (open_jack_file(proj.jack_files_paths[i]) == ERROR_CODE) {
+            return ERROR_CODE;
+        }
+
+        parser_index_signatures(jack_file_handle);
+        fh_close_file(jack_file_handle);
+    }
+
     for (int i = 0; i < proj.jack_files_count; i++) {
         char *file_path = proj.jack_files_paths[i];
 
@@ -48,12 +126,112 @@ int main(int argc, char **argv)
         fh_close_file(jack_file_handle);
     }
 
-    fh_close_file(code_file_handle);
+    if (emit_asm && load_vm_files(proj) == ERROR_CODE) {
+        return ERROR_CODE;
+    }
+
+    cg_finish(code_file_handle);
+
+    if (!fh_close_file(code_file_handle)) {
+        printf("File %s couldn't be written.\n", argv[2]);
+        return ERROR_CODE;
+    }
+
+    if (line_map && !fh_close_file(line_map_handle)) {
+        printf("File %s.map couldn't be written.\n", argv[2]);
+        return ERROR_CODE;
+    }
     fh_close_proj(&proj);
+
+    if (print_stats) {
+        print_id_table_stats();
+        print_pools_stats();
+
+        if (optimize) {
+            print_optimizer_stats();
+            print_peephole_stats();
+            print_licm_stats();
+            print_liveness_stats();
+        }
+
+        if (tree_shake) {
+            print_tree_shaker_stats();
+        }
+
+        if (emit_asm) {
+            print_hack_asm_stats();
+        }
+    }
+
+    if (stack_depth) {
+        print_stack_depth_stats();
+    }
+
+    if (run && run_program(argv[2]) == ERROR_CODE) {
+        return ERROR_CODE;
+    }
+
+    if (simulate && simulate_program(argv[2]) == ERROR_CODE) {
+        return ERROR_CODE;
+    }
+
+    ll_release_pool();
     
     return SUCCESS_CODE;
 }
 
+static int parse_options(int argc, char **argv)
+{
+    for (int i = ARGS_NUM; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            print_stats = true;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            optimize = true;
+        } else if (strcmp(argv[i], "--pool-strings") == 0) {
+            pool_strings = true;
+        } else if (strcmp(argv[i], "--tree-shake") == 0) {
+            tree_shake = true;
+        } else if (strcmp(argv[i], "--asm") == 0) {
+            emit_asm = true;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run = true;
+        } else if (strcmp(argv[i], "--simulate") == 0) {
+            simulate = true;
+        } else if (strcmp(argv[i], "--line-map") == 0) {
+            line_map = true;
+        } else if (strcmp(argv[i], "--stack-depth") == 0) {
+            stack_depth = true;
+        } else if (strcmp(argv[i], "--stack-comments") == 0) {
+            stack_comments = true;
+        } else {
+            printf("Unknown option %s\n", argv[i]);
+            return ERROR_CODE;
+        }
+    }
+
+    if (run && emit_asm) {
+        printf("--run interprets VM code and can't be used with --asm\n");
+        return ERROR_CODE;
+    }
+
+    if (simulate && !emit_asm) {
+        printf("--simulate runs Hack assembly and needs --asm\n");
+        return ERROR_CODE;
+    }
+
+    if (line_map && emit_asm) {
+        printf("--line-map maps VM code and can't be used with --asm\n");
+        return ERROR_CODE;
+    }
+
+    if (stack_comments && emit_asm) {
+        printf("--stack-comments annotates VM code and can't be used with --asm\n");
+        return ERROR_CODE;
+    }
+
+    return SUCCESS_CODE;
+}
+
 static int open_jack_file(const char *path)
 {
     jack_file_handle = fh_open_file(path, false);
@@ -84,3 +262,327 @@ static int create_output_file(char *path)
     return SUCCESS_CODE;
 }
 
+// The map sits next to the output, as <output>.map.
+static int create_line_map_file(const char *output_path)
+{
+    char *path = malloc(strlen(output_path) + strlen(".map") + 1);
+    sprintf(path, "%s.map", output_path);
+
+    line_map_handle = fh_open_file(path, true);
+
+    if (line_map_handle == NULL) {
+        printf("File %s couldn't be created.\n", path);
+        free(path);
+        return ERROR_CODE;
+    }
+
+    free(path);
+    return SUCCESS_CODE;
+}
+
+// Links the project's .vm files, such as the compiled OS, into the
+// assembled program. Files left over from compiling the project's
+// own Jack classes are skipped.
+static int load_vm_files(File_handler_jack_proj proj)
+{
+    for (int i = 0; i < proj.vm_files_count; i++) {
+        char *file_path = proj.vm_files_paths[i];
+
+        if (has_jack_file(proj, file_path)) {
+            continue;
+        }
+
+        FILE *vm_file_handle = fh_open_file(file_path, false);
+
+        if (vm_file_handle == NULL) {
+            printf("File %s couldn't be opened.\n", file_path);
+            return ERROR_CODE;
+        }
+
+        // The class is named after the file: "./dir/Math.vm" is Math.
+        const char *file_name = strrchr(file_path, '/');
+        file_name = file_name == NULL ? file_path : file_name + 1;
+
+        char *name = strdup(file_name);
+        name[strlen(name) - strlen(".vm")] = '\0';
+
+        VM_Class *class_ir = vm_read_class(vm_file_handle, name);
+        fh_close_file(vm_file_handle);
+        free(name);
+
+        if (class_ir == NULL) {
+            printf("File %s couldn't be read.\n", file_path);
+            return ERROR_CODE;
+        }
+
+        cg_add_class(class_ir);
+    }
+
+    return SUCCESS_CODE;
+}
+
+// Loads the emitted VM code back as a single class, since the output
+// file shares one static segment among all of its classes, and
+// interprets it, profiling each function.
+static int run_program(const char *path)
+{
+    FILE *vm_file_handle = fh_open_file(path, false);
+
+    if (vm_file_handle == NULL) {
+        printf("File %s couldn't be opened.\n", path);
+        return ERROR_CODE;
+    }
+
+    VM_Class *program = vm_read_class(vm_file_handle, "Program");
+    fh_close_file(vm_file_handle);
+
+    if (program == NULL) {
+        printf("File %s couldn't be read.\n", path);
+        return ERROR_CODE;
+    }
+
+    bool has_finished = vi_run(program, stdout, VI_MAX_STEPS);
+    print_run_stats();
+    vm_free_class(program);
+
+    return has_finished ? SUCCESS_CODE : ERROR_CODE;
+}
+
+// Runs the written assembly on the Hack CPU simulator, profiling the
+// cycles spent in each function.
+static int simulate_program(const char *path)
+{
+    FILE *asm_file_handle = fh_open_file(path, false);
+
+    if (asm_file_handle == NULL) {
+        printf("File %s couldn't be opened.\n", path);
+        return ERROR_CODE;
+    }
+
+    bool has_halted = hc_run(asm_file_handle, HC_MAX_CYCLES);
+    fh_close_file(asm_file_handle);
+    print_simulation_stats();
+
+    return has_halted ? SUCCESS_CODE : ERROR_CODE;
+}
+
+static bool has_jack_file(File_handler_jack_proj proj, const char *vm_path)
+{
+    size_t stem_length = strlen(vm_path) - strlen(".vm");
+
+    for (int i = 0; i < proj.jack_files_count; i++) {
+        const char *jack_path = proj.jack_files_paths[i];
+
+        if (strlen(jack_path) == stem_length + strlen(".jack") &&
+            strncmp(jack_path, vm_path, stem_length) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void print_id_table_stats()
+{
+    HT_Stats stats = idt_stats();
+
+    printf("Identifier table\n");
+    printf("  entries:       %d\n", stats.entries);
+    printf("  buckets used:  %d/%d\n", stats.buckets_used, stats.buckets);
+    printf("  load factor:   %.2f\n", stats.load_factor);
+    printf("  max chain:     %d\n", stats.max_chain);
+    printf("  mean chain:    %.2f\n", stats.mean_chain);
+    print_histogram("chain lengths", stats.chains_histogram);
+
+    if (!stats.has_counters) {
+        return;
+    }
+
+    HT_Counters counters = stats.counters;
+    printf(
+        "  lookups:       %ld (%ld hits, %ld misses)\n", 
+        counters.lookups, 
+        counters.hits, 
+        counters.misses
+    );
+    printf(
+        "  mean probes:   %.2f\n", 
+        counters.lookups > 0 ? (double)counters.probes / counters.lookups : 0
+    );
+    printf("  max probes:    %ld\n", counters.max_probes);
+    print_histogram("probes", counters.probes_histogram);
+}
+
+static void print_histogram(const char *title, const long *histogram)
+{
+    printf("  %s:\n", title);
+
+    for (int i = 0; i < HT_HISTOGRAM_SIZE; i++) {
+        printf(
+            "    %d%s %ld\n", 
+            i, 
+            i == HT_HISTOGRAM_SIZE - 1 ? "+:" : ": ", 
+            histogram[i]
+        );
+    }
+}
+
+static void print_pools_stats()
+{
+    PL_Stats stats[PL_MAX_POOLS];
+    int count = pl_pools_stats(stats, PL_MAX_POOLS);
+
+    printf("Object pools\n");
+    printf(
+        "  %-22s %6s %8s %8s %10s\n", 
+        "type", 
+        "size", 
+        "chunks", 
+        "in use", 
+        "high water"
+    );
+
+    for (int i = 0; i < count; i++) {
+        printf(
+            "  %-22s %6zu %8ld %8ld %10ld\n",
+            stats[i].name,
+            stats[i].object_size,
+            stats[i].chunks,
+            stats[i].in_use,
+            stats[i].high_water
+        );
+    }
+}
+
+static void print_optimizer_stats()
+{
+    OPT_Stats stats = opt_stats();
+
+    printf("AST optimizer\n");
+    printf("  folded constants:      %ld\n", stats.folded_constants);
+    printf("  simplified identities: %ld\n", stats.simplified_identities);
+    printf("Dead code\n");
+    printf("  unreachable statements: %ld\n", stats.unreachable_statements);
+    printf("  collapsed ifs:          %ld\n", stats.collapsed_ifs);
+    printf("  removed loops:          %ld\n", stats.removed_loops);
+}
+
+static void print_peephole_stats()
+{
+    PH_Stats stats[PH_MAX_RULES];
+    int count = ph_rules_stats(stats, PH_MAX_RULES);
+
+    printf("Peephole rules\n");
+
+    for (int i = 0; i < count; i++) {
+        printf("  %-22s %8ld\n", stats[i].name, stats[i].hits);
+    }
+}
+
+static void print_licm_stats()
+{
+    LICM_Stats stats = licm_stats();
+
+    printf("Loop-invariant code motion\n");
+    printf("  hoisted expressions:  %ld\n", stats.hoisted_expressions);
+    printf("  hoisted instructions: %ld\n", stats.hoisted_instructions);
+}
+
+static void print_liveness_stats()
+{
+    LV_Stats stats = lv_stats();
+
+    printf("Local slots\n");
+    printf("  declared locals: %ld\n", stats.declared_locals);
+    printf("  allocated slots: %ld\n", stats.allocated_slots);
+}
+
+static void print_tree_shaker_stats()
+{
+    TS_Stats stats = ts_stats();
+
+    printf("Tree shaker\n");
+    printf("  functions:            %d\n", stats.functions);
+    printf("  removed functions:    %d\n", stats.removed_functions);
+    printf("  removed instructions: %ld\n", stats.removed_instructions);
+}
+
+static void print_hack_asm_stats()
+{
+    HA_Stats stats = ha_stats();
+
+    printf("Hack assembly\n");
+    printf("  functions:    %ld\n", stats.functions);
+    printf("  instructions: %ld\n", stats.instructions);
+}
+
+static void print_run_stats()
+{
+    VI_Stats stats = vi_stats();
+
+    printf("\nExecution profile\n");
+    printf("  instructions: %ld\n", stats.instructions);
+    printf("  OS calls:     %ld\n", stats.os_calls);
+    printf("  %-32s %10s %14s\n", "function", "calls", "instructions");
+
+    for (int i = 0; i < stats.functions_count; i++) {
+        VI_Function_stats function = stats.functions[i];
+
+        if (function.is_os) {
+            printf("  %-32s %10ld %14s\n", function.name, function.calls, "OS");
+        } else {
+            printf("  %-32s %10ld %14ld\n", function.name, function.calls, function.instructions);
+        }
+    }
+}
+
+static void print_simulation_stats()
+{
+    HC_Stats stats = hc_stats();
+
+    printf("Hack CPU profile\n");
+    printf("  cycles:   %ld\n", stats.cycles);
+    printf("  ROM size: %d\n", stats.rom_size);
+    printf("  %-32s %10s %14s\n", "function", "calls", "cycles");
+
+    for (int i = 0; i < stats.functions_count; i++) {
+        HC_Function_stats function = stats.functions[i];
+
+        printf("  %-32s %10ld %14ld\n", function.name, function.calls, function.cycles);
+    }
+}
+
+// Chains marked + reach recursion or code that wasn't compiled, like
+// the OS when it isn't linked in, and are only lower bounds.
+static void print_stack_depth_stats()
+{
+    SD_Stats stats = sd_stats();
+
+    printf("Stack depth\n");
+    printf("  frame size: %d\n", SD_FRAME_SIZE);
+
+    if (stats.entry != NULL) {
+        printf(
+            "  from %s:   %d%s\n",
+            stats.entry->name,
+            stats.entry->chain_depth,
+            stats.entry->is_recursive || stats.entry->calls_unknown ? "+" : ""
+        );
+    }
+
+    printf("  %-32s %8s %8s %8s\n", "function", "locals", "operands", "chain");
+
+    for (int i = 0; i < stats.functions_count; i++) {
+        SD_Function_stats function = stats.functions[i];
+
+        printf(
+            "  %-32s %8d %8d %8d%s%s\n",
+            function.name,
+            function.locals_count,
+            function.max_depth,
+            function.chain_depth,
+            function.is_recursive || function.calls_unknown ? "+" : "",
+            function.is_recursive ? " recursive" : ""
+        );
+    }
+}
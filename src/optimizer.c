@@ -0,0 +1,628 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "optimizer.h"
+
+#define OPT_MIN_VALUE -32768
+
+static OPT_Stats stats;
+
+static void fold_statements(LL_List *statements);
+static void fold_call(Parser_term_subroutine_call *call);
+static void fold_expression(Parser_expression *expr);
+static void fold_term(Parser_term *term);
+static void fold_sub_term(Parser_term *term);
+
+static void prune_statements(LL_List *statements);
+static LL_Node *collapse_if(LL_List *statements, LL_Node *previous, LL_Node *node);
+static void remove_next_statements(LL_List *statements, LL_Node *node);
+static void remove_statement(LL_List *statements, LL_Node *previous, LL_Node *node);
+static bool always_returns(Parser_statement *statement);
+static bool expression_constant(Parser_expression *expr, short *value);
+
+static bool fold_binary(Parser_term_operator op, short a, short b, short *result);
+static bool combine_operands(
+    Parser_term_operator first_op,
+    short a,
+    Parser_term_operator second_op,
+    short b,
+    Parser_term_operator *op,
+    short *value
+);
+static bool is_right_identity(Parser_term_operator op, short value);
+static bool is_left_identity(Parser_term_operator op, short value);
+
+static bool constant_value(Parser_term *term, short *value);
+static bool make_constant(short value, Parser_term *term);
+static Parser_term make_integer(int value);
+static Parser_term make_sub_term(Parser_term_operator op, Parser_term inner);
+static Parser_term make_empty_term();
+
+void opt_fold_constants(Parser_jack_syntax *ast)
+{
+    LL_Node *node = ast->class_dec.subroutines.head;
+
+    while (node != NULL) {
+        Parser_subroutine_dec *subroutine = (Parser_subroutine_dec *)node->data;
+        fold_statements(&subroutine->statements);
+        node = node->next;
+    }
+}
+
+void opt_eliminate_dead_code(Parser_jack_syntax *ast)
+{
+    LL_Node *node = ast->class_dec.subroutines.head;
+
+    while (node != NULL) {
+        Parser_subroutine_dec *subroutine = (Parser_subroutine_dec *)node->data;
+        prune_statements(&subroutine->statements);
+        node = node->next;
+    }
+}
+
+OPT_Stats opt_stats()
+{
+    return stats;
+}
+
+static void fold_statements(LL_List *statements)
+{
+    LL_Node *node = statements->head;
+
+    while (node != NULL) {
+        Parser_statement *statement = (Parser_statement *)node->data;
+
+        if (statement->do_statement != NULL) {
+            fold_call(&statement->do_statement->subroutine_call);
+
+        } else if (statement->let_statement != NULL) {
+            Parser_let_statement *let_statement = statement->let_statement;
+
+            if (let_statement->has_subscript) {
+                fold_expression(&let_statement->subscript);
+            }
+            fold_expression(&let_statement->value);
+
+        } else if (statement->if_statement != NULL) {
+            Parser_if_statement *if_statement = statement->if_statement;
+
+            fold_expression(&if_statement->conditional);
+            fold_statements(&if_statement->conditional_statements);
+            fold_statements(&if_statement->else_statements);
+
+        } else if (statement->while_statement != NULL) {
+            Parser_while_statement *while_statement = statement->while_statement;
+
+            fold_expression(&while_statement->conditional);
+            fold_statements(&while_statement->statements);
+
+        } else if (statement->return_statement != NULL) {
+            Parser_return_statement *return_statement = statement->return_statement;
+
+            if (return_statement->has_expr) {
+                fold_expression(&return_statement->expression);
+            }
+        }
+
+        node = node->next;
+    }
+}
+
+static void fold_call(Parser_term_subroutine_call *call)
+{
+    LL_Node *node = call->param_expressions.head;
+
+    while (node != NULL) {
+        fold_expression((Parser_expression *)node->data);
+        node = node->next;
+    }
+}
+
+// Jack has no operator precedence: `t0 op1 t1 op2 t2` is evaluated
+// as `(t0 op1 t1) op2 t2`. Terms are kept in order, folding the
+// leading constant run, dropping neutral operands and merging trailing
+// constants of chained +/- or * operations.
+static void fold_expression(Parser_expression *expr)
+{
+    int count = expr->terms.count;
+
+    if (count == 0) {
+        return;
+    }
+
+    Parser_term *terms = malloc(sizeof(Parser_term) * count);
+    Parser_term_operator *ops = malloc(sizeof(Parser_term_operator) * count);
+    int kept = 0;
+
+    LL_Node *term_node = expr->terms.head;
+    LL_Node *op_node = NULL;
+
+    while (term_node != NULL) {
+        Parser_term term = *(Parser_term *)term_node->data;
+        fold_term(&term);
+        term_node = term_node->next;
+
+        if (op_node == NULL) {
+            terms[kept++] = term;
+            op_node = expr->operators.head;
+            continue;
+        }
+
+        Parser_term_operator op = *(Parser_term_operator *)op_node->data;
+        op_node = op_node->next;
+
+        short a, b, result;
+        bool is_constant = constant_value(&term, &b);
+        bool is_constant_prefix = kept == 1 && constant_value(&terms[0], &a);
+        Parser_term folded;
+
+        if (is_constant && is_constant_prefix &&
+            fold_binary(op, a, b, &result) && make_constant(result, &folded)) {
+            parser_free_term(&terms[0]);
+            parser_free_term(&term);
+            terms[0] = folded;
+            stats.folded_constants++;
+            continue;
+        }
+
+        if (is_constant && is_right_identity(op, b)) {
+            parser_free_term(&term);
+            stats.simplified_identities++;
+            continue;
+        }
+
+        if (is_constant_prefix && is_left_identity(op, a)) {
+            parser_free_term(&terms[0]);
+            terms[0] = op == PARSER_TERM_OP_SUBTRACTION ?
+                make_sub_term(PARSER_TERM_OP_SUBTRACTION, term) :
+                term;
+            stats.simplified_identities++;
+            continue;
+        }
+
+        Parser_term_operator merged_op;
+        short merged_value;
+
+        if (is_constant && kept > 1 &&
+            constant_value(&terms[kept - 1], &a) &&
+            combine_operands(ops[kept - 2], a, op, b, &merged_op, &merged_value)) {
+            parser_free_term(&terms[kept - 1]);
+            parser_free_term(&term);
+            stats.folded_constants++;
+
+            if (is_right_identity(merged_op, merged_value)) {
+                kept--;
+            } else {
+                make_constant(merged_value, &terms[kept - 1]);
+                ops[kept - 2] = merged_op;
+            }
+            continue;
+        }
+
+        ops[kept - 1] = op;
+        terms[kept++] = term;
+    }
+
+    ll_free(&expr->terms);
+    ll_free(&expr->operators);
+    expr->terms = ll_make_empty_list();
+    expr->operators = ll_make_empty_list();
+
+    for (int i = 0; i < kept; i++) {
+        LL_Node *node = ll_make_node(sizeof(Parser_term));
+        *(Parser_term *)node->data = terms[i];
+        ll_append(node, &expr->terms);
+
+        if (i > 0) {
+            node = ll_make_node(sizeof(Parser_term_operator));
+            *(Parser_term_operator *)node->data = ops[i - 1];
+            ll_append(node, &expr->operators);
+        }
+    }
+
+    free(terms);
+    free(ops);
+}
+
+static void fold_term(Parser_term *term)
+{
+    if (term->var_usage != NULL && term->var_usage->subscript != NULL) {
+        fold_expression(term->var_usage->subscript);
+
+    } else if (term->subroutine_call != NULL) {
+        fold_call(term->subroutine_call);
+
+    } else if (term->parenthesized_expression != NULL) {
+        Parser_expression *inner = term->parenthesized_expression;
+        fold_expression(inner);
+
+        // (t) evaluates to t itself.
+        if (inner->terms.count == 1) {
+            *term = *(Parser_term *)inner->terms.head->data;
+            ll_free(&inner->terms);
+            free(inner);
+        }
+
+    } else if (term->sub_term != NULL) {
+        fold_sub_term(term);
+    }
+}
+
+static void fold_sub_term(Parser_term *term)
+{
+    Parser_sub_term *sub_term = term->sub_term;
+    Parser_term *inner = &sub_term->term;
+    short value;
+
+    fold_term(inner);
+
+    // -n is how negative constants are represented.
+    if (sub_term->unary_op == PARSER_TERM_OP_SUBTRACTION && inner->integer != NULL) {
+        return;
+    }
+
+    if (constant_value(inner, &value)) {
+        Parser_term folded;
+        short result = sub_term->unary_op == PARSER_TERM_OP_SUBTRACTION ?
+            -value :
+            ~value;
+
+        if (make_constant(result, &folded)) {
+            parser_free_term(term);
+            *term = folded;
+            stats.folded_constants++;
+        }
+
+    } else if (inner->sub_term != NULL &&
+        inner->sub_term->unary_op == sub_term->unary_op) {
+        Parser_sub_term *inner_sub_term = inner->sub_term;
+
+        *term = inner_sub_term->term;
+        free(inner_sub_term);
+        free(sub_term);
+        stats.simplified_identities++;
+    }
+}
+
+// Conditions select the then branch, or run the loop body, only
+// when they evaluate to true (-1): code gen branches on `not cond`,
+// so any other value behaves as false.
+static void prune_statements(LL_List *statements)
+{
+    LL_Node *previous = NULL;
+    LL_Node *node = statements->head;
+
+    while (node != NULL) {
+        Parser_statement *statement = (Parser_statement *)node->data;
+        short value;
+
+        if (statement->if_statement != NULL) {
+            Parser_if_statement *if_statement = statement->if_statement;
+
+            prune_statements(&if_statement->conditional_statements);
+            prune_statements(&if_statement->else_statements);
+
+            if (expression_constant(&if_statement->conditional, &value)) {
+                // Continue from the statements of the arm taken.
+                node = collapse_if(statements, previous, node);
+                stats.collapsed_ifs++;
+                continue;
+            }
+
+        } else if (statement->while_statement != NULL) {
+            Parser_while_statement *while_statement = statement->while_statement;
+
+            prune_statements(&while_statement->statements);
+
+            if (expression_constant(&while_statement->conditional, &value) && value != -1) {
+                LL_Node *next = node->next;
+                remove_statement(statements, previous, node);
+                stats.removed_loops++;
+                node = next;
+                continue;
+            }
+        }
+
+        if (always_returns(statement)) {
+            remove_next_statements(statements, node);
+        }
+
+        previous = node;
+        node = node->next;
+    }
+}
+
+// Replaces the if statement in node by the statements of the arm
+// its constant condition selects, returning the node that now
+// follows previous.
+static LL_Node *collapse_if(LL_List *statements, LL_Node *previous, LL_Node *node)
+{
+    Parser_statement *statement = (Parser_statement *)node->data;
+    Parser_if_statement *if_statement = statement->if_statement;
+    LL_Node *next = node->next;
+    short value;
+
+    expression_constant(&if_statement->conditional, &value);
+
+    LL_List *taken = value == -1 ? 
+        &if_statement->conditional_statements : 
+        &if_statement->else_statements;
+    LL_List arm = *taken;
+    *taken = ll_make_empty_list();
+
+    if (arm.head == NULL) {
+        remove_statement(statements, previous, node);
+        return next;
+    }
+
+    if (previous == NULL) {
+        statements->head = arm.head;
+    } else {
+        previous->next = arm.head;
+    }
+
+    arm.tail->next = next;
+    if (statements->tail == node) {
+        statements->tail = arm.tail;
+    }
+    statements->count += arm.count - 1;
+
+    parser_free_statement(statement);
+    ll_free_node(node);
+
+    return arm.head;
+}
+
+static void remove_next_statements(LL_List *statements, LL_Node *node)
+{
+    LL_Node *next = node->next;
+
+    while (next != NULL) {
+        LL_Node *following = next->next;
+
+        parser_free_statement((Parser_statement *)next->data);
+        ll_free_node(next);
+        statements->count--;
+        stats.unreachable_statements++;
+        next = following;
+    }
+
+    node->next = NULL;
+    statements->tail = node;
+}
+
+static void remove_statement(LL_List *statements, LL_Node *previous, LL_Node *node)
+{
+    if (previous == NULL) {
+        statements->head = node->next;
+    } else {
+        previous->next = node->next;
+    }
+
+    if (statements->tail == node) {
+        statements->tail = previous;
+    }
+    statements->count--;
+
+    parser_free_statement((Parser_statement *)node->data);
+    ll_free_node(node);
+}
+
+// A loop on true only ends by returning, as does an if whose arms
+// both end in a statement that always returns.
+static bool always_returns(Parser_statement *statement)
+{
+    short value;
+
+    if (statement->return_statement != NULL) {
+        return true;
+
+    } else if (statement->while_statement != NULL) {
+        return expression_constant(&statement->while_statement->conditional, &value) &&
+            value == -1;
+
+    } else if (statement->if_statement != NULL) {
+        LL_List *then_statements = &statement->if_statement->conditional_statements;
+        LL_List *else_statements = &statement->if_statement->else_statements;
+
+        return then_statements->tail != NULL &&
+            else_statements->tail != NULL &&
+            always_returns((Parser_statement *)then_statements->tail->data) &&
+            always_returns((Parser_statement *)else_statements->tail->data);
+    }
+
+    return false;
+}
+
+static bool expression_constant(Parser_expression *expr, short *value)
+{
+    return expr->terms.count == 1 && 
+        constant_value((Parser_term *)expr->terms.head->data, value);
+}
+
+// Results wrap around to 16 bits, like the VM and the OS' Math
+// routines do. Comparisons are only folded when a - b doesn't
+// overflow, where every VM implementation agrees on the result, and
+// divisions by zero are left to fail at runtime.
+static bool fold_binary(Parser_term_operator op, short a, short b, short *result)
+{
+    int difference = a - b;
+    bool is_comparable = difference >= OPT_MIN_VALUE && difference <= -(OPT_MIN_VALUE + 1);
+
+    if (op == PARSER_TERM_OP_ADDITION) {
+        *result = (short)(a + b);
+
+    } else if (op == PARSER_TERM_OP_SUBTRACTION) {
+        *result = (short)difference;
+
+    } else if (op == PARSER_TERM_OP_MULTIPLICATION) {
+        *result = (short)(a * b);
+
+    } else if (op == PARSER_TERM_OP_DIVISION) {
+        if (b == 0 || a == OPT_MIN_VALUE || b == OPT_MIN_VALUE) {
+            return false;
+        }
+        *result = a / b;
+
+    } else if (op == PARSER_TERM_OP_AND) {
+        *result = a & b;
+
+    } else if (op == PARSER_TERM_OP_OR) {
+        *result = a | b;
+
+    } else if (op == PARSER_TERM_OP_ASSIGN) {
+        *result = a == b ? -1 : 0;
+
+    } else if (op == PARSER_TERM_OP_LESSER && is_comparable) {
+        *result = a < b ? -1 : 0;
+
+    } else if (op == PARSER_TERM_OP_GREATER && is_comparable) {
+        *result = a > b ? -1 : 0;
+
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// (x op1 a) op2 b, merged into x op b for chains of +/- and of *.
+static bool combine_operands(
+    Parser_term_operator first_op,
+    short a,
+    Parser_term_operator second_op,
+    short b,
+    Parser_term_operator *op,
+    short *value
+) {
+    bool is_first_additive = first_op == PARSER_TERM_OP_ADDITION ||
+        first_op == PARSER_TERM_OP_SUBTRACTION;
+    bool is_second_additive = second_op == PARSER_TERM_OP_ADDITION ||
+        second_op == PARSER_TERM_OP_SUBTRACTION;
+
+    if (is_first_additive && is_second_additive) {
+        short sum = (short)(
+            (first_op == PARSER_TERM_OP_ADDITION ? a : -a) +
+            (second_op == PARSER_TERM_OP_ADDITION ? b : -b)
+        );
+
+        if (sum == OPT_MIN_VALUE) {
+            return false;
+        }
+
+        *op = sum < 0 ? PARSER_TERM_OP_SUBTRACTION : PARSER_TERM_OP_ADDITION;
+        *value = sum < 0 ? -sum : sum;
+        return true;
+    }
+
+    if (first_op == PARSER_TERM_OP_MULTIPLICATION &&
+        second_op == PARSER_TERM_OP_MULTIPLICATION) {
+        short product = (short)(a * b);
+
+        if (product == OPT_MIN_VALUE) {
+            return false;
+        }
+
+        *op = PARSER_TERM_OP_MULTIPLICATION;
+        *value = product;
+        return true;
+    }
+
+    return false;
+}
+
+// x + 0, x - 0, x * 1, x / 1, x | 0, x & true
+static bool is_right_identity(Parser_term_operator op, short value)
+{
+    return ((op == PARSER_TERM_OP_ADDITION ||
+        op == PARSER_TERM_OP_SUBTRACTION ||
+        op == PARSER_TERM_OP_OR) && value == 0) ||
+        ((op == PARSER_TERM_OP_MULTIPLICATION ||
+        op == PARSER_TERM_OP_DIVISION) && value == 1) ||
+        (op == PARSER_TERM_OP_AND && value == -1);
+}
+
+// 0 + x, 0 - x (turned into -x), 1 * x, 0 | x, true & x
+static bool is_left_identity(Parser_term_operator op, short value)
+{
+    return ((op == PARSER_TERM_OP_ADDITION ||
+        op == PARSER_TERM_OP_SUBTRACTION ||
+        op == PARSER_TERM_OP_OR) && value == 0) ||
+        (op == PARSER_TERM_OP_MULTIPLICATION && value == 1) ||
+        (op == PARSER_TERM_OP_AND && value == -1);
+}
+
+static bool constant_value(Parser_term *term, short *value)
+{
+    if (term->integer != NULL) {
+        *value = (short)atoi(term->integer);
+        return true;
+
+    } else if (term->keyword_value == PARSER_TERM_KEYWORD_TRUE) {
+        *value = -1;
+        return true;
+
+    } else if (term->keyword_value == PARSER_TERM_KEYWORD_FALSE ||
+        term->keyword_value == PARSER_TERM_KEYWORD_NULL) {
+        *value = 0;
+        return true;
+
+    } else if (term->sub_term != NULL) {
+        short inner;
+
+        if (!constant_value(&term->sub_term->term, &inner)) {
+            return false;
+        }
+
+        *value = term->sub_term->unary_op == PARSER_TERM_OP_SUBTRACTION ?
+            -inner :
+            ~inner;
+        return true;
+    }
+
+    return false;
+}
+
+// Jack integer constants are non-negative: negative values become
+// -n, except for -32768, which has no positive counterpart.
+static bool make_constant(short value, Parser_term *term)
+{
+    if (value >= 0) {
+        *term = make_integer(value);
+    } else if (value != OPT_MIN_VALUE) {
+        *term = make_sub_term(PARSER_TERM_OP_SUBTRACTION, make_integer(-value));
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static Parser_term make_integer(int value)
+{
+    Parser_term term = make_empty_term();
+    term.integer = malloc(sizeof(char) * 8);
+    sprintf(term.integer, "%d", value);
+    return term;
+}
+
+static Parser_term make_sub_term(Parser_term_operator op, Parser_term inner)
+{
+    Parser_term term = make_empty_term();
+    term.sub_term = malloc(sizeof(Parser_sub_term));
+    term.sub_term->unary_op = op;
+    term.sub_term->term = inner;
+    return term;
+}
+
+static Parser_term make_empty_term()
+{
+    Parser_term term;
+    term.integer = NULL;
+    term.string = NULL;
+    term.keyword_value = PARSER_TERM_KEYWORD_UNDEFINED;
+    term.var_usage = NULL;
+    term.subroutine_call = NULL;
+    term.parenthesized_expression = NULL;
+    term.sub_term = NULL;
+    return term;
+}
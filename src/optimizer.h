@@ -0,0 +1,27 @@
+#ifndef OPT_OPTIMIZER
+#define OPT_OPTIMIZER
+
+#include "parser.h"
+
+// Counters of the rewrites applied to the AST.
+typedef struct {
+    long folded_constants;
+    long simplified_identities;
+    long unreachable_statements;
+    long collapsed_ifs;
+    long removed_loops;
+} OPT_Stats;
+
+// Evaluates constant subexpressions with Jack's 16-bit wraparound
+// semantics and drops operations with neutral operands, rewriting
+// the class' AST in place.
+void opt_fold_constants(Parser_jack_syntax *ast);
+
+// Removes statements that can't run: everything after a statement
+// that always returns, the untaken arm of ifs on constant conditions
+// and loops on constant conditions other than true.
+void opt_eliminate_dead_code(Parser_jack_syntax *ast);
+
+OPT_Stats opt_stats();
+
+#endif
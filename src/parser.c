@@ -10,6 +10,10 @@ static char *class_name;
 
 static Parser_class_dec parse_class_dec();
 
+static int index_class_vars();
+static bool index_subroutine(IDT_Subroutine_Entry *subroutine);
+static void skip_block();
+
 static void parse_class_vars_dec(Parser_class_dec *class, int static_i, int field_i);
 static void parse_subroutines(Parser_class_dec *class);
 static void parse_params_list(Parser_subroutine_dec *subroutine);
@@ -23,6 +27,7 @@ static void parse_if(LL_List *statements);
 static void parse_while(LL_List *statements);
 static void parse_return(LL_List *statements);
 static Parser_statement make_empty_statement();
+static void append_name(LL_List *names, char *name);
 
 static Parser_expression parse_expression();
 static Parser_term parse_term();
@@ -46,9 +51,6 @@ static void exit_parsing(char *msg);
 void free_class_var(Parser_class_var_dec *var);
 void free_subroutine(Parser_subroutine_dec *subroutine);
 void free_var(Parser_var_dec *var);
-void free_statement(Parser_statement *statement);
-void free_expression(Parser_expression *expression);
-void free_term(Parser_term *term);
 void free_subroutine_call(Parser_term_subroutine_call *subroutine_call);
 
 Parser_jack_syntax parser_parse(FILE *source) {
@@ -60,6 +62,73 @@ Parser_jack_syntax parser_parse(FILE *source) {
     return jack_syntax;
 }
 
+// Signature-only pass: stores the class and the signatures of its
+// subroutines in the identifier table, skipping every body. Running
+// it over all files before code gen lets calls into any class of the
+// project be resolved.
+void parser_index_signatures(FILE *source)
+{
+    tokenizer_start(source);
+
+    consume_atom();
+    expect(current_atom.keyword == TK_KEYWORD_CLASS, "'class' keyword expected");
+    free(current_atom.value);
+
+    consume_atom();
+    expect(current_atom.type == TK_TYPE_IDENTIFIER, "Class name expected");
+    char *name = current_atom.value;
+
+    consume_atom();
+    expect(current_atom.symbol == TK_SYMBOL_L_CURLY, "'{' symbol expected");
+    free(current_atom.value);
+
+    int statics_count = 0;
+    int fields_count = 0;
+
+    Tokenizer_atom peek = peek_atom();
+    free(peek.value);
+
+    while (peek.keyword == TK_KEYWORD_STATIC || peek.keyword == TK_KEYWORD_FIELD) {
+        if (peek.keyword == TK_KEYWORD_STATIC) {
+            statics_count += index_class_vars();
+        } else {
+            fields_count += index_class_vars();
+        }
+
+        peek = peek_atom();
+        free(peek.value);
+    }
+
+    int subroutines_count = 0;
+    int subroutines_capacity = 8;
+    IDT_Subroutine_Entry *subroutines = malloc(
+        sizeof(IDT_Subroutine_Entry) * subroutines_capacity
+    );
+
+    while (index_subroutine(&subroutines[subroutines_count])) {
+        subroutines_count++;
+
+        if (subroutines_count == subroutines_capacity) {
+            subroutines_capacity *= 2;
+            subroutines = realloc(
+                subroutines, 
+                sizeof(IDT_Subroutine_Entry) * subroutines_capacity
+            );
+        }
+    }
+
+    // The whole class is published at once, so concurrent
+    // readers never see it partially indexed.
+    idt_store_class_signatures(
+        name, 
+        fields_count, 
+        statics_count, 
+        subroutines, 
+        subroutines_count
+    );
+    free(subroutines);
+}
+
 char *parser_unique_var_key(
     const char *class_name, 
     const char *func_name,
@@ -121,6 +190,150 @@ static Parser_class_dec parse_class_dec()
     return class_dec;
 }
 
+static int index_class_vars()
+{
+    int count = 0;
+
+    consume_atom();
+    free(current_atom.value);
+
+    consume_atom();
+    expect(
+        is_type(current_atom),
+        "Expected type in variable declaration"
+    );
+    free(current_atom.value);
+
+    consume_atom();
+    while (current_atom.type == TK_TYPE_IDENTIFIER) {
+        count++;
+        free(current_atom.value);
+
+        consume_atom();
+        if (current_atom.symbol == TK_SYMBOL_COMMA) {
+            free(current_atom.value);
+            consume_atom();
+        }
+    }
+
+    expect(
+        current_atom.symbol == TK_SYMBOL_SEMICOLON,
+        "Expected ';' at end of variable declaration."
+    );
+    free(current_atom.value);
+
+    return count;
+}
+
+static bool index_subroutine(IDT_Subroutine_Entry *subroutine)
+{
+    Tokenizer_atom peek = peek_atom();
+    free(peek.value);
+
+    IDT_Subroutine_Kind kind;
+
+    if (peek.keyword == TK_KEYWORD_FUNCTION) {
+        kind = IDT_FUNCTION;
+    } else if (peek.keyword == TK_KEYWORD_CONSTRUCTOR) {
+        kind = IDT_CONSTRUCTOR;
+    } else if (peek.keyword == TK_KEYWORD_METHOD) {
+        kind = IDT_METHOD;
+    } else {
+        return false;
+    }
+
+    consume_atom();
+    free(current_atom.value);
+
+    consume_atom();
+    expect(
+        is_type(current_atom),
+        "Expected return type in subroutine declaration"
+    );
+    bool is_void = current_atom.keyword == TK_KEYWORD_VOID;
+    free(current_atom.value);
+
+    consume_atom();
+    expect(
+        current_atom.type == TK_TYPE_IDENTIFIER,
+        "Expected subroutine name in declaration"
+    );
+    char *name = current_atom.value;
+
+    consume_atom();
+    expect(
+        current_atom.symbol == TK_SYMBOL_L_PAREN,
+        "Expected opening parenthesis for parameter list " 
+        "'(' in subroutine declaration"
+    );
+    free(current_atom.value);
+
+    int params_count = 0;
+
+    consume_atom();
+    while (is_type(current_atom)) {
+        free(current_atom.value);
+
+        consume_atom();
+        expect(
+            current_atom.type == TK_TYPE_IDENTIFIER,
+            "Expected parameter name in function declaration"
+        );
+        free(current_atom.value);
+        params_count++;
+
+        consume_atom();
+        if (current_atom.symbol == TK_SYMBOL_COMMA) {
+            free(current_atom.value);
+            consume_atom();
+        }
+    }
+
+    expect(
+        current_atom.symbol == TK_SYMBOL_R_PAREN,
+        "Expected closing parenthesis ')' at "
+        "end of parameter list in subroutine declaration"
+    );
+    free(current_atom.value);
+
+    consume_atom();
+    expect(
+        current_atom.symbol == TK_SYMBOL_L_CURLY,
+        "Expected left curly brace '{' at beginning of "
+        "subroutine's body declaration."
+    );
+    free(current_atom.value);
+
+    skip_block();
+
+    subroutine->key = NULL;
+    subroutine->class_name = NULL;
+    subroutine->name = name;
+    subroutine->kind = kind;
+    subroutine->params_count = params_count;
+    subroutine->is_void = is_void;
+
+    return true;
+}
+
+// Consumes atoms up to the '}' closing an already opened block.
+static void skip_block()
+{
+    int depth = 1;
+
+    while (depth > 0) {
+        consume_atom();
+
+        if (current_atom.symbol == TK_SYMBOL_L_CURLY) {
+            depth++;
+        } else if (current_atom.symbol == TK_SYMBOL_R_CURLY) {
+            depth--;
+        }
+
+        free(current_atom.value);
+    }
+}
+
 static void parse_class_vars_dec(Parser_class_dec *class, int static_i, int field_i)
 {
     bool has_var_decs = false;
@@ -161,17 +374,13 @@ static void parse_class_vars_dec(Parser_class_dec *class, int static_i, int fiel
         "Expected variable name in declaration"
     );
 
-    LL_Node *name_node = malloc(sizeof(LL_Node));
-    name_node->next = NULL;
-    name_node->data = (void *)current_atom.value;
-    ll_append(name_node, &var_dec.names);
-
     idt_store_var(
         parser_unique_var_key(class->name, NULL, current_atom.value),
         var_dec.type_name,
         var_dec.scope == PARSER_VAR_STATIC ? static_i : field_i,
         var_dec.scope == PARSER_VAR_STATIC ? IDT_STATIC : IDT_FIELD
     );
+    append_name(&var_dec.names, current_atom.value);
     
     if (var_dec.scope == PARSER_VAR_STATIC) {
         static_i++;
@@ -189,16 +398,13 @@ static void parse_class_vars_dec(Parser_class_dec *class, int static_i, int fiel
             "Expected variable name in declaration"
         );
 
-        name_node = ll_make_node(sizeof(char));
-        name_node->data = (void *)current_atom.value;
-        ll_append(name_node, &var_dec.names);
-
         idt_store_var(
             parser_unique_var_key(class->name, NULL, current_atom.value),
             var_dec.type_name,
             var_dec.scope == PARSER_VAR_STATIC ? static_i : field_i,
             var_dec.scope == PARSER_VAR_STATIC ? IDT_STATIC : IDT_FIELD
         );
+        append_name(&var_dec.names, current_atom.value);
 
         if (var_dec.scope == PARSER_VAR_STATIC) {
             static_i++;
@@ -379,17 +585,13 @@ static void parse_var_decs(Parser_subroutine_dec *subroutine, int var_i)
         "Expected variable name in declaration"
     );
     while (current_atom.type == TK_TYPE_IDENTIFIER) {
-        LL_Node *name_node = malloc(sizeof(LL_Node));
-        name_node->next = NULL;
-        name_node->data = (void *)current_atom.value;
-        ll_append(name_node, &var.names);
-
         idt_store_var(
             parser_unique_var_key(class_name, subroutine->name, current_atom.value),
             var.type_name,
             var_i, 
             IDT_LOCAL
         );
+        append_name(&var.names, current_atom.value);
         var_i++;
 
         consume_atom();
@@ -418,6 +620,9 @@ static void parse_statements(LL_List *statements_list)
     Tokenizer_atom peek = peek_atom();
     free(peek.value);
 
+    // Peeking skipped everything ahead of the statement's keyword.
+    int line = tokenizer_get_line();
+
     if (peek.keyword == TK_KEYWORD_LET) {
         parse_let(statements_list);    
 
@@ -437,6 +642,8 @@ static void parse_statements(LL_List *statements_list)
         return;
     }
 
+    ((Parser_statement *)statements_list->tail->data)->line = line;
+
     parse_statements(statements_list);
 }
 
@@ -1000,6 +1207,7 @@ static Parser_term_var_usage parse_var_usage()
 static Parser_statement make_empty_statement()
 {
     Parser_statement statement;
+    statement.line = 0;
     statement.do_statement = NULL;
     statement.let_statement = NULL;
     statement.if_statement = NULL;
@@ -1008,6 +1216,19 @@ static Parser_statement make_empty_statement()
     return statement;
 }
 
+// Copies the name inline into its list node and
+// releases the token's buffer.
+static void append_name(LL_List *names, char *name)
+{
+    size_t size = strlen(name) + 1;
+
+    LL_Node *node = ll_make_node(size);
+    memcpy(node->data, name, size);
+    ll_append(node, names);
+
+    free(name);
+}
+
 static Parser_expression make_empty_expression()
 {
     Parser_expression expression;
@@ -1180,7 +1401,7 @@ void free_subroutine(Parser_subroutine_dec *subroutine)
     if (subroutine->statements.count > 0) {
         node = subroutine->statements.head;
         while(node != NULL) {
-            free_statement((Parser_statement *)node->data);
+            parser_free_statement((Parser_statement *)node->data);
             node = node->next;
         }
         ll_free(&subroutine->statements);
@@ -1198,7 +1419,7 @@ void free_var(Parser_var_dec *var)
     free(var->type_name);
 }
 
-void free_statement(Parser_statement *statement)
+void parser_free_statement(Parser_statement *statement)
 {
     LL_Node *node;
 
@@ -1209,8 +1430,8 @@ void free_statement(Parser_statement *statement)
 
     } else if (statement->let_statement != NULL) {
         Parser_let_statement *let_statement = statement->let_statement;
-        free_expression(&let_statement->subscript);
-        free_expression(&let_statement->value);
+        parser_free_expression(&let_statement->subscript);
+        parser_free_expression(&let_statement->value);
         free(let_statement->var_name);
         free(let_statement);
 
@@ -1221,7 +1442,7 @@ void free_statement(Parser_statement *statement)
             LL_Node *node = if_statement->conditional_statements.head;
 
             while (node != NULL) {
-                free_statement((Parser_statement *)node->data);
+                parser_free_statement((Parser_statement *)node->data);
                 node = node->next;
             }
 
@@ -1232,14 +1453,14 @@ void free_statement(Parser_statement *statement)
             LL_Node *node = if_statement->else_statements.head;
 
             while (node != NULL) {
-                free_statement((Parser_statement *)node->data);
+                parser_free_statement((Parser_statement *)node->data);
                 node = node->next;
             }
 
             ll_free(&if_statement->else_statements);
         }
 
-        free_expression(&if_statement->conditional);
+        parser_free_expression(&if_statement->conditional);
         free(if_statement);
 
     } else if (statement->while_statement != NULL) {
@@ -1249,30 +1470,30 @@ void free_statement(Parser_statement *statement)
             node = while_statement->statements.head;
 
             while (node != NULL) {
-                free_statement((Parser_statement *)node->data);
+                parser_free_statement((Parser_statement *)node->data);
                 node = node->next;
             }
 
             ll_free(&while_statement->statements);
         }
 
-        free_expression(&while_statement->conditional);
+        parser_free_expression(&while_statement->conditional);
         free(while_statement);
 
     } else if (statement->return_statement != NULL) {
         Parser_return_statement *return_statement = statement->return_statement;
-        free_expression(&return_statement->expression);
+        parser_free_expression(&return_statement->expression);
         free(return_statement);
     }
 }
 
-void free_expression(Parser_expression *expression)
+void parser_free_expression(Parser_expression *expression)
 {
      if (expression->terms.count > 0) {
         LL_Node *node = expression->terms.head;
 
         while (node != NULL) {
-            free_term((Parser_term *)node->data);
+            parser_free_term((Parser_term *)node->data);
             node = node->next;
         }
 
@@ -1284,7 +1505,7 @@ void free_expression(Parser_expression *expression)
     }
 }
 
-void free_term(Parser_term *term)
+void parser_free_term(Parser_term *term)
 {
     if (term->integer != NULL) {
         free(term->integer);
@@ -1295,7 +1516,7 @@ void free_term(Parser_term *term)
     } else if (term->var_usage != NULL) {
         free(term->var_usage->var_name);
         if (term->var_usage->subscript != NULL) {
-            free_expression(term->var_usage->subscript);
+            parser_free_expression(term->var_usage->subscript);
         }
         free(term->var_usage);
 
@@ -1304,11 +1525,11 @@ void free_term(Parser_term *term)
         free(term->subroutine_call);
 
     } else if (term->parenthesized_expression != NULL) {
-        free_expression(term->parenthesized_expression);
+        parser_free_expression(term->parenthesized_expression);
         free(term->parenthesized_expression);
 
     } else if (term->sub_term != NULL) {
-        free_term(&term->sub_term->term);
+        parser_free_term(&term->sub_term->term);
         free(term->sub_term);
     }
 }
@@ -1319,7 +1540,7 @@ void free_subroutine_call(Parser_term_subroutine_call *subroutine_call)
         LL_Node *node = subroutine_call->param_expressions.head;
 
         while (node != NULL) {
-            free_expression((Parser_expression *)node->data);
+            parser_free_expression((Parser_expression *)node->data);
             node = node->next;
         }
 
@@ -137,7 +137,9 @@ typedef struct {
     Parser_expression expression;
 } Parser_return_statement;
 
+// line is where the statement starts in its Jack file.
 typedef struct {
+    int line;
     Parser_do_statement *do_statement;
     Parser_let_statement *let_statement;
     Parser_if_statement *if_statement;
@@ -146,11 +148,15 @@ typedef struct {
 } Parser_statement;
 
 Parser_jack_syntax parser_parse(FILE *source);
+void parser_index_signatures(FILE *source);
 char *parser_unique_var_key(
     const char *class_name, 
     const char *func_name, 
     const char *name
 );
 void parser_free(Parser_jack_syntax ast);
+void parser_free_statement(Parser_statement *statement);
+void parser_free_expression(Parser_expression *expression);
+void parser_free_term(Parser_term *term);
 
 #endif
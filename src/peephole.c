@@ -0,0 +1,483 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "peephole.h"
+
+#define PH_NO_MATCH -1
+#define PH_MAX_ADDRESS_LENGTH 8
+
+// A rule looks at the last `window` instructions emitted so far. When
+// it matches, it rewrites them in place and returns how many
+// instructions are left in the window, otherwise PH_NO_MATCH.
+typedef struct {
+    const char *name;
+    int window;
+    int (*apply)(VM_Instruction *window);
+} PH_Rule;
+
+static int apply_push_pop(VM_Instruction *window);
+static int apply_double_not(VM_Instruction *window);
+static int apply_double_neg(VM_Instruction *window);
+static int apply_neutral_operand(VM_Instruction *window);
+static int apply_and_true(VM_Instruction *window);
+static int apply_not_true(VM_Instruction *window);
+static int apply_neg_zero(VM_Instruction *window);
+static int apply_constant_branch(VM_Instruction *window);
+static int apply_true_branch(VM_Instruction *window);
+static int apply_not_false_branch(VM_Instruction *window);
+static int apply_inverted_branch(VM_Instruction *window);
+static int apply_jump_to_next(VM_Instruction *window);
+static int apply_unreachable(VM_Instruction *window);
+
+static bool run_rules(VM_Function *function);
+static int reduce(VM_Instruction *code, int length);
+static bool remove_unused_labels(VM_Function *function);
+static bool reuse_that_pointer(VM_Function *function);
+static int address_length(VM_Instruction *code, int length);
+static bool address_reads(VM_Instruction *address, int length, VM_Segment segment, int index);
+static bool is_constant(VM_Instruction instruction, int value);
+static bool is_jump(VM_Instruction instruction);
+static bool is_comparison(VM_Instruction instruction);
+
+static PH_Rule rules[] = {
+    { "push/pop same slot", 2, apply_push_pop },
+    { "not not", 2, apply_double_not },
+    { "neg neg", 2, apply_double_neg },
+    { "add/sub/or 0", 2, apply_neutral_operand },
+    { "and true", 3, apply_and_true },
+    { "not true", 3, apply_not_true },
+    { "neg 0", 2, apply_neg_zero },
+    { "branch on constant", 2, apply_constant_branch },
+    { "branch on true", 3, apply_true_branch },
+    { "branch on not false", 3, apply_not_false_branch },
+    { "inverted branch", 5, apply_inverted_branch },
+    { "jump to next", 2, apply_jump_to_next },
+    { "unreachable", 2, apply_unreachable }
+};
+
+#define PH_RULES_COUNT (int)(sizeof(rules) / sizeof(PH_Rule))
+
+static long hits[PH_RULES_COUNT];
+static long unused_labels;
+static long reused_that_pointers;
+
+void ph_optimize(VM_Class *class)
+{
+    for (int i = 0; i < class->functions_count; i++) {
+        VM_Function *function = &class->functions[i];
+        bool changed = true;
+
+        // Dropping a label can expose more unreachable code, so
+        // both steps run until the function stops changing.
+        while (changed) {
+            changed = run_rules(function);
+            changed = remove_unused_labels(function) || changed;
+            changed = reuse_that_pointer(function) || changed;
+        }
+    }
+}
+
+int ph_rules_stats(PH_Stats *stats, int max_count)
+{
+    int count = 0;
+
+    for (int i = 0; i < PH_RULES_COUNT && count < max_count; i++) {
+        stats[count++] = (PH_Stats){ rules[i].name, hits[i] };
+    }
+
+    if (count < max_count) {
+        stats[count++] = (PH_Stats){ "unused label", unused_labels };
+    }
+
+    if (count < max_count) {
+        stats[count++] = (PH_Stats){ "pointer 1 reuse", reused_that_pointers };
+    }
+
+    return count;
+}
+
+// Instructions are copied into place one at a time and the rules
+// are matched against the tail of what was kept, so a rewrite can
+// immediately enable another one on the instructions before it.
+static bool run_rules(VM_Function *function)
+{
+    VM_Instruction *code = function->instructions;
+    int length = 0;
+
+    for (int i = 0; i < function->count; i++) {
+        code[length++] = code[i];
+        length = reduce(code, length);
+    }
+
+    bool changed = length != function->count;
+    function->count = length;
+
+    return changed;
+}
+
+static int reduce(VM_Instruction *code, int length)
+{
+    int rule = 0;
+
+    while (rule < PH_RULES_COUNT) {
+        int window = rules[rule].window;
+
+        if (length >= window) {
+            int kept = rules[rule].apply(code + length - window);
+
+            if (kept != PH_NO_MATCH) {
+                hits[rule]++;
+                length += kept - window;
+                rule = 0;
+                continue;
+            }
+        }
+
+        rule++;
+    }
+
+    return length;
+}
+
+static bool remove_unused_labels(VM_Function *function)
+{
+    VM_Instruction *code = function->instructions;
+    int max_label = -1;
+
+    for (int i = 0; i < function->count; i++) {
+        if (code[i].opcode == VM_LABEL && code[i].operand > max_label) {
+            max_label = code[i].operand;
+        }
+    }
+
+    if (max_label < 0) {
+        return false;
+    }
+
+    bool *is_used = calloc(max_label + 1, sizeof(bool));
+
+    for (int i = 0; i < function->count; i++) {
+        if (is_jump(code[i]) && code[i].operand <= max_label) {
+            is_used[code[i].operand] = true;
+        }
+    }
+
+    int length = 0;
+
+    for (int i = 0; i < function->count; i++) {
+        if (code[i].opcode == VM_LABEL && !is_used[code[i].operand]) {
+            unused_labels++;
+            continue;
+        }
+        code[length++] = code[i];
+    }
+
+    free(is_used);
+
+    bool changed = length != function->count;
+    function->count = length;
+
+    return changed;
+}
+
+// Array accesses set `pointer 1` from an address computed by pushes
+// and arithmetic alone. Within a block, a later access computing the
+// same address from unchanged slots can use THAT as it is. Calls save
+// and restore THAT, but may change statics and fields, as may writes
+// through THAT itself, so addresses read from those are forgotten.
+static bool reuse_that_pointer(VM_Function *function)
+{
+    VM_Instruction *code = function->instructions;
+    VM_Instruction address[PH_MAX_ADDRESS_LENGTH];
+    int address_count = 0;
+    int length = 0;
+
+    for (int i = 0; i < function->count; i++) {
+        VM_Instruction instruction = code[i];
+
+        if (instruction.opcode == VM_POP && instruction.segment == VM_SEGMENT_POINTER &&
+            instruction.operand == 1) {
+            int count = address_length(code, length);
+
+            if (count > 0 && count == address_count &&
+                vm_same_code(code + length - count, address, count)) {
+                reused_that_pointers++;
+                length -= count;
+                continue;
+            }
+
+            address_count = count;
+            memcpy(address, code + length - count, sizeof(VM_Instruction) * count);
+
+        } else if (instruction.opcode == VM_LABEL) {
+            address_count = 0;
+
+        } else if (instruction.opcode == VM_POP) {
+            VM_Segment segment = instruction.segment;
+
+            if (address_reads(address, address_count, segment, instruction.operand) ||
+                (segment == VM_SEGMENT_POINTER &&
+                 address_reads(address, address_count, VM_SEGMENT_THIS, -1)) ||
+                (segment == VM_SEGMENT_THAT &&
+                 (address_reads(address, address_count, VM_SEGMENT_THIS, -1) ||
+                  address_reads(address, address_count, VM_SEGMENT_STATIC, -1)))) {
+                address_count = 0;
+            }
+
+        } else if (instruction.opcode == VM_CALL) {
+            if (address_reads(address, address_count, VM_SEGMENT_THIS, -1) ||
+                address_reads(address, address_count, VM_SEGMENT_STATIC, -1)) {
+                address_count = 0;
+            }
+        }
+
+        code[length++] = instruction;
+    }
+
+    bool changed = length != function->count;
+    function->count = length;
+
+    return changed;
+}
+
+// Length of the pure address computation ending the code, which must
+// produce exactly one value out of nothing, or 0 if there is none.
+static int address_length(VM_Instruction *code, int length)
+{
+    int needed = 1;
+
+    for (int i = length - 1; i >= 0 && length - i <= PH_MAX_ADDRESS_LENGTH; i--) {
+        VM_Opcode opcode = code[i].opcode;
+
+        if (opcode == VM_PUSH) {
+            VM_Segment segment = code[i].segment;
+
+            if (segment == VM_SEGMENT_THAT ||
+                segment == VM_SEGMENT_POINTER ||
+                segment == VM_SEGMENT_TEMP) {
+                return 0;
+            }
+            needed--;
+
+        } else if (opcode == VM_ADD || opcode == VM_SUB ||
+                   opcode == VM_AND || opcode == VM_OR ||
+                   opcode == VM_EQ || opcode == VM_LT || opcode == VM_GT) {
+            needed++;
+
+        } else if (opcode != VM_NEG && opcode != VM_NOT) {
+            return 0;
+        }
+
+        if (needed == 0) {
+            return length - i;
+        }
+    }
+
+    return 0;
+}
+
+// Whether the address pushes the given slot, or any slot of the
+// segment when index is -1.
+static bool address_reads(VM_Instruction *address, int length, VM_Segment segment, int index)
+{
+    for (int i = 0; i < length; i++) {
+        if (address[i].opcode == VM_PUSH &&
+            address[i].segment == segment &&
+            (index < 0 || address[i].operand == index)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// push S i, pop S i
+static int apply_push_pop(VM_Instruction *window)
+{
+    if (window[0].opcode == VM_PUSH &&
+        window[1].opcode == VM_POP &&
+        window[0].segment == window[1].segment &&
+        window[0].operand == window[1].operand) {
+        return 0;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// not, not
+static int apply_double_not(VM_Instruction *window)
+{
+    if (window[0].opcode == VM_NOT && window[1].opcode == VM_NOT) {
+        return 0;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// neg, neg
+static int apply_double_neg(VM_Instruction *window)
+{
+    if (window[0].opcode == VM_NEG && window[1].opcode == VM_NEG) {
+        return 0;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// push constant 0, add|sub|or
+static int apply_neutral_operand(VM_Instruction *window)
+{
+    VM_Opcode opcode = window[1].opcode;
+
+    if (is_constant(window[0], 0) &&
+        (opcode == VM_ADD || opcode == VM_SUB || opcode == VM_OR)) {
+        return 0;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// push constant 1, neg, and
+static int apply_and_true(VM_Instruction *window)
+{
+    if (is_constant(window[0], 1) &&
+        window[1].opcode == VM_NEG &&
+        window[2].opcode == VM_AND) {
+        return 0;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// push constant 1, neg, not => push constant 0
+static int apply_not_true(VM_Instruction *window)
+{
+    if (is_constant(window[0], 1) &&
+        window[1].opcode == VM_NEG &&
+        window[2].opcode == VM_NOT) {
+        window[0].operand = 0;
+        return 1;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// push constant 0, neg => push constant 0
+static int apply_neg_zero(VM_Instruction *window)
+{
+    if (is_constant(window[0], 0) && window[1].opcode == VM_NEG) {
+        return 1;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// push constant k, if-goto L => goto L when k is not 0
+static int apply_constant_branch(VM_Instruction *window)
+{
+    if (window[0].opcode != VM_PUSH ||
+        window[0].segment != VM_SEGMENT_CONSTANT ||
+        window[1].opcode != VM_IF_GOTO) {
+        return PH_NO_MATCH;
+    }
+
+    if (window[0].operand == 0) {
+        return 0;
+    }
+
+    window[0] = window[1];
+    window[0].opcode = VM_GOTO;
+    return 1;
+}
+
+// push constant 1, neg, if-goto L => goto L
+static int apply_true_branch(VM_Instruction *window)
+{
+    if (is_constant(window[0], 1) &&
+        window[1].opcode == VM_NEG &&
+        window[2].opcode == VM_IF_GOTO) {
+        window[0] = window[2];
+        window[0].opcode = VM_GOTO;
+        return 1;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// push constant 0, not, if-goto L => goto L
+static int apply_not_false_branch(VM_Instruction *window)
+{
+    if (is_constant(window[0], 0) &&
+        window[1].opcode == VM_NOT &&
+        window[2].opcode == VM_IF_GOTO) {
+        window[0] = window[2];
+        window[0].opcode = VM_GOTO;
+        return 1;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// eq|lt|gt, not, if-goto L1, goto L2, label L1 =>
+// eq|lt|gt, if-goto L2, label L1
+// `not` then if-goto only falls through on true (-1), so the branch is
+// inverted only after comparisons, which leave either true or false.
+static int apply_inverted_branch(VM_Instruction *window)
+{
+    if (is_comparison(window[0]) &&
+        window[1].opcode == VM_NOT &&
+        window[2].opcode == VM_IF_GOTO &&
+        window[3].opcode == VM_GOTO &&
+        window[4].opcode == VM_LABEL &&
+        window[2].operand == window[4].operand) {
+        window[1] = window[3];
+        window[1].opcode = VM_IF_GOTO;
+        window[2] = window[4];
+        return 3;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// goto L, label L => label L
+static int apply_jump_to_next(VM_Instruction *window)
+{
+    if (window[0].opcode == VM_GOTO &&
+        window[1].opcode == VM_LABEL &&
+        window[0].operand == window[1].operand) {
+        window[0] = window[1];
+        return 1;
+    }
+
+    return PH_NO_MATCH;
+}
+
+// Anything between a goto or return and the next label can't run.
+static int apply_unreachable(VM_Instruction *window)
+{
+    if ((window[0].opcode == VM_GOTO || window[0].opcode == VM_RETURN) &&
+        window[1].opcode != VM_LABEL) {
+        return 1;
+    }
+
+    return PH_NO_MATCH;
+}
+
+static bool is_constant(VM_Instruction instruction, int value)
+{
+    return instruction.opcode == VM_PUSH &&
+        instruction.segment == VM_SEGMENT_CONSTANT &&
+        instruction.operand == value;
+}
+
+static bool is_jump(VM_Instruction instruction)
+{
+    return instruction.opcode == VM_GOTO || instruction.opcode == VM_IF_GOTO;
+}
+
+static bool is_comparison(VM_Instruction instruction)
+{
+    return instruction.opcode == VM_EQ ||
+        instruction.opcode == VM_LT ||
+        instruction.opcode == VM_GT;
+}
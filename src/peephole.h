@@ -0,0 +1,19 @@
+#ifndef PH_PEEPHOLE
+#define PH_PEEPHOLE
+
+#include "vm-ir.h"
+
+#define PH_MAX_RULES 16
+
+// Peephole optimizer: a table of rewrite rules, each matching a
+// short window of instructions, is applied over every function of
+// a class until none of them fire anymore.
+typedef struct {
+    const char *name;
+    long hits;
+} PH_Stats;
+
+void ph_optimize(VM_Class *class);
+int ph_rules_stats(PH_Stats *stats, int max_count);
+
+#endif
@@ -0,0 +1,262 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "pool.h"
+
+#define PL_CHUNK_SIZE   16384
+#define PL_CACHE_SIZE   32
+
+typedef struct PL_Chunk PL_Chunk;
+typedef struct PL_Free_object PL_Free_object;
+
+struct PL_Chunk {
+    PL_Chunk *next;
+    _Alignas(max_align_t) unsigned char objects[];
+};
+
+struct PL_Free_object {
+    PL_Free_object *next;
+};
+
+struct PL_Pool {
+    int id;
+    const char *name;
+    size_t object_size;
+    int objects_per_chunk;
+    pthread_mutex_t lock;
+    PL_Chunk *chunks;
+    PL_Free_object *free_objects;
+    atomic_uint generation;
+    atomic_long chunks_count;
+    atomic_long allocations;
+    atomic_long in_use;
+    atomic_long high_water;
+};
+
+typedef struct {
+    unsigned int generation;
+    int count;
+    void *objects[PL_CACHE_SIZE];
+} PL_Cache;
+
+static PL_Pool *pools[PL_MAX_POOLS];
+static atomic_int pools_count = 0;
+static atomic_bool is_debug_enabled = false;
+
+static _Thread_local PL_Cache caches[PL_MAX_POOLS];
+
+static PL_Cache *pl_cache(PL_Pool *pool);
+static void pl_refill(PL_Pool *pool, PL_Cache *cache);
+static void pl_drain(PL_Pool *pool, PL_Cache *cache);
+static void pl_add_chunk(PL_Pool *pool);
+static void pl_track(PL_Pool *pool, long delta);
+
+PL_Pool *pl_make_pool(const char *name, size_t object_size)
+{
+    int id = atomic_fetch_add(&pools_count, 1);
+
+    if (id >= PL_MAX_POOLS) {
+        atomic_fetch_sub(&pools_count, 1);
+        return NULL;
+    }
+
+    size_t align = _Alignof(max_align_t);
+    if (object_size < sizeof(PL_Free_object)) {
+        object_size = sizeof(PL_Free_object);
+    }
+    object_size = (object_size + align - 1) / align * align;
+
+    PL_Pool *pool = malloc(sizeof(PL_Pool));
+    pool->id = id;
+    pool->name = name;
+    pool->object_size = object_size;
+    pool->objects_per_chunk = PL_CHUNK_SIZE / object_size;
+    if (pool->objects_per_chunk < PL_CACHE_SIZE) {
+        pool->objects_per_chunk = PL_CACHE_SIZE;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->chunks = NULL;
+    pool->free_objects = NULL;
+    atomic_init(&pool->generation, 1);
+    atomic_init(&pool->chunks_count, 0);
+    atomic_init(&pool->allocations, 0);
+    atomic_init(&pool->in_use, 0);
+    atomic_init(&pool->high_water, 0);
+
+    pools[id] = pool;
+
+    return pool;
+}
+
+void *pl_alloc(PL_Pool *pool)
+{
+    PL_Cache *cache = pl_cache(pool);
+
+    if (cache->count == 0) {
+        pl_refill(pool, cache);
+    }
+
+    if (atomic_load_explicit(&is_debug_enabled, memory_order_relaxed)) {
+        pl_track(pool, 1);
+    }
+
+    cache->count--;
+    return cache->objects[cache->count];
+}
+
+void pl_free(PL_Pool *pool, void *object)
+{
+    PL_Cache *cache = pl_cache(pool);
+
+    if (cache->count == PL_CACHE_SIZE) {
+        pl_drain(pool, cache);
+    }
+
+    if (atomic_load_explicit(&is_debug_enabled, memory_order_relaxed)) {
+        pl_track(pool, -1);
+    }
+
+    cache->objects[cache->count] = object;
+    cache->count++;
+}
+
+void pl_release(PL_Pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    PL_Chunk *chunk = pool->chunks;
+    while (chunk != NULL) {
+        PL_Chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    pool->chunks = NULL;
+    pool->free_objects = NULL;
+    atomic_store(&pool->chunks_count, 0);
+    atomic_store(&pool->in_use, 0);
+
+    // Thread caches from older generations are dropped lazily.
+    atomic_fetch_add(&pool->generation, 1);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pl_enable_debug()
+{
+    atomic_store(&is_debug_enabled, true);
+}
+
+PL_Stats pl_stats(const PL_Pool *pool)
+{
+    PL_Stats stats;
+    stats.name = pool->name;
+    stats.object_size = pool->object_size;
+    stats.chunks = atomic_load(&pool->chunks_count);
+    stats.allocations = atomic_load(&pool->allocations);
+    stats.in_use = atomic_load(&pool->in_use);
+    stats.high_water = atomic_load(&pool->high_water);
+    return stats;
+}
+
+int pl_pools_stats(PL_Stats *stats, int max_count)
+{
+    int count = atomic_load(&pools_count);
+
+    if (count > max_count) {
+        count = max_count;
+    }
+
+    for (int i = 0; i < count; i++) {
+        stats[i] = pl_stats(pools[i]);
+    }
+
+    return count;
+}
+
+static PL_Cache *pl_cache(PL_Pool *pool)
+{
+    PL_Cache *cache = &caches[pool->id];
+    unsigned int generation = atomic_load_explicit(
+        &pool->generation, 
+        memory_order_acquire
+    );
+
+    if (cache->generation != generation) {
+        cache->generation = generation;
+        cache->count = 0;
+    }
+
+    return cache;
+}
+
+static void pl_refill(PL_Pool *pool, PL_Cache *cache)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    while (cache->count < PL_CACHE_SIZE / 2) {
+        if (pool->free_objects == NULL) {
+            pl_add_chunk(pool);
+        }
+
+        PL_Free_object *object = pool->free_objects;
+        pool->free_objects = object->next;
+        cache->objects[cache->count] = object;
+        cache->count++;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void pl_drain(PL_Pool *pool, PL_Cache *cache)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    while (cache->count > PL_CACHE_SIZE / 2) {
+        cache->count--;
+        PL_Free_object *object = cache->objects[cache->count];
+        object->next = pool->free_objects;
+        pool->free_objects = object;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void pl_add_chunk(PL_Pool *pool)
+{
+    PL_Chunk *chunk = malloc(
+        sizeof(PL_Chunk) + pool->object_size * pool->objects_per_chunk
+    );
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+
+    for (int i = pool->objects_per_chunk - 1; i >= 0; i--) {
+        PL_Free_object *object = (PL_Free_object *)(
+            chunk->objects + pool->object_size * i
+        );
+        object->next = pool->free_objects;
+        pool->free_objects = object;
+    }
+
+    atomic_fetch_add(&pool->chunks_count, 1);
+}
+
+static void pl_track(PL_Pool *pool, long delta)
+{
+    if (delta > 0) {
+        atomic_fetch_add_explicit(&pool->allocations, 1, memory_order_relaxed);
+    }
+
+    long in_use = atomic_fetch_add_explicit(
+        &pool->in_use, 
+        delta, 
+        memory_order_relaxed
+    ) + delta;
+    long high_water = atomic_load_explicit(&pool->high_water, memory_order_relaxed);
+
+    while (in_use > high_water) {
+        if (atomic_compare_exchange_weak(&pool->high_water, &high_water, in_use)) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef PL_POOL
+#define PL_POOL
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PL_MAX_POOLS 32
+
+// Fixed-size object pools. Each pool hands out objects of a
+// single size from chunks it owns, recycling them through a free
+// list. Every thread keeps a small cache per pool, so the pool's
+// lock is only taken to refill or drain those caches.
+typedef struct PL_Pool PL_Pool;
+
+typedef struct {
+    const char *name;
+    size_t object_size;
+    long chunks;
+    long allocations;
+    long in_use;
+    long high_water;
+} PL_Stats;
+
+#define pl_make_typed_pool(type) pl_make_pool(#type, sizeof(type))
+
+PL_Pool *pl_make_pool(const char *name, size_t object_size);
+void *pl_alloc(PL_Pool *pool);
+void pl_free(PL_Pool *pool, void *object);
+
+// Bulk release: every chunk goes back to the system at once,
+// invalidating all objects handed out by the pool. It must not
+// race with allocations from other threads.
+void pl_release(PL_Pool *pool);
+
+// Debug mode tracks objects in use and their high-water mark
+// for every pool.
+void pl_enable_debug();
+PL_Stats pl_stats(const PL_Pool *pool);
+int pl_pools_stats(PL_Stats *stats, int max_count);
+
+#endif
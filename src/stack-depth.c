@@ -0,0 +1,267 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stack-depth.h"
+#include "cfg.h"
+#include "hash-table.h"
+
+typedef enum {
+    SD_UNVISITED,
+    SD_VISITING,
+    SD_VISITED
+} SD_State;
+
+// depth is the operand stack right before the call, its arguments
+// included.
+typedef struct {
+    char *callee;
+    int depth;
+} SD_Call;
+
+typedef struct {
+    SD_Function_stats stats;
+    SD_Call *calls;
+    int calls_count;
+    int calls_capacity;
+    SD_State state;
+} SD_Function;
+
+static SD_Function *functions;
+static int functions_count;
+static int functions_capacity;
+static SD_Function_stats *sorted_functions;
+
+static int walk(const VM_Class *class, const VM_Function *function, SD_Function *record);
+static int stack_effect(VM_Instruction instruction);
+static void add_call(SD_Function *record, const char *callee, int depth);
+static SD_Function *add_function(const char *name, int locals_count);
+static int chain_depth(HT_Table *table, SD_Function *function);
+static int compare_chains(const void *a, const void *b);
+static void free_table(HT_Table *table);
+
+int sd_max_depth(const VM_Function *function)
+{
+    return walk(NULL, function, NULL);
+}
+
+void sd_analyze(const VM_Class *class)
+{
+    for (int i = 0; i < class->functions_count; i++) {
+        const VM_Function *function = &class->functions[i];
+        SD_Function *record = add_function(
+            class->symbols[function->symbol],
+            function->locals_count
+        );
+
+        record->stats.max_depth = walk(class, function, record);
+    }
+}
+
+// Later definitions of a name are never called, as with the tree
+// shaker, so they're left out of the chains and of the functions.
+SD_Stats sd_stats()
+{
+    SD_Stats stats = { NULL, 0, NULL };
+    HT_Table table = ht_make_empty_table();
+
+    for (int i = 0; i < functions_count; i++) {
+        functions[i].state = SD_UNVISITED;
+        functions[i].stats.is_recursive = false;
+        functions[i].stats.calls_unknown = false;
+
+        if (ht_value(functions[i].stats.name, &table) == NULL) {
+            ht_store(functions[i].stats.name, &functions[i], &table);
+        }
+    }
+
+    free(sorted_functions);
+    sorted_functions = malloc(sizeof(SD_Function_stats) * (functions_count + 1));
+
+    for (int i = 0; i < functions_count; i++) {
+        if (ht_value(functions[i].stats.name, &table) != &functions[i]) {
+            continue;
+        }
+
+        chain_depth(&table, &functions[i]);
+        sorted_functions[stats.functions_count++] = functions[i].stats;
+    }
+
+    qsort(sorted_functions, stats.functions_count, sizeof(SD_Function_stats), compare_chains);
+    stats.functions = sorted_functions;
+
+    for (int i = 0; i < stats.functions_count && stats.entry == NULL; i++) {
+        if (strcmp(sorted_functions[i].name, SD_BOOTSTRAP) == 0) {
+            stats.entry = &sorted_functions[i];
+        }
+    }
+    for (int i = 0; i < stats.functions_count && stats.entry == NULL; i++) {
+        if (strcmp(sorted_functions[i].name, SD_ENTRY_POINT) == 0) {
+            stats.entry = &sorted_functions[i];
+        }
+    }
+
+    free_table(&table);
+
+    return stats;
+}
+
+// The code generator leaves the stack as deep at a label whichever
+// way it's reached, so the first path to a block sets its depth.
+static int walk(const VM_Class *class, const VM_Function *function, SD_Function *record)
+{
+    if (function->count == 0) {
+        return 0;
+    }
+
+    CFG_Graph *graph = cfg_build(function);
+    int *entry_depths = malloc(sizeof(int) * graph->blocks_count);
+    int *worklist = malloc(sizeof(int) * graph->blocks_count);
+    int worklist_count = 0;
+    int max_depth = 0;
+
+    for (int i = 0; i < graph->blocks_count; i++) {
+        entry_depths[i] = -1;
+    }
+
+    entry_depths[0] = 0;
+    worklist[worklist_count++] = 0;
+
+    while (worklist_count > 0) {
+        int index = worklist[--worklist_count];
+        CFG_Block *block = &graph->blocks[index];
+        int depth = entry_depths[index];
+
+        for (int i = block->start; i < block->end; i++) {
+            VM_Instruction instruction = function->instructions[i];
+
+            if (instruction.opcode == VM_CALL && record != NULL) {
+                add_call(record, class->symbols[instruction.symbol], depth);
+            }
+
+            depth += stack_effect(instruction);
+
+            if (depth > max_depth) {
+                max_depth = depth;
+            }
+        }
+
+        for (int i = 0; i < block->successors_count; i++) {
+            int successor = block->successors[i];
+
+            if (entry_depths[successor] < 0) {
+                entry_depths[successor] = depth;
+                worklist[worklist_count++] = successor;
+            }
+        }
+    }
+
+    free(entry_depths);
+    free(worklist);
+    cfg_free(graph);
+
+    return max_depth;
+}
+
+static int stack_effect(VM_Instruction instruction)
+{
+    VM_Opcode opcode = instruction.opcode;
+
+    if (opcode == VM_PUSH) {
+        return 1;
+
+    } else if (opcode == VM_CALL) {
+        return 1 - instruction.operand;
+
+    } else if (opcode == VM_NEG || opcode == VM_NOT || opcode == VM_LABEL ||
+               opcode == VM_GOTO || opcode == VM_RETURN) {
+        return 0;
+    }
+
+    // Pop, if-goto and the binary operations.
+    return -1;
+}
+
+static void add_call(SD_Function *record, const char *callee, int depth)
+{
+    if (record->calls_count == record->calls_capacity) {
+        record->calls_capacity = record->calls_capacity == 0 ? 8 : record->calls_capacity * 2;
+        record->calls = realloc(record->calls, sizeof(SD_Call) * record->calls_capacity);
+    }
+
+    record->calls[record->calls_count++] = (SD_Call){ strdup(callee), depth };
+}
+
+// Names are copied, as the classes are freed once written out.
+static SD_Function *add_function(const char *name, int locals_count)
+{
+    if (functions_count == functions_capacity) {
+        functions_capacity = functions_capacity == 0 ? 32 : functions_capacity * 2;
+        functions = realloc(functions, sizeof(SD_Function) * functions_capacity);
+    }
+
+    SD_Function *function = &functions[functions_count++];
+    *function = (SD_Function){ 0 };
+    function->stats.name = strdup(name);
+    function->stats.locals_count = locals_count;
+
+    return function;
+}
+
+// Depth first over the call graph. A call back into a function still
+// being visited closes a cycle and adds nothing but its arguments.
+static int chain_depth(HT_Table *table, SD_Function *function)
+{
+    if (function->state != SD_UNVISITED) {
+        return function->stats.chain_depth;
+    }
+
+    function->state = SD_VISITING;
+    int deepest = function->stats.max_depth;
+
+    for (int i = 0; i < function->calls_count; i++) {
+        SD_Call call = function->calls[i];
+        SD_Function *callee = ht_value(call.callee, table);
+        int depth = call.depth;
+
+        if (callee == NULL) {
+            function->stats.calls_unknown = true;
+            depth += SD_FRAME_SIZE;
+
+        } else if (callee->state == SD_VISITING) {
+            function->stats.is_recursive = true;
+
+        } else {
+            depth += chain_depth(table, callee);
+            function->stats.is_recursive |= callee->stats.is_recursive;
+            function->stats.calls_unknown |= callee->stats.calls_unknown;
+        }
+
+        if (depth > deepest) {
+            deepest = depth;
+        }
+    }
+
+    function->stats.chain_depth = SD_FRAME_SIZE + function->stats.locals_count + deepest;
+    function->state = SD_VISITED;
+
+    return function->stats.chain_depth;
+}
+
+static int compare_chains(const void *a, const void *b)
+{
+    const SD_Function_stats *left = a;
+    const SD_Function_stats *right = b;
+
+    if (left->chain_depth != right->chain_depth) {
+        return right->chain_depth - left->chain_depth;
+    }
+
+    return strcmp(left->name, right->name);
+}
+
+static void free_table(HT_Table *table)
+{
+    for (int i = 0; i < HT_MAX_COUNT; i++) {
+        ll_free(&table->values[i]);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SD_STACK_DEPTH
+#define SD_STACK_DEPTH
+
+#include <stdbool.h>
+#include "vm-ir.h"
+
+// Words a call pushes besides the arguments: the return address
+// and the caller's LCL, ARG, THIS and THAT.
+#define SD_FRAME_SIZE   5
+
+#define SD_ENTRY_POINT  "Main.main"
+#define SD_BOOTSTRAP    "Sys.init"
+
+// max_depth is the most the operand stack grows above the locals.
+// chain_depth is the worst case a call to the function takes from
+// the stack, its arguments aside: the frame, the locals and either
+// the operands or the deepest call it makes. Recursive calls are
+// counted once and functions that weren't analyzed, such as the OS
+// when it isn't linked in, as bare frames, so the chains of functions
+// reaching either, as flagged, are lower bounds.
+typedef struct {
+    char *name;
+    int locals_count;
+    int max_depth;
+    int chain_depth;
+    bool is_recursive;
+    bool calls_unknown;
+} SD_Function_stats;
+
+// Functions sorted by chain depth. entry is the function the program
+// starts from, the bootstrap when it was analyzed, NULL when neither
+// it nor the entry point was.
+typedef struct {
+    SD_Function_stats *functions;
+    int functions_count;
+    SD_Function_stats *entry;
+} SD_Stats;
+
+// Operand stack depth analysis: the depth reached by every
+// instruction is propagated over the function's control flow.
+int sd_max_depth(const VM_Function *function);
+
+// Records the stack use of the class' functions and the depth at
+// each of their calls, for the call chains of sd_stats, which leaves
+// out functions recorded again under the same name.
+void sd_analyze(const VM_Class *class);
+
+SD_Stats sd_stats();
+
+#endif
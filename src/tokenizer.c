@@ -154,6 +154,9 @@ Tokenizer_atom tokenizer_peek()
     // TODO: Unit test tokenizer peeking.
     int token_len = 0;
     int ch;
+    // The position is restored, or peeked newlines would count twice.
+    int peek_line = line;
+    int peek_column = column;
     Tokenizer_atom atom = tokenizer_next();
 
     if (atom.value != NULL) {
@@ -165,6 +168,8 @@ Tokenizer_atom tokenizer_peek()
         }
     }
     seek_back(token_len);
+    line = peek_line;
+    column = peek_column;
 
     return atom;
 }
@@ -302,9 +307,15 @@ static bool tokenize_comment(Tokenizer_atom *atom)
     comment_len = 2; // / + (/ or *)
 
     while ((ch = get_char()) != EOF) {
-        column++;
         comment_len += 1;
 
+        if (ch == '\n') {
+            newlines++;
+            column = 0;
+        } else {
+            column++;
+        }
+
         if (is_line_comment && ch == '\n') {
             break;
         }
@@ -312,14 +323,8 @@ static bool tokenize_comment(Tokenizer_atom *atom)
         if (!is_line_comment && (ch == '*' && peek() == '/')) {
             ch = get_char(); // Move cursor.
             comment_len += 1;
-            break;
-        }
-
-        if (is_line_comment && ch == '\n') {
-            newlines++;
-            column = 0;
-        } else {
             column++;
+            break;
         }
     }
 
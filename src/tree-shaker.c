@@ -0,0 +1,157 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "tree-shaker.h"
+#include "hash-table.h"
+
+// Location of a function within the project's classes.
+typedef struct {
+    int class_index;
+    int function_index;
+} TS_Function;
+
+static VM_Class **classes;
+static int classes_count;
+static TS_Stats stats;
+
+static void index_functions(HT_Table *table, TS_Function *functions, bool **is_reachable);
+static void mark_reachable(HT_Table *table, bool **is_reachable, const char *root);
+static void remove_unreachable(VM_Class *class, bool *is_reachable);
+static void free_table(HT_Table *table);
+
+void ts_shake(VM_Class **program, int count)
+{
+    classes = program;
+    classes_count = count;
+
+    for (int i = 0; i < classes_count; i++) {
+        stats.functions += classes[i]->functions_count;
+    }
+
+    HT_Table table = ht_make_empty_table();
+    TS_Function *functions = malloc(sizeof(TS_Function) * (stats.functions + 1));
+    bool **is_reachable = malloc(sizeof(bool *) * (classes_count + 1));
+
+    index_functions(&table, functions, is_reachable);
+
+    if (ht_value(TS_ENTRY_POINT, &table) != NULL) {
+        mark_reachable(&table, is_reachable, TS_ENTRY_POINT);
+        mark_reachable(&table, is_reachable, TS_BOOTSTRAP);
+    } else {
+        // Without an entry point anything could be called, so
+        // every function is kept.
+        printf("%s not found, no subroutines were removed\n", TS_ENTRY_POINT);
+
+        for (int i = 0; i < classes_count; i++) {
+            for (int j = 0; j < classes[i]->functions_count; j++) {
+                is_reachable[i][j] = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < classes_count; i++) {
+        remove_unreachable(classes[i], is_reachable[i]);
+        free(is_reachable[i]);
+    }
+
+    free_table(&table);
+    free(functions);
+    free(is_reachable);
+
+    classes = NULL;
+    classes_count = 0;
+}
+
+TS_Stats ts_stats()
+{
+    return stats;
+}
+
+// Maps each "Class.name" to the function defining it. The keys are
+// the classes' own interned symbols, which outlive the table.
+static void index_functions(HT_Table *table, TS_Function *functions, bool **is_reachable)
+{
+    int count = 0;
+
+    for (int i = 0; i < classes_count; i++) {
+        VM_Class *class = classes[i];
+        is_reachable[i] = calloc(class->functions_count + 1, sizeof(bool));
+
+        for (int j = 0; j < class->functions_count; j++) {
+            char *symbol = class->symbols[class->functions[j].symbol];
+
+            // Later definitions of a symbol are never called.
+            if (ht_value(symbol, table) != NULL) {
+                continue;
+            }
+
+            functions[count] = (TS_Function){ i, j };
+            ht_store(symbol, &functions[count], table);
+            count++;
+        }
+    }
+}
+
+// Depth first walk of the call graph. Calls to symbols not defined in
+// the project go to the OS and are ignored.
+static void mark_reachable(HT_Table *table, bool **is_reachable, const char *root)
+{
+    TS_Function *entry = ht_value(root, table);
+
+    if (entry == NULL || is_reachable[entry->class_index][entry->function_index]) {
+        return;
+    }
+
+    TS_Function **stack = malloc(sizeof(TS_Function *) * (stats.functions + 1));
+    int stack_count = 0;
+
+    is_reachable[entry->class_index][entry->function_index] = true;
+    stack[stack_count++] = entry;
+
+    while (stack_count > 0) {
+        TS_Function *caller = stack[--stack_count];
+        VM_Class *class = classes[caller->class_index];
+        VM_Function *function = &class->functions[caller->function_index];
+
+        for (int i = 0; i < function->count; i++) {
+            if (function->instructions[i].opcode != VM_CALL) {
+                continue;
+            }
+
+            char *symbol = class->symbols[function->instructions[i].symbol];
+            TS_Function *callee = ht_value(symbol, table);
+
+            if (callee != NULL &&
+                !is_reachable[callee->class_index][callee->function_index]) {
+                is_reachable[callee->class_index][callee->function_index] = true;
+                stack[stack_count++] = callee;
+            }
+        }
+    }
+
+    free(stack);
+}
+
+static void remove_unreachable(VM_Class *class, bool *is_reachable)
+{
+    int count = 0;
+
+    for (int i = 0; i < class->functions_count; i++) {
+        if (is_reachable[i]) {
+            class->functions[count++] = class->functions[i];
+            continue;
+        }
+
+        stats.removed_functions++;
+        stats.removed_instructions += class->functions[i].count;
+        free(class->functions[i].instructions);
+    }
+
+    class->functions_count = count;
+}
+
+static void free_table(HT_Table *table)
+{
+    for (int i = 0; i < HT_MAX_COUNT; i++) {
+        ll_free(&table->values[i]);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef TS_TREE_SHAKER
+#define TS_TREE_SHAKER
+
+#include "vm-ir.h"
+
+#define TS_ENTRY_POINT  "Main.main"
+#define TS_BOOTSTRAP    "Sys.init"
+
+typedef struct {
+    int functions;
+    int removed_functions;
+    long removed_instructions;
+} TS_Stats;
+
+// Tree shaker: the call graph of the whole program is walked from
+// the entry point, and from the bootstrap when the OS is linked in,
+// and every function it doesn't reach is removed from its class.
+void ts_shake(VM_Class **classes, int count);
+
+TS_Stats ts_stats();
+
+#endif
@@ -0,0 +1,1010 @@
+#include <stdlib.h>
+#include <string.h>
+#include "vm-interpreter.h"
+
+#define VI_RAM_SIZE         32768
+#define VI_ADDRESS_MASK     (VI_RAM_SIZE - 1)
+#define VI_SP               0
+#define VI_LCL              1
+#define VI_ARG              2
+#define VI_THIS             3
+#define VI_THAT             4
+#define VI_POINTER_BASE     3
+#define VI_TEMP_BASE        5
+#define VI_STATIC_BASE      16
+#define VI_STACK_BASE       256
+#define VI_HEAP_BASE        2048
+#define VI_HEAP_END         16384
+#define VI_FRAME_SIZE       5
+#define VI_MAX_FRAMES       4096
+#define VI_STRING_HEADER    2
+#define VI_NEW_LINE         128
+#define VI_BACKSPACE        129
+#define VI_DOUBLE_QUOTE     34
+
+#define RAM(address)        ram[(address) & VI_ADDRESS_MASK]
+
+// Decoded operations. Segments are resolved into the opcode, labels
+// are dropped and jumps and calls hold the index of their target.
+typedef enum {
+    VI_PUSH_CONSTANT,
+    VI_PUSH_LOCAL,
+    VI_PUSH_ARGUMENT,
+    VI_PUSH_THIS,
+    VI_PUSH_THAT,
+    VI_PUSH_FIXED,
+    VI_POP_LOCAL,
+    VI_POP_ARGUMENT,
+    VI_POP_THIS,
+    VI_POP_THAT,
+    VI_POP_FIXED,
+    VI_ADD,
+    VI_SUB,
+    VI_NEG,
+    VI_EQ,
+    VI_GT,
+    VI_LT,
+    VI_AND,
+    VI_OR,
+    VI_NOT,
+    VI_GOTO,
+    VI_IF_GOTO,
+    VI_CALL,
+    VI_CALL_OS,
+    VI_CALL_UNDEFINED,
+    VI_RETURN,
+    VI_ENTER
+} VI_Opcode;
+
+// handler is the opcode's label in execute, which each operation
+// jumps to directly. Calls keep the arguments count in operand and
+// the callee, OS routine or symbol in target.
+typedef struct {
+    VI_Opcode opcode;
+    const void *handler;
+    int operand;
+    int target;
+} VI_Op;
+
+typedef struct {
+    int return_pc;
+    int function;
+} VI_Frame;
+
+typedef short (*VI_Routine)(int args);
+
+typedef struct {
+    const char *name;
+    VI_Routine routine;
+} VI_Os_function;
+
+static const VM_Class *class;
+static VI_Op *ops;
+static int ops_count;
+static int *entries;
+static long *calls;
+static long *os_calls;
+static long *executed;
+static VI_Frame frames[VI_MAX_FRAMES];
+static short ram[VI_RAM_SIZE];
+static int heap_top;
+static FILE *output_file;
+static const char *failure;
+static bool is_halted;
+static VI_Stats stats;
+
+static short os_noop(int args);
+static short math_multiply(int args);
+static short math_divide(int args);
+static short math_abs(int args);
+static short math_min(int args);
+static short math_max(int args);
+static short math_sqrt(int args);
+static short memory_peek(int args);
+static short memory_poke(int args);
+static short memory_alloc(int args);
+static short array_new(int args);
+static short string_new(int args);
+static short string_length(int args);
+static short string_char_at(int args);
+static short string_set_char_at(int args);
+static short string_append_char(int args);
+static short string_erase_last_char(int args);
+static short string_int_value(int args);
+static short string_set_int(int args);
+static short string_back_space(int args);
+static short string_double_quote(int args);
+static short string_new_line(int args);
+static short output_print_char(int args);
+static short output_print_string(int args);
+static short output_print_int(int args);
+static short output_println(int args);
+static short sys_halt(int args);
+static short sys_error(int args);
+
+static const VI_Os_function os_functions[] = {
+    { "Math.init", os_noop },
+    { "Math.multiply", math_multiply },
+    { "Math.divide", math_divide },
+    { "Math.abs", math_abs },
+    { "Math.min", math_min },
+    { "Math.max", math_max },
+    { "Math.sqrt", math_sqrt },
+    { "Memory.init", os_noop },
+    { "Memory.peek", memory_peek },
+    { "Memory.poke", memory_poke },
+    { "Memory.alloc", memory_alloc },
+    { "Memory.deAlloc", os_noop },
+    { "Array.new", array_new },
+    { "Array.dispose", os_noop },
+    { "String.new", string_new },
+    { "String.dispose", os_noop },
+    { "String.length", string_length },
+    { "String.charAt", string_char_at },
+    { "String.setCharAt", string_set_char_at },
+    { "String.appendChar", string_append_char },
+    { "String.eraseLastChar", string_erase_last_char },
+    { "String.intValue", string_int_value },
+    { "String.setInt", string_set_int },
+    { "String.backSpace", string_back_space },
+    { "String.doubleQuote", string_double_quote },
+    { "String.newLine", string_new_line },
+    { "Output.init", os_noop },
+    { "Output.moveCursor", os_noop },
+    { "Output.printChar", output_print_char },
+    { "Output.printString", output_print_string },
+    { "Output.printInt", output_print_int },
+    { "Output.println", output_println },
+    { "Output.backSpace", os_noop },
+    { "Screen.init", os_noop },
+    { "Screen.clearScreen", os_noop },
+    { "Screen.setColor", os_noop },
+    { "Screen.drawPixel", os_noop },
+    { "Screen.drawLine", os_noop },
+    { "Screen.drawRectangle", os_noop },
+    { "Screen.drawCircle", os_noop },
+    { "Keyboard.init", os_noop },
+    { "Keyboard.keyPressed", os_noop },
+    { "Keyboard.readChar", os_noop },
+    { "Keyboard.readLine", os_noop },
+    { "Keyboard.readInt", os_noop },
+    { "Sys.halt", sys_halt },
+    { "Sys.error", sys_error },
+    { "Sys.wait", os_noop }
+};
+
+#define VI_OS_FUNCTIONS_COUNT (int)(sizeof(os_functions) / sizeof(VI_Os_function))
+
+static void decode(int *symbol_functions);
+static VI_Op decode_instruction(VM_Instruction instruction, const int *labels, const int *symbol_functions);
+static int find_os_function(const char *symbol);
+static int entry_function(const int *symbol_functions);
+static bool execute(int entry, long max_steps);
+static void collect_stats();
+static int compare_function_stats(const void *a, const void *b);
+static short allocate(int size);
+static void fail(const char *message);
+static void free_program();
+
+bool vi_run(const VM_Class *program, FILE *output, long max_steps)
+{
+    class = program;
+    output_file = output;
+    failure = NULL;
+    is_halted = false;
+    heap_top = VI_HEAP_BASE;
+    memset(ram, 0, sizeof(ram));
+
+    int *symbol_functions = malloc(sizeof(int) * (class->symbols_count + 1));
+    decode(symbol_functions);
+
+    int entry = entry_function(symbol_functions);
+    free(symbol_functions);
+
+    if (entry < 0) {
+        printf("Main.main not found, nothing to run\n");
+        free_program();
+        return false;
+    }
+
+    bool has_finished = execute(entry, max_steps);
+    fflush(output_file);
+
+    collect_stats();
+    free_program();
+
+    return has_finished;
+}
+
+VI_Stats vi_stats()
+{
+    return stats;
+}
+
+// Lays the functions out one after the other, each starting with an
+// enter operation that allocates its locals. Labels take the index of
+// the operation following them.
+static void decode(int *symbol_functions)
+{
+    int *labels = malloc(sizeof(int) * (class->labels_count + 1));
+    int count = 0;
+
+    entries = malloc(sizeof(int) * (class->functions_count + 1));
+
+    for (int i = 0; i < class->symbols_count; i++) {
+        symbol_functions[i] = -1;
+    }
+
+    for (int i = 0; i < class->functions_count; i++) {
+        VM_Function *function = &class->functions[i];
+
+        // Only the first definition of a symbol is ever called.
+        if (symbol_functions[function->symbol] < 0) {
+            symbol_functions[function->symbol] = i;
+        }
+
+        entries[i] = count++;
+
+        for (int j = 0; j < function->count; j++) {
+            if (function->instructions[j].opcode == VM_LABEL) {
+                labels[function->instructions[j].operand] = count;
+            } else {
+                count++;
+            }
+        }
+    }
+
+    entries[class->functions_count] = count;
+    ops = malloc(sizeof(VI_Op) * (count + 1));
+    ops_count = 0;
+
+    for (int i = 0; i < class->functions_count; i++) {
+        VM_Function *function = &class->functions[i];
+
+        ops[ops_count++] = (VI_Op){ VI_ENTER, NULL, function->locals_count, i };
+
+        for (int j = 0; j < function->count; j++) {
+            if (function->instructions[j].opcode != VM_LABEL) {
+                ops[ops_count++] = decode_instruction(
+                    function->instructions[j],
+                    labels,
+                    symbol_functions
+                );
+            }
+        }
+    }
+
+    calls = calloc(class->functions_count + 1, sizeof(long));
+    os_calls = calloc(VI_OS_FUNCTIONS_COUNT, sizeof(long));
+    executed = calloc(ops_count + 1, sizeof(long));
+
+    free(labels);
+}
+
+static VI_Op decode_instruction(VM_Instruction instruction, const int *labels, const int *symbol_functions)
+{
+    VM_Opcode opcode = instruction.opcode;
+    VI_Op op = { VI_RETURN, NULL, instruction.operand, 0 };
+
+    if (opcode == VM_PUSH || opcode == VM_POP) {
+        bool is_push = opcode == VM_PUSH;
+        VM_Segment segment = instruction.segment;
+
+        if (segment == VM_SEGMENT_CONSTANT) {
+            op.opcode = VI_PUSH_CONSTANT;
+        } else if (segment == VM_SEGMENT_LOCAL) {
+            op.opcode = is_push ? VI_PUSH_LOCAL : VI_POP_LOCAL;
+        } else if (segment == VM_SEGMENT_ARGUMENT) {
+            op.opcode = is_push ? VI_PUSH_ARGUMENT : VI_POP_ARGUMENT;
+        } else if (segment == VM_SEGMENT_THIS) {
+            op.opcode = is_push ? VI_PUSH_THIS : VI_POP_THIS;
+        } else if (segment == VM_SEGMENT_THAT) {
+            op.opcode = is_push ? VI_PUSH_THAT : VI_POP_THAT;
+        } else {
+            // Fixed segments are addressed directly.
+            op.opcode = is_push ? VI_PUSH_FIXED : VI_POP_FIXED;
+
+            if (segment == VM_SEGMENT_STATIC) {
+                op.operand += VI_STATIC_BASE;
+            } else if (segment == VM_SEGMENT_TEMP) {
+                op.operand += VI_TEMP_BASE;
+            } else {
+                op.operand += VI_POINTER_BASE;
+            }
+        }
+
+    } else if (opcode == VM_GOTO || opcode == VM_IF_GOTO) {
+        op.opcode = opcode == VM_GOTO ? VI_GOTO : VI_IF_GOTO;
+        op.target = labels[instruction.operand];
+
+    } else if (opcode == VM_CALL) {
+        int function = symbol_functions[instruction.symbol];
+        int os_function = find_os_function(class->symbols[instruction.symbol]);
+
+        if (function >= 0) {
+            op.opcode = VI_CALL;
+            op.target = function;
+        } else if (os_function >= 0) {
+            op.opcode = VI_CALL_OS;
+            op.target = os_function;
+        } else {
+            op.opcode = VI_CALL_UNDEFINED;
+            op.target = instruction.symbol;
+        }
+
+    } else if (opcode == VM_ADD) {
+        op.opcode = VI_ADD;
+    } else if (opcode == VM_SUB) {
+        op.opcode = VI_SUB;
+    } else if (opcode == VM_NEG) {
+        op.opcode = VI_NEG;
+    } else if (opcode == VM_EQ) {
+        op.opcode = VI_EQ;
+    } else if (opcode == VM_GT) {
+        op.opcode = VI_GT;
+    } else if (opcode == VM_LT) {
+        op.opcode = VI_LT;
+    } else if (opcode == VM_AND) {
+        op.opcode = VI_AND;
+    } else if (opcode == VM_OR) {
+        op.opcode = VI_OR;
+    } else if (opcode == VM_NOT) {
+        op.opcode = VI_NOT;
+    }
+
+    return op;
+}
+
+static int find_os_function(const char *symbol)
+{
+    for (int i = 0; i < VI_OS_FUNCTIONS_COUNT; i++) {
+        if (strcmp(os_functions[i].name, symbol) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int entry_function(const int *symbol_functions)
+{
+    int entry = -1;
+
+    for (int i = 0; i < class->symbols_count; i++) {
+        if (symbol_functions[i] < 0) {
+            continue;
+        }
+
+        if (strcmp(class->symbols[i], "Sys.init") == 0) {
+            return symbol_functions[i];
+        } else if (strcmp(class->symbols[i], "Main.main") == 0) {
+            entry = symbol_functions[i];
+        }
+    }
+
+    return entry;
+}
+
+// Direct threaded: every operation jumps straight to the handler of
+// the next one, with the stack pointer held in a local. Frames are
+// laid out in RAM as the VM specifies, while return addresses are
+// kept aside with the function they return to.
+static bool execute(int entry, long max_steps)
+{
+    static const void *handlers[] = {
+        [VI_PUSH_CONSTANT] = &&push_constant,
+        [VI_PUSH_LOCAL] = &&push_local,
+        [VI_PUSH_ARGUMENT] = &&push_argument,
+        [VI_PUSH_THIS] = &&push_this,
+        [VI_PUSH_THAT] = &&push_that,
+        [VI_PUSH_FIXED] = &&push_fixed,
+        [VI_POP_LOCAL] = &&pop_local,
+        [VI_POP_ARGUMENT] = &&pop_argument,
+        [VI_POP_THIS] = &&pop_this,
+        [VI_POP_THAT] = &&pop_that,
+        [VI_POP_FIXED] = &&pop_fixed,
+        [VI_ADD] = &&add,
+        [VI_SUB] = &&sub,
+        [VI_NEG] = &&neg,
+        [VI_EQ] = &&eq,
+        [VI_GT] = &&gt,
+        [VI_LT] = &&lt,
+        [VI_AND] = &&and,
+        [VI_OR] = &&or,
+        [VI_NOT] = &&not,
+        [VI_GOTO] = &&jump,
+        [VI_IF_GOTO] = &&if_jump,
+        [VI_CALL] = &&call,
+        [VI_CALL_OS] = &&call_os,
+        [VI_CALL_UNDEFINED] = &&call_undefined,
+        [VI_RETURN] = &&return_,
+        [VI_ENTER] = &&enter
+    };
+
+    for (int i = 0; i < ops_count; i++) {
+        ops[i].handler = handlers[ops[i].opcode];
+    }
+
+    int frames_count = 0;
+    int function = entry;
+    int pc = entries[entry];
+    int sp = VI_STACK_BASE + VI_FRAME_SIZE;
+    long steps = 0;
+    VI_Op *op;
+
+    // The entry point is called with no arguments and no caller.
+    ram[VI_ARG] = VI_STACK_BASE;
+    ram[VI_LCL] = sp;
+    calls[entry]++;
+
+    #define DISPATCH() \
+        op = &ops[pc]; \
+        executed[pc]++; \
+        steps++; \
+        goto *op->handler
+
+    DISPATCH();
+
+push_constant:
+    RAM(sp++) = op->operand;
+    pc++;
+    DISPATCH();
+push_local:
+    RAM(sp++) = RAM(ram[VI_LCL] + op->operand);
+    pc++;
+    DISPATCH();
+push_argument:
+    RAM(sp++) = RAM(ram[VI_ARG] + op->operand);
+    pc++;
+    DISPATCH();
+push_this:
+    RAM(sp++) = RAM(ram[VI_THIS] + op->operand);
+    pc++;
+    DISPATCH();
+push_that:
+    RAM(sp++) = RAM(ram[VI_THAT] + op->operand);
+    pc++;
+    DISPATCH();
+push_fixed:
+    RAM(sp++) = RAM(op->operand);
+    pc++;
+    DISPATCH();
+pop_local:
+    sp--;
+    RAM(ram[VI_LCL] + op->operand) = RAM(sp);
+    pc++;
+    DISPATCH();
+pop_argument:
+    sp--;
+    RAM(ram[VI_ARG] + op->operand) = RAM(sp);
+    pc++;
+    DISPATCH();
+pop_this:
+    sp--;
+    RAM(ram[VI_THIS] + op->operand) = RAM(sp);
+    pc++;
+    DISPATCH();
+pop_that:
+    sp--;
+    RAM(ram[VI_THAT] + op->operand) = RAM(sp);
+    pc++;
+    DISPATCH();
+pop_fixed:
+    sp--;
+    RAM(op->operand) = RAM(sp);
+    pc++;
+    DISPATCH();
+add:
+    sp--;
+    RAM(sp - 1) = (short)(RAM(sp - 1) + RAM(sp));
+    pc++;
+    DISPATCH();
+sub:
+    sp--;
+    RAM(sp - 1) = (short)(RAM(sp - 1) - RAM(sp));
+    pc++;
+    DISPATCH();
+neg:
+    RAM(sp - 1) = (short)-RAM(sp - 1);
+    pc++;
+    DISPATCH();
+eq:
+    sp--;
+    RAM(sp - 1) = RAM(sp - 1) == RAM(sp) ? -1 : 0;
+    pc++;
+    DISPATCH();
+gt:
+    sp--;
+    RAM(sp - 1) = RAM(sp - 1) > RAM(sp) ? -1 : 0;
+    pc++;
+    DISPATCH();
+lt:
+    sp--;
+    RAM(sp - 1) = RAM(sp - 1) < RAM(sp) ? -1 : 0;
+    pc++;
+    DISPATCH();
+and:
+    sp--;
+    RAM(sp - 1) &= RAM(sp);
+    pc++;
+    DISPATCH();
+or:
+    sp--;
+    RAM(sp - 1) |= RAM(sp);
+    pc++;
+    DISPATCH();
+not:
+    RAM(sp - 1) = ~RAM(sp - 1);
+    pc++;
+    DISPATCH();
+jump:
+    // The budget is only checked on jumps and calls, the only ways
+    // for a program not to end.
+    if (steps > max_steps) {
+        fail("step budget exhausted");
+        goto stop;
+    }
+    pc = op->target;
+    DISPATCH();
+if_jump:
+    if (steps > max_steps) {
+        fail("step budget exhausted");
+        goto stop;
+    }
+    sp--;
+    pc = RAM(sp) != 0 ? op->target : pc + 1;
+    DISPATCH();
+call:
+    if (steps > max_steps) {
+        fail("step budget exhausted");
+        goto stop;
+    }
+    if (frames_count == VI_MAX_FRAMES) {
+        fail("too many nested calls");
+        goto stop;
+    }
+    frames[frames_count++] = (VI_Frame){ pc + 1, function };
+    RAM(sp) = 0;
+    RAM(sp + 1) = ram[VI_LCL];
+    RAM(sp + 2) = ram[VI_ARG];
+    RAM(sp + 3) = ram[VI_THIS];
+    RAM(sp + 4) = ram[VI_THAT];
+    sp += VI_FRAME_SIZE;
+    ram[VI_ARG] = sp - VI_FRAME_SIZE - op->operand;
+    ram[VI_LCL] = sp;
+    function = op->target;
+    calls[function]++;
+    pc = entries[function];
+    DISPATCH();
+call_os:
+    ram[VI_SP] = sp;
+    sp -= op->operand;
+    RAM(sp) = os_functions[op->target].routine(sp);
+    sp++;
+    os_calls[op->target]++;
+    if (failure != NULL || is_halted) {
+        goto stop;
+    }
+    pc++;
+    DISPATCH();
+call_undefined:
+    printf("Undefined subroutine %s\n", class->symbols[op->target]);
+    fail("call to an undefined subroutine");
+    goto stop;
+return_:
+    {
+        int frame = ram[VI_LCL];
+        int arg = ram[VI_ARG];
+
+        RAM(arg) = RAM(sp - 1);
+        sp = arg + 1;
+        ram[VI_THAT] = RAM(frame - 1);
+        ram[VI_THIS] = RAM(frame - 2);
+        ram[VI_ARG] = RAM(frame - 3);
+        ram[VI_LCL] = RAM(frame - 4);
+    }
+    if (frames_count == 0) {
+        goto stop;
+    }
+    frames_count--;
+    pc = frames[frames_count].return_pc;
+    function = frames[frames_count].function;
+    DISPATCH();
+enter:
+    if (sp + op->operand >= VI_HEAP_BASE) {
+        fail("stack overflow");
+        goto stop;
+    }
+    for (int i = 0; i < op->operand; i++) {
+        RAM(sp++) = 0;
+    }
+    pc++;
+    DISPATCH();
+
+    #undef DISPATCH
+
+stop:
+    ram[VI_SP] = sp;
+    stats.instructions = steps;
+
+    if (failure != NULL) {
+        printf(
+            "Runtime error in %s: %s\n",
+            class->symbols[class->functions[function].symbol],
+            failure
+        );
+        return false;
+    }
+
+    return true;
+}
+
+static void collect_stats()
+{
+    for (int i = 0; i < stats.functions_count; i++) {
+        free(stats.functions[i].name);
+    }
+    free(stats.functions);
+    stats.functions = malloc(
+        sizeof(VI_Function_stats) * (class->functions_count + VI_OS_FUNCTIONS_COUNT)
+    );
+    stats.functions_count = 0;
+    stats.os_calls = 0;
+
+    for (int i = 0; i < class->functions_count; i++) {
+        long instructions = 0;
+
+        for (int pc = entries[i]; pc < entries[i + 1]; pc++) {
+            instructions += executed[pc];
+        }
+
+        if (calls[i] > 0) {
+            stats.functions[stats.functions_count++] = (VI_Function_stats){
+                strdup(class->symbols[class->functions[i].symbol]),
+                false,
+                calls[i],
+                instructions
+            };
+        }
+    }
+
+    for (int i = 0; i < VI_OS_FUNCTIONS_COUNT; i++) {
+        if (os_calls[i] > 0) {
+            stats.functions[stats.functions_count++] = (VI_Function_stats){
+                strdup(os_functions[i].name),
+                true,
+                os_calls[i],
+                0
+            };
+            stats.os_calls += os_calls[i];
+        }
+    }
+
+    qsort(
+        stats.functions,
+        stats.functions_count,
+        sizeof(VI_Function_stats),
+        compare_function_stats
+    );
+}
+
+static int compare_function_stats(const void *a, const void *b)
+{
+    const VI_Function_stats *first = a;
+    const VI_Function_stats *second = b;
+
+    if (first->instructions != second->instructions) {
+        return first->instructions < second->instructions ? 1 : -1;
+    } else if (first->calls != second->calls) {
+        return first->calls < second->calls ? 1 : -1;
+    }
+
+    return strcmp(first->name, second->name);
+}
+
+// Bump allocator: disposed objects are never reused.
+static short allocate(int size)
+{
+    if (size <= 0) {
+        fail("allocated size must be positive");
+        return 0;
+    } else if (heap_top + size > VI_HEAP_END) {
+        fail("heap overflow");
+        return 0;
+    }
+
+    int base = heap_top;
+    heap_top += size;
+
+    return base;
+}
+
+static void fail(const char *message)
+{
+    if (failure == NULL) {
+        failure = message;
+    }
+}
+
+static void free_program()
+{
+    free(ops);
+    free(entries);
+    free(calls);
+    free(os_calls);
+    free(executed);
+
+    ops = NULL;
+    entries = NULL;
+    calls = NULL;
+    os_calls = NULL;
+    executed = NULL;
+    ops_count = 0;
+}
+
+// The OS stand-ins receive the address of their first argument.
+
+static short os_noop(int args)
+{
+    return 0;
+}
+
+static short math_multiply(int args)
+{
+    return (short)(RAM(args) * RAM(args + 1));
+}
+
+static short math_divide(int args)
+{
+    if (RAM(args + 1) == 0) {
+        fail("division by zero");
+        return 0;
+    }
+
+    return (short)(RAM(args) / RAM(args + 1));
+}
+
+static short math_abs(int args)
+{
+    return (short)(RAM(args) < 0 ? -RAM(args) : RAM(args));
+}
+
+static short math_min(int args)
+{
+    return RAM(args) < RAM(args + 1) ? RAM(args) : RAM(args + 1);
+}
+
+static short math_max(int args)
+{
+    return RAM(args) > RAM(args + 1) ? RAM(args) : RAM(args + 1);
+}
+
+static short math_sqrt(int args)
+{
+    int value = RAM(args);
+    int root = 0;
+
+    if (value < 0) {
+        fail("square root of a negative number");
+        return 0;
+    }
+
+    while ((root + 1) * (root + 1) <= value) {
+        root++;
+    }
+
+    return root;
+}
+
+static short memory_peek(int args)
+{
+    return RAM(RAM(args));
+}
+
+static short memory_poke(int args)
+{
+    RAM(RAM(args)) = RAM(args + 1);
+    return 0;
+}
+
+static short memory_alloc(int args)
+{
+    return allocate(RAM(args));
+}
+
+static short array_new(int args)
+{
+    return allocate(RAM(args));
+}
+
+// Strings keep their capacity and length ahead of the characters.
+static short string_new(int args)
+{
+    int capacity = RAM(args);
+
+    if (capacity < 0) {
+        fail("string capacity must not be negative");
+        return 0;
+    }
+
+    short string = allocate(capacity + VI_STRING_HEADER);
+    RAM(string) = capacity;
+    RAM(string + 1) = 0;
+
+    return string;
+}
+
+static short string_length(int args)
+{
+    return RAM(RAM(args) + 1);
+}
+
+static short string_char_at(int args)
+{
+    short string = RAM(args);
+    short index = RAM(args + 1);
+
+    if (index < 0 || index >= RAM(string + 1)) {
+        fail("string index out of bounds");
+        return 0;
+    }
+
+    return RAM(string + VI_STRING_HEADER + index);
+}
+
+static short string_set_char_at(int args)
+{
+    short string = RAM(args);
+    short index = RAM(args + 1);
+
+    if (index < 0 || index >= RAM(string + 1)) {
+        fail("string index out of bounds");
+        return 0;
+    }
+
+    RAM(string + VI_STRING_HEADER + index) = RAM(args + 2);
+    return 0;
+}
+
+static short string_append_char(int args)
+{
+    short string = RAM(args);
+    short length = RAM(string + 1);
+
+    if (length >= RAM(string)) {
+        fail("string is full");
+        return string;
+    }
+
+    RAM(string + VI_STRING_HEADER + length) = RAM(args + 1);
+    RAM(string + 1) = length + 1;
+
+    return string;
+}
+
+static short string_erase_last_char(int args)
+{
+    short string = RAM(args);
+
+    if (RAM(string + 1) == 0) {
+        fail("string is empty");
+        return 0;
+    }
+
+    RAM(string + 1)--;
+    return 0;
+}
+
+static short string_int_value(int args)
+{
+    short string = RAM(args);
+    short length = RAM(string + 1);
+    int i = 0;
+    bool is_negative = length > 0 && RAM(string + VI_STRING_HEADER) == '-';
+    short value = 0;
+
+    if (is_negative) {
+        i++;
+    }
+
+    for (; i < length; i++) {
+        short c = RAM(string + VI_STRING_HEADER + i);
+
+        if (c < '0' || c > '9') {
+            break;
+        }
+        value = (short)(value * 10 + c - '0');
+    }
+
+    return is_negative ? (short)-value : value;
+}
+
+static short string_set_int(int args)
+{
+    short string = RAM(args);
+    char digits[8];
+    int length = snprintf(digits, sizeof(digits), "%d", RAM(args + 1));
+
+    if (length > RAM(string)) {
+        fail("string is full");
+        return 0;
+    }
+
+    for (int i = 0; i < length; i++) {
+        RAM(string + VI_STRING_HEADER + i) = digits[i];
+    }
+    RAM(string + 1) = length;
+
+    return 0;
+}
+
+static short string_back_space(int args)
+{
+    return VI_BACKSPACE;
+}
+
+static short string_double_quote(int args)
+{
+    return VI_DOUBLE_QUOTE;
+}
+
+static short string_new_line(int args)
+{
+    return VI_NEW_LINE;
+}
+
+static short output_print_char(int args)
+{
+    short c = RAM(args);
+
+    if (c == VI_NEW_LINE) {
+        fputc('\n', output_file);
+    } else if (c >= ' ' && c <= '~') {
+        fputc(c, output_file);
+    }
+
+    return 0;
+}
+
+static short output_print_string(int args)
+{
+    short string = RAM(args);
+    short length = RAM(string + 1);
+
+    for (int i = 0; i < length; i++) {
+        short c = RAM(string + VI_STRING_HEADER + i);
+
+        if (c == VI_NEW_LINE) {
+            fputc('\n', output_file);
+        } else if (c >= ' ' && c <= '~') {
+            fputc(c, output_file);
+        }
+    }
+
+    return 0;
+}
+
+static short output_print_int(int args)
+{
+    fprintf(output_file, "%d", RAM(args));
+    return 0;
+}
+
+static short output_println(int args)
+{
+    fputc('\n', output_file);
+    return 0;
+}
+
+static short sys_halt(int args)
+{
+    is_halted = true;
+    return 0;
+}
+
+static short sys_error(int args)
+{
+    printf("Sys.error(%d)\n", RAM(args));
+    fail("Sys.error was called");
+    return 0;
+}
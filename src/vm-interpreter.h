@@ -0,0 +1,36 @@
+#ifndef VI_VM_INTERPRETER
+#define VI_VM_INTERPRETER
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "vm-ir.h"
+
+#define VI_MAX_STEPS    1000000000L
+
+typedef struct {
+    char *name;
+    bool is_os;
+    long calls;
+    long instructions;
+} VI_Function_stats;
+
+// Profile of the last run, with the functions that were called
+// sorted by executed instructions, then by calls.
+typedef struct {
+    long instructions;
+    long os_calls;
+    VI_Function_stats *functions;
+    int functions_count;
+} VI_Stats;
+
+// Interprets the program from Sys.init when it defines one, otherwise
+// from Main.main, until it returns, calls Sys.halt or runs max_steps
+// instructions. The OS is replaced by built-in stand-ins: Math, Memory,
+// String, Array and Sys behave as specified, Output writes text to
+// output and Screen and Keyboard do nothing. Returns false after
+// printing the error when the program fails.
+bool vi_run(const VM_Class *program, FILE *output, long max_steps);
+
+VI_Stats vi_stats();
+
+#endif
@@ -0,0 +1,478 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm-ir.h"
+#include "file-handler.h"
+
+#define VM_INITIAL_INSTRUCTIONS 64
+#define VM_INITIAL_FUNCTIONS    8
+#define VM_INITIAL_SYMBOLS      16
+#define VM_MAX_LINE_LENGTH      256
+#define VM_MAX_TOKEN_LENGTH     128
+
+static const char *opcode_names[] = {
+    [VM_PUSH] = "push",
+    [VM_POP] = "pop",
+    [VM_ADD] = "add",
+    [VM_SUB] = "sub",
+    [VM_NEG] = "neg",
+    [VM_EQ] = "eq",
+    [VM_GT] = "gt",
+    [VM_LT] = "lt",
+    [VM_AND] = "and",
+    [VM_OR] = "or",
+    [VM_NOT] = "not",
+    [VM_LABEL] = "label",
+    [VM_GOTO] = "goto",
+    [VM_IF_GOTO] = "if-goto",
+    [VM_CALL] = "call",
+    [VM_RETURN] = "return"
+};
+
+static const char *segment_names[] = {
+    [VM_SEGMENT_CONSTANT] = "constant",
+    [VM_SEGMENT_ARGUMENT] = "argument",
+    [VM_SEGMENT_LOCAL] = "local",
+    [VM_SEGMENT_STATIC] = "static",
+    [VM_SEGMENT_THIS] = "this",
+    [VM_SEGMENT_THAT] = "that",
+    [VM_SEGMENT_POINTER] = "pointer",
+    [VM_SEGMENT_TEMP] = "temp"
+};
+
+static uint32_t symbol_hash(const char *class_name, const char *name);
+static uint32_t hash_string(uint32_t hash, const char *str);
+static bool symbol_matches(const char *symbol, const char *class_name, const char *name);
+static void grow_symbols(VM_Class *class);
+static void write_instruction(FH_Sink *sink, const VM_Class *class, VM_Instruction instruction);
+static void put(FH_Sink *sink, const char *str);
+static void write_line_range(FH_Sink *sink, const VM_Class *class, int first, int last, int line);
+static VM_Function *add_function(VM_Class *class, int symbol, int locals_count);
+static bool read_instruction(VM_Class *class, VM_Function *function, char **labels, int labels_count, char *line);
+static int read_label(VM_Class *class, char ***labels, int *labels_count, const char *name);
+static bool find_name(const char **names, int count, const char *name, int *index);
+
+VM_Class *vm_make_class(const char *name)
+{
+    VM_Class *class = calloc(1, sizeof(VM_Class));
+    class->name = strdup(name);
+    return class;
+}
+
+void vm_free_class(VM_Class *class)
+{
+    for (int i = 0; i < class->functions_count; i++) {
+        free(class->functions[i].instructions);
+    }
+    for (int i = 0; i < class->symbols_count; i++) {
+        free(class->symbols[i]);
+    }
+
+    free(class->functions);
+    free(class->symbols);
+    free(class->symbol_slots);
+    free(class->name);
+    free(class);
+}
+
+VM_Function *vm_add_function(VM_Class *class, const char *name, int locals_count)
+{
+    return add_function(class, vm_symbol(class, class->name, name), locals_count);
+}
+
+void vm_append(VM_Function *function, VM_Instruction instruction)
+{
+    if (function->count == function->capacity) {
+        function->capacity = function->capacity > 0 ?
+            function->capacity * 2 :
+            VM_INITIAL_INSTRUCTIONS;
+        function->instructions = realloc(
+            function->instructions,
+            sizeof(VM_Instruction) * function->capacity
+        );
+    }
+
+    function->instructions[function->count++] = instruction;
+}
+
+// Symbols are looked up through an open addressing index of ids,
+// kept at most half full.
+int vm_symbol(VM_Class *class, const char *class_name, const char *name)
+{
+    if (class->symbols_count * 2 >= class->symbols_capacity) {
+        grow_symbols(class);
+    }
+
+    uint32_t mask = class->symbols_capacity - 1;
+    uint32_t slot = symbol_hash(class_name, name) & mask;
+
+    while (class->symbol_slots[slot] >= 0) {
+        int id = class->symbol_slots[slot];
+
+        if (symbol_matches(class->symbols[id], class_name, name)) {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    size_t class_length = strlen(class_name);
+    size_t name_length = strlen(name);
+    char *symbol = malloc(class_length + name_length + 2);
+    memcpy(symbol, class_name, class_length);
+    symbol[class_length] = '.';
+    memcpy(symbol + class_length + 1, name, name_length + 1);
+
+    int id = class->symbols_count++;
+    class->symbols[id] = symbol;
+    class->symbol_slots[slot] = id;
+
+    return id;
+}
+
+int vm_make_label(VM_Class *class)
+{
+    return class->labels_count++;
+}
+
+const char *vm_opcode_name(VM_Opcode opcode)
+{
+    return opcode_names[opcode];
+}
+
+const char *vm_segment_name(VM_Segment segment)
+{
+    return segment_names[segment];
+}
+
+bool vm_same_code(const VM_Instruction *a, const VM_Instruction *b, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (a[i].opcode != b[i].opcode || a[i].segment != b[i].segment ||
+            a[i].operand != b[i].operand || a[i].symbol != b[i].symbol) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void vm_write_class(FILE *file, const VM_Class *class)
+{
+    FH_Sink *sink = fh_sink(file);
+
+    put(sink, "// compiled ");
+    put(sink, class->name);
+    put(sink, ".jack\n");
+
+    for (int i = 0; i < class->functions_count; i++) {
+        VM_Function *function = &class->functions[i];
+
+        put(sink, "function ");
+        put(sink, class->symbols[function->symbol]);
+        put(sink, " ");
+        fh_sink_int(sink, function->locals_count);
+        put(sink, "\n");
+
+        for (int j = 0; j < function->count; j++) {
+            fh_sink_indent(sink, 1);
+            write_instruction(sink, class, function->instructions[j]);
+            put(sink, "\n");
+        }
+    }
+}
+
+// The header comment and every function line map to no Jack line.
+int vm_write_line_map(FILE *file, const VM_Class *class, int first_line)
+{
+    FH_Sink *sink = fh_sink(file);
+    int output_line = first_line + 1;
+
+    for (int i = 0; i < class->functions_count; i++) {
+        VM_Function *function = &class->functions[i];
+        int start = 0;
+
+        output_line++;
+
+        for (int j = 1; j <= function->count; j++) {
+            int line = function->instructions[start].line;
+
+            if (j < function->count && function->instructions[j].line == line) {
+                continue;
+            }
+            if (line > 0) {
+                write_line_range(sink, class, output_line + start, output_line + j - 1, line);
+            }
+            start = j;
+        }
+        output_line += function->count;
+    }
+
+    return output_line - first_line;
+}
+
+// Labels are scoped to their function, so their names are collected
+// anew for each one, every name mapping to a label id of the class.
+VM_Class *vm_read_class(FILE *file, const char *name)
+{
+    VM_Class *class = vm_make_class(name);
+    VM_Function *function = NULL;
+    char **labels = NULL;
+    int labels_count = 0;
+    char line[VM_MAX_LINE_LENGTH];
+    char command[VM_MAX_TOKEN_LENGTH];
+    char argument[VM_MAX_TOKEN_LENGTH];
+    int line_number = 0;
+    bool failed = false;
+
+    while (!failed && fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+
+        char *comment = strstr(line, "//");
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        int count = sscanf(line, "%127s %127s", command, argument);
+
+        if (count <= 0) {
+            continue;
+        }
+
+        if (strcmp(command, "function") == 0) {
+            int locals_count = 0;
+            char *dot = count == 2 ? strchr(argument, '.') : NULL;
+
+            if (dot == NULL || sscanf(line, "%*s %*s %d", &locals_count) != 1) {
+                failed = true;
+                break;
+            }
+
+            *dot = '\0';
+            function = add_function(class, vm_symbol(class, argument, dot + 1), locals_count);
+
+            for (int i = 0; i < labels_count; i++) {
+                free(labels[i]);
+            }
+            labels_count = 0;
+
+        } else if (function == NULL) {
+            failed = true;
+
+        } else if (count == 2 && 
+                   (strcmp(command, "label") == 0 || 
+                    strcmp(command, "goto") == 0 || 
+                    strcmp(command, "if-goto") == 0)) {
+            int label = read_label(class, &labels, &labels_count, argument);
+            int opcode;
+
+            find_name(opcode_names, VM_RETURN + 1, command, &opcode);
+            vm_append(function, (VM_Instruction){ opcode, 0, label, -1 });
+
+        } else {
+            failed = !read_instruction(class, function, labels, labels_count, line);
+        }
+    }
+
+    for (int i = 0; i < labels_count; i++) {
+        free(labels[i]);
+    }
+    free(labels);
+
+    if (failed) {
+        printf("Line %d: invalid VM command\n%s\n", line_number, line);
+        vm_free_class(class);
+        return NULL;
+    }
+
+    return class;
+}
+
+// FNV-1a of "class_name.name", hashed in parts so the key never has
+// to be assembled just for a lookup.
+static uint32_t symbol_hash(const char *class_name, const char *name)
+{
+    uint32_t hash = hash_string(2166136261u, class_name);
+    hash = (hash ^ '.') * 16777619u;
+    return hash_string(hash, name);
+}
+
+static uint32_t hash_string(uint32_t hash, const char *str)
+{
+    for (const char *c = str; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+
+    return hash;
+}
+
+static bool symbol_matches(const char *symbol, const char *class_name, const char *name)
+{
+    size_t class_length = strlen(class_name);
+
+    return strncmp(symbol, class_name, class_length) == 0 &&
+        symbol[class_length] == '.' &&
+        strcmp(symbol + class_length + 1, name) == 0;
+}
+
+static void grow_symbols(VM_Class *class)
+{
+    class->symbols_capacity = class->symbols_capacity > 0 ?
+        class->symbols_capacity * 2 :
+        VM_INITIAL_SYMBOLS;
+    class->symbols = realloc(
+        class->symbols,
+        sizeof(char *) * class->symbols_capacity
+    );
+
+    free(class->symbol_slots);
+    class->symbol_slots = malloc(sizeof(int) * class->symbols_capacity);
+    memset(class->symbol_slots, -1, sizeof(int) * class->symbols_capacity);
+
+    uint32_t mask = class->symbols_capacity - 1;
+
+    for (int id = 0; id < class->symbols_count; id++) {
+        uint32_t slot = hash_string(2166136261u, class->symbols[id]) & mask;
+        while (class->symbol_slots[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        class->symbol_slots[slot] = id;
+    }
+}
+
+static void write_instruction(FH_Sink *sink, const VM_Class *class, VM_Instruction instruction)
+{
+    VM_Opcode opcode = instruction.opcode;
+
+    put(sink, opcode_names[opcode]);
+
+    if (opcode == VM_PUSH || opcode == VM_POP) {
+        put(sink, " ");
+        put(sink, segment_names[instruction.segment]);
+        put(sink, " ");
+        fh_sink_int(sink, instruction.operand);
+
+    } else if (opcode == VM_LABEL || opcode == VM_GOTO || opcode == VM_IF_GOTO) {
+        put(sink, " ");
+        put(sink, class->name);
+        put(sink, "_");
+        fh_sink_int(sink, instruction.operand);
+
+    } else if (opcode == VM_CALL) {
+        put(sink, " ");
+        put(sink, class->symbols[instruction.symbol]);
+        put(sink, " ");
+        fh_sink_int(sink, instruction.operand);
+    }
+}
+
+static void put(FH_Sink *sink, const char *str)
+{
+    fh_sink_write(sink, str, strlen(str));
+}
+
+static void write_line_range(FH_Sink *sink, const VM_Class *class, int first, int last, int line)
+{
+    fh_sink_int(sink, first);
+
+    if (last > first) {
+        put(sink, "-");
+        fh_sink_int(sink, last);
+    }
+    put(sink, " ");
+    put(sink, class->name);
+    put(sink, ".jack:");
+    fh_sink_int(sink, line);
+    put(sink, "\n");
+}
+
+static VM_Function *add_function(VM_Class *class, int symbol, int locals_count)
+{
+    if (class->functions_count == class->functions_capacity) {
+        class->functions_capacity = class->functions_capacity > 0 ?
+            class->functions_capacity * 2 :
+            VM_INITIAL_FUNCTIONS;
+        class->functions = realloc(
+            class->functions,
+            sizeof(VM_Function) * class->functions_capacity
+        );
+    }
+
+    VM_Function *function = &class->functions[class->functions_count++];
+    function->symbol = symbol;
+    function->locals_count = locals_count;
+    function->instructions = NULL;
+    function->count = 0;
+    function->capacity = 0;
+
+    return function;
+}
+
+// Push, pop, call and the stack commands.
+static bool read_instruction(VM_Class *class, VM_Function *function, char **labels, int labels_count, char *line)
+{
+    char command[VM_MAX_TOKEN_LENGTH];
+    char argument[VM_MAX_TOKEN_LENGTH];
+    int operand = 0;
+    int opcode;
+    int count = sscanf(line, "%127s %127s %d", command, argument, &operand);
+
+    if (!find_name(opcode_names, VM_RETURN + 1, command, &opcode)) {
+        return false;
+    }
+
+    VM_Instruction instruction = { opcode, 0, 0, -1 };
+
+    if (opcode == VM_PUSH || opcode == VM_POP) {
+        int segment;
+
+        if (count != 3 || !find_name(segment_names, VM_SEGMENT_TEMP + 1, argument, &segment)) {
+            return false;
+        }
+        instruction.segment = segment;
+        instruction.operand = operand;
+
+    } else if (opcode == VM_CALL) {
+        char *dot = strchr(argument, '.');
+
+        if (count != 3 || dot == NULL) {
+            return false;
+        }
+        *dot = '\0';
+        instruction.symbol = vm_symbol(class, argument, dot + 1);
+        instruction.operand = operand;
+
+    } else if (count != 1) {
+        return false;
+    }
+
+    vm_append(function, instruction);
+
+    return true;
+}
+
+static int read_label(VM_Class *class, char ***labels, int *labels_count, const char *name)
+{
+    int index;
+
+    if (find_name((const char **)*labels, *labels_count, name, &index)) {
+        return class->labels_count - *labels_count + index;
+    }
+
+    *labels = realloc(*labels, sizeof(char *) * (*labels_count + 1));
+    (*labels)[(*labels_count)++] = strdup(name);
+
+    return vm_make_label(class);
+}
+
+static bool find_name(const char **names, int count, const char *name, int *index)
+{
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            *index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
\ No newline at end of file
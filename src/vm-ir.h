@@ -0,0 +1,102 @@
+#ifndef VM_IR
+#define VM_IR
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef enum {
+    VM_SEGMENT_CONSTANT,
+    VM_SEGMENT_ARGUMENT,
+    VM_SEGMENT_LOCAL,
+    VM_SEGMENT_STATIC,
+    VM_SEGMENT_THIS,
+    VM_SEGMENT_THAT,
+    VM_SEGMENT_POINTER,
+    VM_SEGMENT_TEMP
+} VM_Segment;
+
+typedef enum {
+    VM_PUSH,
+    VM_POP,
+    VM_ADD,
+    VM_SUB,
+    VM_NEG,
+    VM_EQ,
+    VM_GT,
+    VM_LT,
+    VM_AND,
+    VM_OR,
+    VM_NOT,
+    VM_LABEL,
+    VM_GOTO,
+    VM_IF_GOTO,
+    VM_CALL,
+    VM_RETURN
+} VM_Opcode;
+
+// A single VM command. Push and pop use segment and operand (the
+// index), label, goto and if-goto keep the label id in operand and
+// call keeps the callee's symbol id plus the arguments count. line
+// is the Jack line the command was compiled from, 0 when unknown.
+typedef struct {
+    VM_Opcode opcode;
+    VM_Segment segment;
+    int operand;
+    int symbol;
+    int line;
+} VM_Instruction;
+
+typedef struct {
+    int symbol;
+    int locals_count;
+    VM_Instruction *instructions;
+    int count;
+    int capacity;
+} VM_Function;
+
+// IR of a compiled class. Symbols are interned "Class.name" strings,
+// referenced by id from functions and calls. Label ids are unique
+// within the class and are written out as Class_id.
+typedef struct {
+    char *name;
+    VM_Function *functions;
+    int functions_count;
+    int functions_capacity;
+    char **symbols;
+    int symbols_count;
+    int symbols_capacity;
+    int *symbol_slots;
+    int labels_count;
+} VM_Class;
+
+VM_Class *vm_make_class(const char *name);
+void vm_free_class(VM_Class *class);
+
+// The returned function is only valid until the next one is added.
+VM_Function *vm_add_function(VM_Class *class, const char *name, int locals_count);
+void vm_append(VM_Function *function, VM_Instruction instruction);
+
+int vm_symbol(VM_Class *class, const char *class_name, const char *name);
+int vm_make_label(VM_Class *class);
+
+const char *vm_opcode_name(VM_Opcode opcode);
+const char *vm_segment_name(VM_Segment segment);
+
+// Whether both runs of instructions are the same code, whatever
+// lines they were compiled from.
+bool vm_same_code(const VM_Instruction *a, const VM_Instruction *b, int count);
+
+void vm_write_class(FILE *file, const VM_Class *class);
+
+// Writes which Jack line each run of instructions was compiled from,
+// as "first-last Class.jack:line" over the lines of the class' VM
+// output, given the line its header comment was written to. Returns
+// how many lines the class takes in the VM output.
+int vm_write_line_map(FILE *file, const VM_Class *class, int first_line);
+
+// Reads VM code, such as the OS' compiled classes, into a class with
+// the given name. Prints the offending line and returns NULL when the
+// file isn't valid VM code.
+VM_Class *vm_read_class(FILE *file, const char *name);
+
+#endif
@@ -13,16 +13,43 @@ source_files=(
     '../src/tokenizer.c'
     '../src/file-handler.c'
     '../src/linked-list.c'
+    '../src/pool.c'
     '../src/hash-table.c'
     '../src/id-table.c'
+    '../src/code-gen.c'
+    '../src/vm-ir.c'
+    '../src/peephole.c'
+    '../src/optimizer.c'
+    '../src/liveness.c'
+    '../src/cfg.c'
+    '../src/licm.c'
+    '../src/tree-shaker.c'
+    '../src/hack-asm.c'
+    '../src/vm-interpreter.c'
+    '../src/hack-cpu.c'
+    '../src/stack-depth.c'
 )
 test_files=(
     '../tests/main.c'
     '../tests/test.c'
     '../tests/utils.c'
     '../tests/test-tokenizer.c'
+    '../tests/test-file-handler.c'
     '../tests/test-parser.c'
     '../tests/test-id-table.c'
+    '../tests/test-pool.c'
+    '../tests/test-vm-ir.c'
+    '../tests/test-peephole.c'
+    '../tests/test-optimizer.c'
+    '../tests/test-liveness.c'
+    '../tests/test-cfg.c'
+    '../tests/test-licm.c'
+    '../tests/test-tree-shaker.c'
+    '../tests/test-hack-asm.c'
+    '../tests/test-vm-interpreter.c'
+    '../tests/test-hack-cpu.c'
+    '../tests/test-stack-depth.c'
+    '../tests/test-code-gen.c'
 )
 files=("${source_files[@]}" "${test_files[@]}")
 
@@ -36,7 +63,7 @@ for file in "${files[@]}"; do
     args+=$file' '
 done
 
-if clang -g -Wall -o _test $args; then
+if clang -g -Wall -pthread -o _test $args; then
     ./_test
 fi
 
@@ -1,10 +1,38 @@
 #include "test-tokenizer.h"
+#include "test-file-handler.h"
 #include "test-parser.h"
 #include "test-id-table.h"
+#include "test-pool.h"
+#include "test-vm-ir.h"
+#include "test-peephole.h"
+#include "test-optimizer.h"
+#include "test-liveness.h"
+#include "test-cfg.h"
+#include "test-licm.h"
+#include "test-tree-shaker.h"
+#include "test-hack-asm.h"
+#include "test-vm-interpreter.h"
+#include "test-hack-cpu.h"
+#include "test-stack-depth.h"
+#include "test-code-gen.h"
 
 int main(int argc, char **argv)
 {
     test_tokenizer();
+    test_file_handler();
     test_parser();
     test_id_table();
+    test_pool();
+    test_vm_ir();
+    test_peephole();
+    test_optimizer();
+    test_liveness();
+    test_cfg();
+    test_licm();
+    test_tree_shaker();
+    test_hack_asm();
+    test_vm_interpreter();
+    test_hack_cpu();
+    test_stack_depth();
+    test_code_gen();
 }
@@ -0,0 +1,141 @@
+#include "test.h"
+#include "test-cfg.h"
+#include "utils.h"
+#include "../src/cfg.h"
+
+static void test_cfg_blocks();
+static void test_cfg_dominators();
+static void test_cfg_loops();
+static VM_Class *make_class();
+
+void test_cfg()
+{
+    tst_suite_begin("CFG");
+
+    tst_unit("Blocks", test_cfg_blocks);
+    tst_unit("Dominators", test_cfg_dominators);
+    tst_unit("Loops", test_cfg_loops);
+
+    tst_suite_finish();
+}
+
+static void test_cfg_blocks()
+{
+    VM_Class *class = make_class();
+    CFG_Graph *graph = cfg_build(&class->functions[0]);
+
+    tst_int_equals(graph->blocks_count, 7);
+    tst_int_equals(graph->blocks[1].start, 2);
+    tst_int_equals(graph->blocks[1].end, 7);
+    tst_int_equals(graph->instruction_blocks[9], 2);
+
+    tst_int_equals(graph->blocks[1].successors_count, 2);
+    tst_int_equals(graph->blocks[1].successors[0], 5);
+    tst_int_equals(graph->blocks[1].successors[1], 2);
+    tst_int_equals(graph->blocks[4].successors_count, 1);
+    tst_int_equals(graph->blocks[4].successors[0], 1);
+    tst_int_equals(graph->blocks[5].successors_count, 0);
+    tst_int_equals(graph->blocks[1].predecessors_count, 2);
+
+    tst_true(graph->blocks[5].is_reachable);
+    tst_true(!graph->blocks[6].is_reachable);
+
+    cfg_free(graph);
+    vm_free_class(class);
+}
+
+static void test_cfg_dominators()
+{
+    VM_Class *class = make_class();
+    CFG_Graph *graph = cfg_build(&class->functions[0]);
+
+    tst_int_equals(graph->blocks[0].immediate_dominator, CFG_NONE);
+    tst_int_equals(graph->blocks[2].immediate_dominator, 1);
+    tst_int_equals(graph->blocks[3].immediate_dominator, 2);
+    tst_int_equals(graph->blocks[4].immediate_dominator, 2);
+    tst_int_equals(graph->blocks[5].immediate_dominator, 1);
+    tst_int_equals(graph->blocks[6].immediate_dominator, CFG_NONE);
+
+    tst_true(cfg_dominates(graph, 0, 4));
+    tst_true(cfg_dominates(graph, 4, 4));
+    tst_true(!cfg_dominates(graph, 3, 4));
+    tst_true(!cfg_dominates(graph, 0, 6));
+
+    cfg_free(graph);
+    vm_free_class(class);
+}
+
+static void test_cfg_loops()
+{
+    VM_Class *class = make_class();
+    CFG_Graph *graph = cfg_build(&class->functions[0]);
+
+    tst_int_equals(graph->loops_count, 2);
+
+    int outer = graph->blocks[1].loop;
+    int inner = graph->blocks[3].loop;
+
+    tst_int_equals(graph->loops[outer].header, 1);
+    tst_int_equals(graph->loops[outer].blocks_count, 4);
+    tst_int_equals(graph->loops[outer].parent, CFG_NONE);
+    tst_int_equals(graph->loops[inner].header, 3);
+    tst_int_equals(graph->loops[inner].blocks_count, 1);
+    tst_int_equals(graph->loops[inner].parent, outer);
+    tst_int_equals(graph->loops[inner].depth, 2);
+
+    tst_true(cfg_loop_contains(graph, outer, 4));
+    tst_true(!cfg_loop_contains(graph, outer, 5));
+    tst_int_equals(graph->blocks[3].loop_depth, 2);
+    tst_int_equals(graph->blocks[4].loop_depth, 1);
+    tst_int_equals(graph->blocks[5].loop_depth, 0);
+    tst_int_equals(graph->blocks[5].loop, CFG_NONE);
+
+    cfg_free(graph);
+    vm_free_class(class);
+}
+
+// while (i < 10) { if (~(i & 1)) { while (j) {} } let i = i + 1; }
+// return 0; followed by an unreachable return.
+static VM_Class *make_class()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 2);
+    int test = vm_make_label(class);
+    int end = vm_make_label(class);
+    int skip = vm_make_label(class);
+    int inner = vm_make_label(class);
+
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 0);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 0);
+
+    append_test_instruction(function, VM_LABEL, 0, test);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 10);
+    append_test_instruction(function, VM_LT, 0, 0);
+    append_test_instruction(function, VM_IF_GOTO, 0, end);
+
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 1);
+    append_test_instruction(function, VM_AND, 0, 0);
+    append_test_instruction(function, VM_IF_GOTO, 0, skip);
+
+    append_test_instruction(function, VM_LABEL, 0, inner);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 1);
+    append_test_instruction(function, VM_IF_GOTO, 0, inner);
+
+    append_test_instruction(function, VM_LABEL, 0, skip);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 1);
+    append_test_instruction(function, VM_ADD, 0, 0);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_GOTO, 0, test);
+
+    append_test_instruction(function, VM_LABEL, 0, end);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 0);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 1);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    return class;
+}
@@ -0,0 +1 @@
+void test_cfg();
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <string.h>
+#include "test.h"
+#include "test-code-gen.h"
+#include "../src/code-gen.h"
+#include "../src/file-handler.h"
+#include "../src/id-table.h"
+#include "../src/parser.h"
+#include "../src/vm-interpreter.h"
+
+#define TEST_JACK_NAME      "code_gen_test_file.jack"
+#define TEST_VM_NAME        "code_gen_test_file.vm"
+#define TEST_OUTPUT_NAME    "code_gen_test_output.txt"
+#define TEST_MAX_STEPS      10000000
+#define TEST_OUTPUT_SIZE    4096
+#define TEST_VM_SIZE        65536
+
+static void test_multiply_and_divide();
+static void test_pooled_strings();
+static void test_if_and_while();
+static void test_dispatch_chains();
+static bool compile_and_run(
+    const char **sources,
+    int count,
+    CG_Options options,
+    char *output,
+    char *vm
+);
+static void write_source(const char *source);
+static void read_file(const char *name, char *content, size_t size);
+static int count_occurrences(const char *text, const char *pattern);
+static long os_calls(const char *name);
+
+void test_code_gen()
+{
+    tst_suite_begin("Code generation");
+
+    tst_unit("Multiply and divide", test_multiply_and_divide);
+    tst_unit("Pooled strings", test_pooled_strings);
+    tst_unit("If and while", test_if_and_while);
+    tst_unit("Dispatch chains", test_dispatch_chains);
+
+    tst_suite_finish();
+}
+
+// Strength reduced products and quotients, under -O, print what the
+// calls to Math.multiply and Math.divide print without it.
+static void test_multiply_and_divide()
+{
+    const char *source =
+        "class Main {\n"
+        "  function void main() {\n"
+        "    var Array xs;\n"
+        "    var int i, x;\n"
+        "    let xs = Array.new(9);\n"
+        "    let xs[0] = 0; let xs[1] = 1; let xs[2] = -1;\n"
+        "    let xs[3] = 7; let xs[4] = -8; let xs[5] = 9;\n"
+        "    let xs[6] = 181; let xs[7] = 16383; let xs[8] = -32767 - 1;\n"
+        "    let i = 0;\n"
+        "    while (i < 9) {\n"
+        "      let x = xs[i];\n"
+        "      do Main.show(x * 0); do Main.show(x * 1); do Main.show(x * -1);\n"
+        "      do Main.show(x * 2); do Main.show(x * 3); do Main.show(x * -3);\n"
+        "      do Main.show(x * 10); do Main.show(x * 4096); do Main.show(x * -4096);\n"
+        "      do Main.show(x * 8192); do Main.show(x * 16384);\n"
+        "      do Main.show(3 * x); do Main.show(-1 * x);\n"
+        "      do Main.show(x / 1); do Main.show(x / -1);\n"
+        "      do Output.println();\n"
+        "      let i = i + 1;\n"
+        "    }\n"
+        "    return;\n"
+        "  }\n"
+        "  function void show(int value) {\n"
+        "    do Output.printInt(value);\n"
+        "    do Output.printChar(32);\n"
+        "    return;\n"
+        "  }\n"
+        "}\n";
+    char expected[TEST_OUTPUT_SIZE];
+    char output[TEST_OUTPUT_SIZE];
+    char vm[TEST_VM_SIZE];
+
+    tst_true(compile_and_run(&source, 1, (CG_Options){ 0 }, expected, vm));
+    tst_int_equals(count_occurrences(vm, "call Math.multiply"), 13);
+    tst_int_equals(count_occurrences(vm, "call Math.divide"), 2);
+
+    tst_true(compile_and_run(&source, 1, (CG_Options){ .optimize = true }, output, vm));
+    // -4096 costs a negation more than reducing allows, as do 8192
+    // and 16384 their extra doublings.
+    tst_int_equals(count_occurrences(vm, "call Math.multiply"), 3);
+    tst_int_equals(count_occurrences(vm, "call Math.divide"), 0);
+
+    tst_str_equals(output, expected);
+    tst_true(strstr(output, "\n0 7 -7 14 21 -21 70 28672 -28672 -8192 -16384 21 -7 7 -7 \n") != NULL);
+    tst_true(strstr(output, "\n0 -32768 -32768 0 -32768 -32768 0 0 0 0 0 -32768 -32768 -32768 -32768 \n") != NULL);
+}
+
+// Each literal gets a slot past the statics of every class, which
+// keep their values, and is built once however often it's printed.
+static void test_pooled_strings()
+{
+    const char *sources[] = {
+        "class Main {\n"
+        "  static int a, b;\n"
+        "  function void main() {\n"
+        "    var int i;\n"
+        "    let a = 1; let b = 2;\n"
+        "    do Output.printInt(a + b);\n"
+        "    do Counter.init();\n"
+        "    let i = 0;\n"
+        "    while (i < 5) {\n"
+        "      do Output.printString(\"ab\");\n"
+        "      do Counter.greet();\n"
+        "      do Output.printString(\"ab\");\n"
+        "      let i = i + 1;\n"
+        "    }\n"
+        "    do Counter.print();\n"
+        "    return;\n"
+        "  }\n"
+        "}\n",
+        "class Counter {\n"
+        "  static int x, y, z;\n"
+        "  function void init() {\n"
+        "    let x = 10; let y = 20; let z = 30;\n"
+        "    return;\n"
+        "  }\n"
+        "  function void greet() {\n"
+        "    let z = z + 1;\n"
+        "    do Output.printString(\"hi\");\n"
+        "    return;\n"
+        "  }\n"
+        "  function void print() {\n"
+        "    do Output.printInt(x + y + z);\n"
+        "    return;\n"
+        "  }\n"
+        "}\n"
+    };
+    char expected[TEST_OUTPUT_SIZE];
+    char output[TEST_OUTPUT_SIZE];
+    char vm[TEST_VM_SIZE];
+    char slot[64];
+
+    tst_true(compile_and_run(sources, 2, (CG_Options){ 0 }, expected, vm));
+    tst_int_equals(os_calls("String.new"), 15);
+
+    tst_true(compile_and_run(sources, 2, (CG_Options){ .pool_strings = true }, output, vm));
+    tst_int_equals(os_calls("String.new"), 2);
+    tst_str_equals(output, expected);
+    tst_str_equals(output, "3abhiababhiababhiababhiababhiab65");
+
+    int first_slot = idt_max_statics_count();
+    tst_true(first_slot >= 3);
+
+    sprintf(slot, "push static %d\n    if-goto", first_slot);
+    tst_int_equals(count_occurrences(vm, slot), 2);
+    sprintf(slot, "push static %d\n    if-goto", first_slot + 1);
+    tst_int_equals(count_occurrences(vm, slot), 1);
+    sprintf(slot, "static %d\n", first_slot + 2);
+    tst_int_equals(count_occurrences(vm, slot), 0);
+}
+
+// Under -O, ifs branch on boolean conditions without the `not` and
+// loops test at the bottom. Conditions other than true or false, as
+// `if (5)`, still take the else arm.
+static void test_if_and_while()
+{
+    const char *source =
+        "class Main {\n"
+        "  function void main() {\n"
+        "    var int i, j, k;\n"
+        "    let i = 0;\n"
+        "    while (i < 5) {\n"
+        "      if (i < 2) { do Main.show(1); }\n"
+        "      if ((i > 1) & (i < 4)) { do Main.show(2); } else { do Main.show(3); }\n"
+        "      if (5) { do Main.show(4); } else { do Main.show(5); }\n"
+        "      if (i - 1) { do Main.show(6); } else { do Main.show(7); }\n"
+        "      if (~(i = 2)) { do Main.show(8); } else { do Main.show(9); }\n"
+        "      let j = 0;\n"
+        "      while (j < i) { let j = j + 1; }\n"
+        "      do Main.show(j);\n"
+        "      while (j < 0) { do Main.show(99); }\n"
+        "      let k = -1;\n"
+        "      while (k) { do Main.show(10); let k = 0; }\n"
+        "      do Output.println();\n"
+        "      let i = i + 1;\n"
+        "    }\n"
+        "    return;\n"
+        "  }\n"
+        "  function void show(int value) {\n"
+        "    do Output.printInt(value);\n"
+        "    do Output.printChar(32);\n"
+        "    return;\n"
+        "  }\n"
+        "}\n";
+    char expected[TEST_OUTPUT_SIZE];
+    char output[TEST_OUTPUT_SIZE];
+    char vm[TEST_VM_SIZE];
+
+    tst_true(compile_and_run(&source, 1, (CG_Options){ 0 }, expected, vm));
+    int nots_count = count_occurrences(vm, "not\n");
+
+    tst_true(compile_and_run(&source, 1, (CG_Options){ .optimize = true }, output, vm));
+    tst_true(count_occurrences(vm, "not\n") < nots_count);
+
+    tst_str_equals(output, expected);
+    tst_str_equals(
+        output,
+        "1 3 5 6 8 0 10 \n"
+        "1 3 5 7 8 1 10 \n"
+        "2 5 7 9 2 10 \n"
+        "2 5 7 8 3 10 \n"
+        "3 5 7 8 4 10 \n"
+    );
+}
+
+// Equality chains on one variable, which -O turns into a tree of
+// tests, select the arms the chained ifs select, for every value
+// around their constants.
+static void test_dispatch_chains()
+{
+    const char *source =
+        "class Main {\n"
+        "  function void main() {\n"
+        "    var int x;\n"
+        "    let x = -25;\n"
+        "    while (x < 36) {\n"
+        "      do Main.show(x);\n"
+        "      do Main.show(Main.negatives(x));\n"
+        "      do Main.show(Main.cut(x));\n"
+        "      do Main.show(Main.five(x));\n"
+        "      do Main.show(Main.four(x));\n"
+        "      do Output.println();\n"
+        "      let x = x + 1;\n"
+        "    }\n"
+        "    return;\n"
+        "  }\n"
+        "  function int negatives(int x) {\n"
+        "    var int r;\n"
+        "    if (x = 3) { let r = 1; }\n"
+        "    else { if (x = -7) { let r = 2; }\n"
+        "    else { if (12 = x) { let r = 3; }\n"
+        "    else { if (x = 0) { let r = 4; }\n"
+        "    else { if (x = 3) { let r = 5; }\n"
+        "    else { if (-20 = x) { let r = 6; }\n"
+        "    else { if (x = 30) { let r = 7; }\n"
+        "    else { let r = 8; } } } } } } }\n"
+        "    return r;\n"
+        "  }\n"
+        "  function int cut(int x) {\n"
+        "    var int r;\n"
+        "    if (x = 1) { let r = 1; }\n"
+        "    else { if (x = 2) { let r = 2; }\n"
+        "    else { if (x = 4) { let r = 3; }\n"
+        "    else { if (x = 8) { let r = 4; }\n"
+        "    else { if (x = 16) { let r = 5; }\n"
+        "    else { if (x > 20) { let r = 6; }\n"
+        "    else { if (x = -1) { let r = 7; }\n"
+        "    else { if (x = -2) { let r = 8; }\n"
+        "    else { if (x = -4) { let r = 9; }\n"
+        "    else { if (x = -8) { let r = 10; }\n"
+        "    else { if (x = 17) { let r = 11; }\n"
+        "    else { let r = 12; } } } } } } } } } } }\n"
+        "    return r;\n"
+        "  }\n"
+        "  function int five(int x) {\n"
+        "    var int r;\n"
+        "    let r = 0;\n"
+        "    if (x = 5) { let r = 1; }\n"
+        "    else { if (x = 6) { let r = 2; }\n"
+        "    else { if (x = 7) { let r = 3; }\n"
+        "    else { if (x = 9) { let r = 4; }\n"
+        "    else { if (x = 10) { let r = 5; } } } } }\n"
+        "    return r;\n"
+        "  }\n"
+        "  function int four(int x) {\n"
+        "    var int r;\n"
+        "    let r = 0;\n"
+        "    if (x = 5) { let r = 1; }\n"
+        "    else { if (x = 6) { let r = 2; }\n"
+        "    else { if (x = 7) { let r = 3; }\n"
+        "    else { if (x = 9) { let r = 4; } } } }\n"
+        "    return r;\n"
+        "  }\n"
+        "  function void show(int value) {\n"
+        "    do Output.printInt(value);\n"
+        "    do Output.printChar(32);\n"
+        "    return;\n"
+        "  }\n"
+        "}\n";
+    char expected[TEST_OUTPUT_SIZE];
+    char output[TEST_OUTPUT_SIZE];
+    char vm[TEST_VM_SIZE];
+
+    tst_true(compile_and_run(&source, 1, (CG_Options){ 0 }, expected, vm));
+    tst_int_equals(count_occurrences(vm, "lt\n"), 1);
+
+    tst_true(compile_and_run(&source, 1, (CG_Options){ .optimize = true }, output, vm));
+    // The loop's test, three splits for the six distinct constants of
+    // negatives(), two for each five cases of cut(), on both sides of
+    // its `x > 20`, and of five(), none for four(), tested in order.
+    tst_int_equals(count_occurrences(vm, "lt\n"), 10);
+
+    tst_str_equals(output, expected);
+    tst_true(strstr(output, "\n-20 6 12 0 0 \n") != NULL);
+    tst_true(strstr(output, "\n-7 2 12 0 0 \n") != NULL);
+    tst_true(strstr(output, "\n-4 8 9 0 0 \n") != NULL);
+    tst_true(strstr(output, "\n3 1 12 0 0 \n") != NULL);
+    tst_true(strstr(output, "\n9 8 12 4 4 \n") != NULL);
+    tst_true(strstr(output, "\n12 3 12 0 0 \n") != NULL);
+    tst_true(strstr(output, "\n17 8 11 0 0 \n") != NULL);
+    tst_true(strstr(output, "\n30 7 6 0 0 \n") != NULL);
+}
+
+// Compiles the Jack classes, one file each, through the whole
+// pipeline with the given options, then runs the program on the VM
+// interpreter. The VM code and what the program prints are copied
+// to vm and output, TEST_VM_SIZE and TEST_OUTPUT_SIZE long.
+static bool compile_and_run(
+    const char **sources,
+    int count,
+    CG_Options options,
+    char *output,
+    char *vm
+) {
+    static bool has_os_signatures = false;
+
+    if (!has_os_signatures) {
+        idt_store_os_signatures();
+        has_os_signatures = true;
+    }
+
+    for (int i = 0; i < count; i++) {
+        write_source(sources[i]);
+
+        FILE *file = fopen(TEST_JACK_NAME, "r");
+        parser_index_signatures(file);
+        fclose(file);
+    }
+
+    cg_set_options(options);
+    FILE *vm_file = fh_open_file(TEST_VM_NAME, true);
+
+    for (int i = 0; i < count; i++) {
+        write_source(sources[i]);
+
+        FILE *file = fopen(TEST_JACK_NAME, "r");
+        Parser_jack_syntax ast = parser_parse(file);
+        cg_gen_code(vm_file, &ast);
+        parser_free(ast);
+        fclose(file);
+    }
+
+    cg_finish(vm_file);
+    fh_close_file(vm_file);
+    remove(TEST_JACK_NAME);
+
+    read_file(TEST_VM_NAME, vm, TEST_VM_SIZE);
+
+    vm_file = fopen(TEST_VM_NAME, "r");
+    VM_Class *program = vm_read_class(vm_file, "Program");
+    fclose(vm_file);
+    remove(TEST_VM_NAME);
+
+    if (program == NULL) {
+        output[0] = '\0';
+        return false;
+    }
+
+    FILE *output_file = fopen(TEST_OUTPUT_NAME, "w");
+    bool has_finished = vi_run(program, output_file, TEST_MAX_STEPS);
+    fclose(output_file);
+    vm_free_class(program);
+
+    read_file(TEST_OUTPUT_NAME, output, TEST_OUTPUT_SIZE);
+    remove(TEST_OUTPUT_NAME);
+
+    return has_finished;
+}
+
+static void write_source(const char *source)
+{
+    FILE *file = fopen(TEST_JACK_NAME, "w");
+    fputs(source, file);
+    fclose(file);
+}
+
+static void read_file(const char *name, char *content, size_t size)
+{
+    FILE *file = fopen(name, "r");
+    size_t length = fread(content, 1, size - 1, file);
+    content[length] = '\0';
+    fclose(file);
+}
+
+static int count_occurrences(const char *text, const char *pattern)
+{
+    int count = 0;
+
+    for (const char *match = strstr(text, pattern); match != NULL; match = strstr(match + 1, pattern)) {
+        count++;
+    }
+
+    return count;
+}
+
+// Calls made to the function by the last run.
+static long os_calls(const char *name)
+{
+    VI_Stats stats = vi_stats();
+
+    for (int i = 0; i < stats.functions_count; i++) {
+        if (strcmp(stats.functions[i].name, name) == 0) {
+            return stats.functions[i].calls;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1 @@
+void test_code_gen();
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include "test.h"
+#include "test-file-handler.h"
+#include "../src/file-handler.h"
+
+#define TEST_FILES_COUNT    12
+#define TEST_LINES_COUNT    40000
+
+static void test_many_sinks();
+static void test_large_output();
+static void test_write_errors();
+static void test_file_name(char *name, int index);
+static long read_back(const char *name, char *content, size_t size);
+
+void test_file_handler()
+{
+    tst_suite_begin("File handler");
+
+    tst_unit("Many sinks", test_many_sinks);
+    tst_unit("Large output", test_large_output);
+    tst_unit("Write errors", test_write_errors);
+
+    tst_suite_finish();
+}
+
+// More files than the sinks table starts with are written at once,
+// each through its own sink.
+static void test_many_sinks()
+{
+    FILE *files[TEST_FILES_COUNT];
+    char name[64];
+
+    for (int i = 0; i < TEST_FILES_COUNT; i++) {
+        test_file_name(name, i);
+        files[i] = fh_open_file(name, true);
+    }
+
+    for (int i = 0; i < TEST_FILES_COUNT; i++) {
+        FH_Sink *sink = fh_sink(files[i]);
+
+        tst_true(fh_sink(files[i]) == sink);
+        fh_sink_indent(sink, 1);
+        fh_write("push constant ", files[i]);
+        fh_sink_int(sink, -i);
+        fh_write("\n", files[i]);
+    }
+
+    for (int i = 0; i < TEST_FILES_COUNT; i++) {
+        tst_true(fh_close_file(files[i]));
+    }
+
+    for (int i = 0; i < TEST_FILES_COUNT; i++) {
+        char content[64] = "";
+        char expected[64];
+
+        test_file_name(name, i);
+        read_back(name, content, sizeof(content));
+        sprintf(expected, "    push constant %d\n", -i);
+        tst_str_equals(content, expected);
+        remove(name);
+    }
+}
+
+// The output outgrows the sink's buffer, which is then flushed as
+// it goes.
+static void test_large_output()
+{
+    char name[64];
+    test_file_name(name, 0);
+
+    FILE *file = fh_open_file(name, true);
+    FH_Sink *sink = fh_sink(file);
+
+    for (int i = 0; i < TEST_LINES_COUNT; i++) {
+        fh_sink_write(sink, "function Main.main 0\n", strlen("function Main.main 0\n"));
+    }
+    tst_true(fh_close_file(file));
+
+    tst_int_equals(
+        read_back(name, NULL, 0),
+        TEST_LINES_COUNT * strlen("function Main.main 0\n")
+    );
+    remove(name);
+}
+
+static void test_write_errors()
+{
+    FILE *file = fh_open_file("/dev/full", true);
+
+    if (file == NULL) {
+        return;
+    }
+
+    fh_write("return\n", file);
+    tst_false(fh_close_file(file));
+}
+
+static void test_file_name(char *name, int index)
+{
+    sprintf(name, "file_handler_test_file_%d.vm", index);
+}
+
+// Returns the file's size, copying its start to content when given.
+static long read_back(const char *name, char *content, size_t size)
+{
+    FILE *file = fopen(name, "r");
+
+    if (content != NULL) {
+        fread(content, 1, size - 1, file);
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fclose(file);
+
+    return length;
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include "test.h"
+#include "test-hack-asm.h"
+#include "utils.h"
+#include "../src/file-handler.h"
+#include "../src/hack-asm.h"
+#include "../src/hack-cpu.h"
+
+#define TEST_FILE_NAME "hack_asm_test_file.asm"
+
+static void test_writing_program();
+static void test_running_program();
+
+void test_hack_asm()
+{
+    tst_suite_begin("Hack assembly");
+
+    tst_unit("Writing a program", test_writing_program);
+    tst_unit("Running a program", test_running_program);
+
+    tst_suite_finish();
+}
+
+static void test_writing_program()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 1);
+    int label = vm_make_label(class);
+
+    vm_append(function, (VM_Instruction){ VM_LABEL, 0, label, -1 });
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_LOCAL, 0, -1 });
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_CONSTANT, 1, -1 });
+    vm_append(function, (VM_Instruction){ VM_ADD, 0, 0, -1 });
+    vm_append(function, (VM_Instruction){ VM_POP, VM_SEGMENT_STATIC, 2, -1 });
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_STATIC, 2, -1 });
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_CONSTANT, 10, -1 });
+    vm_append(function, (VM_Instruction){ VM_LT, 0, 0, -1 });
+    vm_append(function, (VM_Instruction){ VM_IF_GOTO, 0, label, -1 });
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_CONSTANT, 0, -1 });
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1 });
+
+    VM_Class *classes[] = { class };
+
+    FILE *file = fh_open_file(TEST_FILE_NAME, true);
+    ha_write_program(file, classes, 1);
+    fh_close_file(file);
+    vm_free_class(class);
+
+    char content[4096] = "";
+    file = fopen(TEST_FILE_NAME, "r");
+    fread(content, 1, sizeof(content) - 1, file);
+    fclose(file);
+    remove(TEST_FILE_NAME);
+
+    // Without Sys.init the bootstrap calls Main.main directly.
+    tst_true(strstr(content, "@Main.main\nD=A\n@R13\nM=D\n") != NULL);
+
+    // The operands are folded into the operations, the value stays in
+    // D until stored and the comparison with a constant branches inline.
+    tst_true(strstr(
+        content,
+        "// function Main.main\n"
+        "(Main.main)\n"
+        "@SP\n"
+        "A=M\n"
+        "M=0\n"
+        "D=A+1\n"
+        "@SP\n"
+        "M=D\n"
+        "(Main$0)\n"
+        "@LCL\n"
+        "A=M\n"
+        "D=M\n"
+        "D=D+1\n"
+        "@Main.2\n"
+        "M=D\n"
+        "@Main.2\n"
+        "D=M\n"
+        "@Main$0\n"
+        "D;JLT\n"
+        "@10\n"
+        "D=D-A\n"
+        "@Main$0\n"
+        "D;JLT\n"
+        "D=0\n"
+        "@$return\n"
+        "0;JMP\n"
+    ) != NULL);
+
+    HA_Stats stats = ha_stats();
+    tst_int_equals(stats.functions, 1);
+}
+
+// Compares values of opposite signs, whose difference overflows, and
+// calls Main.sub, keeping its result in local 9, out of the reach of
+// the segment's fast path.
+static void test_running_program()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 10);
+
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 30000);
+    append_test_instruction(function, VM_NEG, 0, 0);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 30000);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 1);
+
+    VM_Opcode comparisons[] = { VM_LT, VM_GT };
+    for (int i = 0; i < 4; i++) {
+        append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, i / 2);
+        append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 1 - i / 2);
+        append_test_instruction(function, comparisons[i % 2], 0, 0);
+        append_test_instruction(function, VM_POP, VM_SEGMENT_TEMP, i);
+    }
+
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 7);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 5);
+    append_test_call(class, function, "Main.sub", 2);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 9);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 9);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 12);
+    append_test_call(class, function, "Main.sub", 2);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_TEMP, 4);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 9);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    function = vm_add_function(class, "sub", 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_ARGUMENT, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_ARGUMENT, 1);
+    append_test_instruction(function, VM_SUB, 0, 0);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    VM_Class *classes[] = { class };
+
+    FILE *file = fh_open_file(TEST_FILE_NAME, true);
+    ha_write_program(file, classes, 1);
+    fh_close_file(file);
+    vm_free_class(class);
+
+    file = fopen(TEST_FILE_NAME, "r");
+    tst_true(hc_run(file, 100000));
+    fclose(file);
+    remove(TEST_FILE_NAME);
+
+    // -30000 < 30000, -30000 > 30000, 30000 < -30000, 30000 > -30000.
+    tst_int_equals(hc_ram(5), -1);
+    tst_int_equals(hc_ram(6), 0);
+    tst_int_equals(hc_ram(7), 0);
+    tst_int_equals(hc_ram(8), -1);
+    tst_int_equals(hc_ram(9), 2 - 12);
+
+    // Main.main's frame follows the bootstrap's stack base, so its
+    // locals start at 261. Returns leave the result in D, and the
+    // stack back where the call found it.
+    tst_int_equals(hc_ram(261 + 9), 2);
+    tst_int_equals(hc_ram(0), 256);
+}
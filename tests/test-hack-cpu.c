@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <string.h>
+#include "test.h"
+#include "test-hack-cpu.h"
+#include "../src/hack-cpu.h"
+
+#define TEST_FILE_NAME "hack_cpu_test_file.asm"
+
+static void test_running_program();
+static void test_invalid_programs();
+static bool run_code(const char *code, long max_cycles);
+
+void test_hack_cpu()
+{
+    tst_suite_begin("Hack CPU");
+
+    tst_unit("Running a program", test_running_program);
+    tst_unit("Invalid programs", test_invalid_programs);
+
+    tst_suite_finish();
+}
+
+static void test_running_program()
+{
+    // Sums 1 to 10 into R0 in Main.sum, called from and returning to
+    // the bootstrap through R15.
+    bool has_halted = run_code(
+        "@END\n"
+        "D=A\n"
+        "@R15\n"
+        "M=D\n"
+        "@Main.sum\n"
+        "0;JMP\n"
+        "(END)\n"
+        "@END\n"
+        "0;JMP\n"
+        "(Main.sum)\n"
+        "@10\n"
+        "D=A\n"
+        "@i\n"
+        "M=D\n"
+        "@R0\n"
+        "M=0\n"
+        "(Main.sum$LOOP)\n"
+        "@i\n"
+        "D=M\n"
+        "@R0\n"
+        "M=D+M\n"
+        "@i\n"
+        "MD=M-1\n"
+        "@Main.sum$LOOP\n"
+        "D;JGT\n"
+        "@R15\n"
+        "A=M\n"
+        "0;JMP\n",
+        1000
+    );
+
+    tst_true(has_halted);
+    tst_int_equals(hc_ram(0), 55);
+    tst_int_equals(hc_ram(16), 0);
+
+    HC_Stats stats = hc_stats();
+
+    tst_int_equals(stats.rom_size, 25);
+    tst_int_equals(stats.cycles, 6 + 6 + 10 * 8 + 3);
+    tst_int_equals(stats.functions_count, 2);
+    tst_str_equals(stats.functions[0].name, "Main.sum");
+    tst_int_equals(stats.functions[0].calls, 1);
+    tst_int_equals(stats.functions[0].cycles, 6 + 10 * 8 + 3);
+    tst_str_equals(stats.functions[1].name, "(bootstrap)");
+}
+
+static void test_invalid_programs()
+{
+    tst_false(run_code("@1\nD=D*A\n", 1000));
+    tst_false(run_code("(LOOP)\n(LOOP)\n", 1000));
+
+    // Jumping back to a label isn't halting, only to the jump is.
+    tst_false(run_code("(LOOP)\nD=D+1\n@LOOP\n0;JMP\n", 1000));
+    tst_int_equals(hc_stats().cycles, 1000);
+}
+
+static bool run_code(const char *code, long max_cycles)
+{
+    FILE *file = fopen(TEST_FILE_NAME, "w");
+    fputs(code, file);
+    fclose(file);
+
+    file = fopen(TEST_FILE_NAME, "r");
+    bool has_halted = hc_run(file, max_cycles);
+    fclose(file);
+    remove(TEST_FILE_NAME);
+
+    return has_halted;
+}
@@ -1,14 +1,20 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
 #include "test.h"
 #include "test-id-table.h"
 #include "../src/id-table.h"
 
 void test_id_table_usage();
+void test_id_table_signatures();
+void test_id_table_concurrent_registry();
 
 void test_id_table()
 {
     tst_suite_begin("Id table");
     tst_unit("Identifier table usage", test_id_table_usage);
+    tst_unit("Class signatures", test_id_table_signatures);
+    tst_unit("Concurrent registry", test_id_table_concurrent_registry);
     tst_suite_finish();
 }
 
@@ -18,28 +24,132 @@ void test_id_table_usage()
 {
     IDT_Entry *entry = NULL;
 
-    idt_store("test", "some_func", 0, IDT_LOCAL);
-    entry = idt_entry("test", "some_func");
+    idt_store_var("Main$some_func$test", "int", 0, IDT_LOCAL);
+    entry = idt_entry("Main$some_func$test");
     tst_true(entry != NULL);
-    tst_true(entry->category == IDT_LOCAL);
-    tst_true(strcmp(entry->key, "test$some_func") == 0);
-    tst_true(strcmp(entry->id, "test") == 0);
+    tst_true(entry->var != NULL);
+    tst_true(entry->var->category == IDT_LOCAL);
+    tst_true(strcmp(entry->var->key, "Main$some_func$test") == 0);
+    tst_true(strcmp(entry->var->class_name, "int") == 0);
 
-    idt_store("tets", "func_some", 0, IDT_PARAM);
-    entry = idt_entry("tets", "func_some");
+    idt_store_var("Main$func_some$tets", "Array", 0, IDT_PARAM);
+    entry = idt_entry("Main$func_some$tets");
     tst_true(entry != NULL);
-    tst_true(entry->category == IDT_PARAM);
-    tst_true(strcmp(entry->key, "tets$func_some") == 0);
-    tst_true(strcmp(entry->id, "tets") == 0);
+    tst_true(entry->var->category == IDT_PARAM);
+    tst_true(strcmp(entry->var->key, "Main$func_some$tets") == 0);
+    tst_true(strcmp(entry->var->class_name, "Array") == 0);
     
-    idt_store("testing", "class", 1, IDT_FIELD);
-    entry = idt_entry("testing", "class");
+    idt_store_var("Main$$testing", "boolean", 1, IDT_FIELD);
+    entry = idt_entry("Main$$testing");
     tst_true(entry != NULL);
-    tst_true(entry->index == 1);
-    tst_true(entry->category == IDT_FIELD);
-    tst_true(strcmp(entry->key, "testing$class") == 0);
-    tst_true(strcmp(entry->id, "testing") == 0);
+    tst_true(entry->var->index == 1);
+    tst_true(entry->var->category == IDT_FIELD);
+    tst_true(strcmp(entry->var->key, "Main$$testing") == 0);
 
-    tst_true(idt_entry("asdf", "") == NULL);
+    tst_true(idt_entry("asdf") == NULL);
 }
 
+void test_id_table_signatures()
+{
+    IDT_Subroutine_Entry *subroutine = NULL;
+    IDT_Class_Entry *class = NULL;
+
+    idt_store_class("Point", 2, 1);
+    idt_store_subroutine("Point", "new", IDT_CONSTRUCTOR, 2, false);
+    idt_store_subroutine("Point", "draw", IDT_METHOD, 0, true);
+
+    class = idt_class("Point");
+    tst_true(class != NULL);
+    tst_int_equals(class->fields_count, 2);
+    tst_int_equals(class->statics_count, 1);
+
+    subroutine = idt_subroutine("Point", "new");
+    tst_true(subroutine != NULL);
+    tst_true(subroutine->kind == IDT_CONSTRUCTOR);
+    tst_int_equals(subroutine->params_count, 2);
+    tst_false(subroutine->is_void);
+    tst_true(strcmp(subroutine->key, "Point.new") == 0);
+
+    subroutine = idt_subroutine("Point", "draw");
+    tst_true(subroutine != NULL);
+    tst_true(subroutine->kind == IDT_METHOD);
+    tst_true(subroutine->is_void);
+
+    tst_true(idt_subroutine("Point", "erase") == NULL);
+    tst_true(idt_class("Point.draw") == NULL);
+    tst_true(idt_class("Circle") == NULL);
+
+    idt_store_os_signatures();
+    subroutine = idt_subroutine("Output", "printInt");
+    tst_true(subroutine != NULL);
+    tst_true(subroutine->kind == IDT_FUNCTION);
+    tst_int_equals(subroutine->params_count, 1);
+    tst_true(idt_class("Math") != NULL);
+}
+
+#define REGISTRY_CLASSES 200
+#define REGISTRY_READERS 4
+
+static char registry_names[REGISTRY_CLASSES][16];
+static atomic_bool is_registry_done;
+static atomic_int registry_failures;
+
+static void *read_registry(void *arg)
+{
+    while (!atomic_load(&is_registry_done)) {
+        for (int i = 0; i < REGISTRY_CLASSES; i++) {
+            IDT_Class_Entry *class = idt_class(registry_names[i]);
+
+            if (class == NULL) {
+                continue;
+            }
+
+            IDT_Subroutine_Entry *run = idt_subroutine(registry_names[i], "run");
+            IDT_Subroutine_Entry *stop = idt_subroutine(registry_names[i], "stop");
+
+            if (run == NULL || stop == NULL || run->params_count != class->fields_count) {
+                atomic_fetch_add(&registry_failures, 1);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void test_id_table_concurrent_registry()
+{
+    pthread_t readers[REGISTRY_READERS];
+
+    atomic_store(&is_registry_done, false);
+    atomic_store(&registry_failures, 0);
+
+    for (int i = 0; i < REGISTRY_CLASSES; i++) {
+        sprintf(registry_names[i], "Worker%d", i);
+    }
+
+    for (int i = 0; i < REGISTRY_READERS; i++) {
+        pthread_create(&readers[i], NULL, read_registry, NULL);
+    }
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < REGISTRY_CLASSES; i++) {
+            IDT_Subroutine_Entry subroutines[2] = {
+                { NULL, NULL, "run", IDT_METHOD, round, false },
+                { NULL, NULL, "stop", IDT_FUNCTION, 0, true }
+            };
+            idt_store_class_signatures(registry_names[i], round, 0, subroutines, 2);
+        }
+    }
+
+    atomic_store(&is_registry_done, true);
+    for (int i = 0; i < REGISTRY_READERS; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    tst_int_equals(atomic_load(&registry_failures), 0);
+
+    for (int i = 0; i < REGISTRY_CLASSES; i++) {
+        IDT_Subroutine_Entry *run = idt_subroutine(registry_names[i], "run");
+        tst_true(run != NULL && run->params_count == 2);
+    }
+}
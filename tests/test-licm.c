@@ -0,0 +1,82 @@
+#include "test.h"
+#include "test-licm.h"
+#include "utils.h"
+#include "../src/licm.h"
+
+static void test_licm_hoisting();
+static void test_licm_written_operands();
+static VM_Class *make_loop(VM_Segment step_segment);
+
+void test_licm()
+{
+    tst_suite_begin("LICM");
+
+    tst_unit("Hoisting", test_licm_hoisting);
+    tst_unit("Written operands", test_licm_written_operands);
+
+    tst_suite_finish();
+}
+
+static void test_licm_hoisting()
+{
+    VM_Class *class = make_loop(VM_SEGMENT_ARGUMENT);
+    VM_Function *function = &class->functions[0];
+
+    licm_hoist(class);
+
+    tst_int_equals(function->locals_count, 2);
+    tst_int_equals(function->count, 17);
+
+    // x + 1 is computed once, before the jump into the loop.
+    tst_true(function->instructions[0].segment == VM_SEGMENT_ARGUMENT);
+    tst_true(function->instructions[3].opcode == VM_POP);
+    tst_int_equals(function->instructions[3].operand, 1);
+    tst_true(function->instructions[4].opcode == VM_GOTO);
+    tst_true(function->instructions[7].opcode == VM_PUSH);
+    tst_true(function->instructions[7].segment == VM_SEGMENT_LOCAL);
+    tst_int_equals(function->instructions[7].operand, 1);
+    tst_true(function->instructions[8].opcode == VM_ADD);
+
+    vm_free_class(class);
+}
+
+static void test_licm_written_operands()
+{
+    VM_Class *class = make_loop(VM_SEGMENT_LOCAL);
+    VM_Function *function = &class->functions[0];
+
+    licm_hoist(class);
+
+    tst_int_equals(function->locals_count, 1);
+    tst_int_equals(function->count, 15);
+
+    vm_free_class(class);
+}
+
+// while (i < 10) { let i = i + (x + 1); } with x in the given segment,
+// rotated as code gen does.
+static VM_Class *make_loop(VM_Segment step_segment)
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 1);
+    int body = vm_make_label(class);
+    int test = vm_make_label(class);
+
+    append_test_instruction(function, VM_GOTO, 0, test);
+    append_test_instruction(function, VM_LABEL, 0, body);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_PUSH, step_segment, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 1);
+    append_test_instruction(function, VM_ADD, 0, 0);
+    append_test_instruction(function, VM_ADD, 0, 0);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_LABEL, 0, test);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 10);
+    append_test_instruction(function, VM_LT, 0, 0);
+    append_test_instruction(function, VM_IF_GOTO, 0, body);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 0);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    return class;
+}
@@ -0,0 +1,66 @@
+#include "test.h"
+#include "test-liveness.h"
+#include "utils.h"
+#include "../src/liveness.h"
+
+static void test_sharing_slots();
+static void test_keeping_live_slots();
+
+void test_liveness()
+{
+    tst_suite_begin("Liveness");
+
+    tst_unit("Sharing slots", test_sharing_slots);
+    tst_unit("Keeping live slots", test_keeping_live_slots);
+
+    tst_suite_finish();
+}
+
+// Local 0 is never used, locals 1 and 2 are never live together.
+static void test_sharing_slots()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 3);
+
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 1);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 1);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 1);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 2);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 2);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    lv_compact_locals(class);
+
+    tst_int_equals(function->locals_count, 1);
+    tst_int_equals(function->instructions[1].operand, 0);
+    tst_int_equals(function->instructions[3].operand, 0);
+    tst_int_equals(function->instructions[4].operand, 0);
+
+    vm_free_class(class);
+}
+
+// Local 0 is read before being written on every iteration of the
+// loop, so it stays live across it and can't share local 1's slot.
+static void test_keeping_live_slots()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 2);
+    int loop = vm_make_label(class);
+
+    append_test_instruction(function, VM_LABEL, 0, loop);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 1);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 1);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 1);
+    append_test_instruction(function, VM_IF_GOTO, 0, loop);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    lv_compact_locals(class);
+
+    tst_int_equals(function->locals_count, 2);
+    tst_int_equals(function->instructions[1].operand, 0);
+    tst_int_equals(function->instructions[2].operand, 1);
+
+    vm_free_class(class);
+}
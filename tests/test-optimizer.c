@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <string.h>
+#include "test.h"
+#include "test-optimizer.h"
+#include "utils.h"
+#include "../src/optimizer.h"
+#include "../src/parser.h"
+
+#define TEST_FILE_NAME "optimizer_test_file.jack"
+
+static FILE *test_file_handle = NULL;
+
+static void test_folding_constants();
+static void test_simplifying_identities();
+static void test_eliminating_dead_code();
+
+static Parser_expression let_value(LL_Node *statement_node);
+
+void test_optimizer()
+{
+    tst_suite_begin("AST optimizer");
+
+    tst_unit("Constant folding", test_folding_constants);
+    tst_unit("Identities", test_simplifying_identities);
+    tst_unit("Dead code", test_eliminating_dead_code);
+
+    tst_suite_finish();
+}
+
+static void test_folding_constants()
+{
+    test_file_handle = prepare_test_file(
+        TEST_FILE_NAME,
+        "class Foo {\n"
+        "  function int f() {\n"
+        "    let a = 2 * 3 + 4;\n"
+        "    let b = (1 - 3) * 5;\n"
+        "    let c = 32767 + 1;\n"
+        "    let d = x + 2 - 5;\n"
+        "    let e = 7 / 0;\n"
+        "    let f = 1 < 2;\n"
+        "  }\n"
+        "}"
+    );
+
+    Parser_jack_syntax ast = parser_parse(test_file_handle);
+    opt_fold_constants(&ast);
+
+    Parser_subroutine_dec subroutine = 
+        *(Parser_subroutine_dec *)ast.class_dec.subroutines.head->data;
+    LL_Node *node = subroutine.statements.head;
+    Parser_expression expr;
+    Parser_term term;
+
+    expr = let_value(node);
+    term = *(Parser_term *)expr.terms.head->data;
+    tst_int_equals(expr.terms.count, 1);
+    tst_str_equals(term.integer, "10");
+
+    node = node->next;
+    expr = let_value(node);
+    term = *(Parser_term *)expr.terms.head->data;
+    tst_int_equals(expr.terms.count, 1);
+    tst_true(term.sub_term != NULL);
+    tst_true(term.sub_term->unary_op == PARSER_TERM_OP_SUBTRACTION);
+    tst_str_equals(term.sub_term->term.integer, "10");
+
+    // -32768 can't be written as a Jack constant.
+    node = node->next;
+    expr = let_value(node);
+    tst_int_equals(expr.terms.count, 2);
+
+    node = node->next;
+    expr = let_value(node);
+    term = *(Parser_term *)expr.terms.tail->data;
+    tst_int_equals(expr.terms.count, 2);
+    tst_true(*(Parser_term_operator *)expr.operators.head->data == PARSER_TERM_OP_SUBTRACTION);
+    tst_str_equals(term.integer, "3");
+
+    node = node->next;
+    expr = let_value(node);
+    tst_int_equals(expr.terms.count, 2);
+
+    node = node->next;
+    expr = let_value(node);
+    term = *(Parser_term *)expr.terms.head->data;
+    tst_int_equals(expr.terms.count, 1);
+    tst_true(term.sub_term != NULL);
+    tst_str_equals(term.sub_term->term.integer, "1");
+
+    parser_free(ast);
+    erase_test_file(test_file_handle, TEST_FILE_NAME);
+}
+
+static void test_simplifying_identities()
+{
+    test_file_handle = prepare_test_file(
+        TEST_FILE_NAME,
+        "class Foo {\n"
+        "  function int f() {\n"
+        "    let a = x * 1 + 0 - 0;\n"
+        "    let b = ~~x;\n"
+        "    let c = 0 - x;\n"
+        "    let d = (x) & true;\n"
+        "  }\n"
+        "}"
+    );
+
+    Parser_jack_syntax ast = parser_parse(test_file_handle);
+    opt_fold_constants(&ast);
+
+    Parser_subroutine_dec subroutine = 
+        *(Parser_subroutine_dec *)ast.class_dec.subroutines.head->data;
+    LL_Node *node = subroutine.statements.head;
+    Parser_expression expr;
+    Parser_term term;
+
+    expr = let_value(node);
+    term = *(Parser_term *)expr.terms.head->data;
+    tst_int_equals(expr.terms.count, 1);
+    tst_str_equals(term.var_usage->var_name, "x");
+
+    node = node->next;
+    expr = let_value(node);
+    term = *(Parser_term *)expr.terms.head->data;
+    tst_int_equals(expr.terms.count, 1);
+    tst_str_equals(term.var_usage->var_name, "x");
+
+    node = node->next;
+    expr = let_value(node);
+    term = *(Parser_term *)expr.terms.head->data;
+    tst_int_equals(expr.terms.count, 1);
+    tst_true(term.sub_term->unary_op == PARSER_TERM_OP_SUBTRACTION);
+    tst_str_equals(term.sub_term->term.var_usage->var_name, "x");
+
+    node = node->next;
+    expr = let_value(node);
+    term = *(Parser_term *)expr.terms.head->data;
+    tst_int_equals(expr.terms.count, 1);
+    tst_str_equals(term.var_usage->var_name, "x");
+
+    parser_free(ast);
+    erase_test_file(test_file_handle, TEST_FILE_NAME);
+}
+
+static void test_eliminating_dead_code()
+{
+    test_file_handle = prepare_test_file(
+        TEST_FILE_NAME,
+        "class Foo {\n"
+        "  function int f() {\n"
+        "    if (true) { let a = 1; } else { let b = 2; }\n"
+        "    if (5) { let c = 3; } else { let d = 4; }\n"
+        "    while (false) { let e = 5; }\n"
+        "    if (x) { return 1; } else { return 2; }\n"
+        "    let f = 6;\n"
+        "  }\n"
+        "}"
+    );
+
+    Parser_jack_syntax ast = parser_parse(test_file_handle);
+    opt_eliminate_dead_code(&ast);
+
+    Parser_subroutine_dec subroutine = 
+        *(Parser_subroutine_dec *)ast.class_dec.subroutines.head->data;
+    LL_Node *node = subroutine.statements.head;
+    Parser_statement statement;
+
+    tst_int_equals(subroutine.statements.count, 3);
+
+    statement = *(Parser_statement *)node->data;
+    tst_str_equals(statement.let_statement->var_name, "a");
+
+    // Only true selects the then branch.
+    node = node->next;
+    statement = *(Parser_statement *)node->data;
+    tst_str_equals(statement.let_statement->var_name, "d");
+
+    node = node->next;
+    statement = *(Parser_statement *)node->data;
+    tst_true(statement.if_statement != NULL);
+    tst_true(node == subroutine.statements.tail);
+    tst_true(node->next == NULL);
+
+    parser_free(ast);
+    erase_test_file(test_file_handle, TEST_FILE_NAME);
+}
+
+static Parser_expression let_value(LL_Node *statement_node)
+{
+    Parser_statement statement = *(Parser_statement *)statement_node->data;
+    return statement.let_statement->value;
+}
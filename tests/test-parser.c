@@ -5,6 +5,7 @@
 #include "test-parser.h"
 #include "utils.h"
 #include "../src/parser.h"
+#include "../src/id-table.h"
 
 #define TEST_FILE_NAME "parser_test_file.jack"
 
@@ -15,6 +16,8 @@ void test_parsing_class_with_vars();
 void test_parsing_class_with_empty_funcs();
 void test_parsing_func_body_with_vars();
 void test_parsing_func_body_with_statements();
+void test_indexing_signatures();
+void test_statement_lines();
 
 void test_parser()
 {
@@ -25,6 +28,8 @@ void test_parser()
     tst_unit("Class with empty funcs", test_parsing_class_with_empty_funcs);
     tst_unit("Func body with vars", test_parsing_func_body_with_vars);
     tst_unit("Func body with statements", test_parsing_func_body_with_statements);
+    tst_unit("Signatures index", test_indexing_signatures);
+    tst_unit("Statement lines", test_statement_lines);
 
     tst_suite_finish();
 }
@@ -345,3 +350,105 @@ void test_parsing_func_body_with_statements()
     erase_test_file(test_file_handle, TEST_FILE_NAME);
 }
 
+
+void test_indexing_signatures()
+{
+    test_file_handle = prepare_test_file(
+        TEST_FILE_NAME, 
+        "class Shape {\n"
+        "  static int count;\n"
+        "  field int x, y;\n"
+        "  field boolean visible;\n"
+        "  constructor Shape new(int ax, int ay) {\n"
+        "    let x = ax;\n"
+        "    if (x > 0) { let y = ay; } else { let y = 0; }\n"
+        "    return this;\n"
+        "  }\n"
+        "  method void hide() {\n"
+        "    while (visible) { let visible = false; }\n"
+        "    return;\n"
+        "  }\n"
+        "  function int total() { return count; }\n"
+        "}"
+    );
+
+    parser_index_signatures(test_file_handle);
+
+    IDT_Class_Entry *class = idt_class("Shape");
+    tst_true(class != NULL);
+    tst_int_equals(class->fields_count, 3);
+    tst_int_equals(class->statics_count, 1);
+
+    IDT_Subroutine_Entry *subroutine = idt_subroutine("Shape", "new");
+    tst_true(subroutine != NULL);
+    tst_true(subroutine->kind == IDT_CONSTRUCTOR);
+    tst_int_equals(subroutine->params_count, 2);
+    tst_false(subroutine->is_void);
+
+    subroutine = idt_subroutine("Shape", "hide");
+    tst_true(subroutine != NULL);
+    tst_true(subroutine->kind == IDT_METHOD);
+    tst_int_equals(subroutine->params_count, 0);
+    tst_true(subroutine->is_void);
+
+    subroutine = idt_subroutine("Shape", "total");
+    tst_true(subroutine != NULL);
+    tst_true(subroutine->kind == IDT_FUNCTION);
+
+    tst_true(idt_entry(parser_unique_var_key("Shape", NULL, "x")) == NULL);
+
+    erase_test_file(test_file_handle, TEST_FILE_NAME);
+}
+
+void test_statement_lines()
+{
+    test_file_handle = prepare_test_file(
+        TEST_FILE_NAME, 
+        "class Main {\n"
+        "  function void main() {\n"
+        "    var int i;\n"
+        "    // Counting down.\n"
+        "    let i = 3;\n"
+        "\n"
+        "    while (i > 0) {\n"
+        "      let i = i - 1;\n"
+        "    }\n"
+        "    if (i) { let i = 1; } else {\n"
+        "      let i = 2;\n"
+        "    }\n"
+        "    return;\n"
+        "  }\n"
+        "}"
+    );
+
+    Parser_class_dec class = parser_parse(test_file_handle).class_dec;
+    Parser_subroutine_dec subroutine = *(Parser_subroutine_dec *)class.subroutines.head->data;
+    LL_Node *node = subroutine.statements.head;
+
+    tst_int_equals(((Parser_statement *)node->data)->line, 5);
+
+    node = node->next;
+    Parser_statement stmt = *(Parser_statement *)node->data;
+    tst_int_equals(stmt.line, 7);
+    tst_int_equals(
+        ((Parser_statement *)stmt.while_statement->statements.head->data)->line,
+        8
+    );
+
+    node = node->next;
+    stmt = *(Parser_statement *)node->data;
+    tst_int_equals(stmt.line, 10);
+    tst_int_equals(
+        ((Parser_statement *)stmt.if_statement->conditional_statements.head->data)->line,
+        10
+    );
+    tst_int_equals(
+        ((Parser_statement *)stmt.if_statement->else_statements.head->data)->line,
+        11
+    );
+
+    node = node->next;
+    tst_int_equals(((Parser_statement *)node->data)->line, 13);
+
+    erase_test_file(test_file_handle, TEST_FILE_NAME);
+}
@@ -0,0 +1,200 @@
+#include "test.h"
+#include "test-peephole.h"
+#include "../src/peephole.h"
+#include "../src/vm-ir.h"
+
+static void test_peephole_redundant_pairs();
+static void test_peephole_constant_branches();
+static void test_peephole_inverted_branch();
+static void test_peephole_that_pointer_reuse();
+static void append_address(VM_Function *function);
+
+static VM_Instruction push(VM_Segment segment, int index);
+static VM_Instruction pop(VM_Segment segment, int index);
+static VM_Instruction op(VM_Opcode opcode);
+static VM_Instruction jump(VM_Opcode opcode, int label);
+
+void test_peephole()
+{
+    tst_suite_begin("Peephole");
+
+    tst_unit("Redundant pairs", test_peephole_redundant_pairs);
+    tst_unit("Constant branches", test_peephole_constant_branches);
+    tst_unit("Inverted branch", test_peephole_inverted_branch);
+    tst_unit("Pointer 1 reuse", test_peephole_that_pointer_reuse);
+
+    tst_suite_finish();
+}
+
+static void test_peephole_redundant_pairs()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 1);
+
+    // let x = ~~x + 0; return x;
+    vm_append(function, push(VM_SEGMENT_LOCAL, 0));
+    vm_append(function, op(VM_NOT));
+    vm_append(function, op(VM_NOT));
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 0));
+    vm_append(function, op(VM_ADD));
+    vm_append(function, pop(VM_SEGMENT_LOCAL, 0));
+    vm_append(function, push(VM_SEGMENT_LOCAL, 0));
+    vm_append(function, op(VM_RETURN));
+
+    ph_optimize(class);
+
+    tst_int_equals(function->count, 2);
+    tst_true(function->instructions[0].opcode == VM_PUSH);
+    tst_true(function->instructions[0].segment == VM_SEGMENT_LOCAL);
+    tst_true(function->instructions[1].opcode == VM_RETURN);
+
+    vm_free_class(class);
+}
+
+static void test_peephole_constant_branches()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 0);
+    int start = vm_make_label(class);
+    int end = vm_make_label(class);
+
+    // while (true) { do Main.f(); } return;
+    vm_append(function, jump(VM_LABEL, start));
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 1));
+    vm_append(function, op(VM_NEG));
+    vm_append(function, op(VM_NOT));
+    vm_append(function, jump(VM_IF_GOTO, end));
+    vm_append(
+        function, 
+        (VM_Instruction){ VM_CALL, 0, 0, vm_symbol(class, "Main", "f") }
+    );
+    vm_append(function, pop(VM_SEGMENT_TEMP, 0));
+    vm_append(function, jump(VM_GOTO, start));
+    vm_append(function, jump(VM_LABEL, end));
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 0));
+    vm_append(function, op(VM_RETURN));
+
+    ph_optimize(class);
+
+    tst_int_equals(function->count, 4);
+    tst_true(function->instructions[0].opcode == VM_LABEL);
+    tst_true(function->instructions[1].opcode == VM_CALL);
+    tst_true(function->instructions[2].opcode == VM_POP);
+    tst_true(function->instructions[3].opcode == VM_GOTO);
+
+    vm_free_class(class);
+}
+
+static void test_peephole_inverted_branch()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 0);
+    int skip = vm_make_label(class);
+    int target = vm_make_label(class);
+
+    vm_append(function, jump(VM_LABEL, target));
+    vm_append(function, push(VM_SEGMENT_ARGUMENT, 0));
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 0));
+    vm_append(function, op(VM_GT));
+    vm_append(function, op(VM_NOT));
+    vm_append(function, jump(VM_IF_GOTO, skip));
+    vm_append(function, jump(VM_GOTO, target));
+    vm_append(function, jump(VM_LABEL, skip));
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 0));
+    vm_append(function, op(VM_RETURN));
+
+    ph_optimize(class);
+
+    tst_int_equals(function->count, 7);
+    tst_true(function->instructions[3].opcode == VM_GT);
+    tst_true(function->instructions[4].opcode == VM_IF_GOTO);
+    tst_int_equals(function->instructions[4].operand, target);
+    tst_true(function->instructions[5].opcode == VM_PUSH);
+
+    vm_free_class(class);
+
+    // Any value but true takes the jump after `not`, so a branch on
+    // a plain value keeps it.
+    class = vm_make_class("Main");
+    function = vm_add_function(class, "main", 0);
+    skip = vm_make_label(class);
+    target = vm_make_label(class);
+
+    vm_append(function, jump(VM_LABEL, target));
+    vm_append(function, push(VM_SEGMENT_ARGUMENT, 0));
+    vm_append(function, op(VM_NOT));
+    vm_append(function, jump(VM_IF_GOTO, skip));
+    vm_append(function, jump(VM_GOTO, target));
+    vm_append(function, jump(VM_LABEL, skip));
+    vm_append(function, op(VM_RETURN));
+
+    ph_optimize(class);
+
+    tst_int_equals(function->count, 7);
+
+    vm_free_class(class);
+}
+
+static void test_peephole_that_pointer_reuse()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 2);
+
+    // let a[i + 1] = a[i + 1] + 1; 
+    append_address(function);
+    vm_append(function, pop(VM_SEGMENT_POINTER, 1));
+    vm_append(function, push(VM_SEGMENT_THAT, 0));
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 1));
+    vm_append(function, op(VM_ADD));
+    append_address(function);
+    vm_append(function, pop(VM_SEGMENT_POINTER, 1));
+    vm_append(function, pop(VM_SEGMENT_THAT, 0));
+
+    // let i = 0; let a[i + 1] = 0;
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 0));
+    vm_append(function, pop(VM_SEGMENT_LOCAL, 1));
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 0));
+    append_address(function);
+    vm_append(function, pop(VM_SEGMENT_POINTER, 1));
+    vm_append(function, pop(VM_SEGMENT_THAT, 0));
+
+    ph_optimize(class);
+
+    // Only the address after i changed is computed again.
+    tst_int_equals(function->count, 20);
+    tst_true(function->instructions[9].opcode == VM_POP);
+    tst_true(function->instructions[9].segment == VM_SEGMENT_THAT);
+    tst_true(function->instructions[18].opcode == VM_POP);
+    tst_true(function->instructions[18].segment == VM_SEGMENT_POINTER);
+
+    vm_free_class(class);
+}
+
+static void append_address(VM_Function *function)
+{
+    vm_append(function, push(VM_SEGMENT_LOCAL, 0));
+    vm_append(function, push(VM_SEGMENT_LOCAL, 1));
+    vm_append(function, push(VM_SEGMENT_CONSTANT, 1));
+    vm_append(function, op(VM_ADD));
+    vm_append(function, op(VM_ADD));
+}
+
+static VM_Instruction push(VM_Segment segment, int index)
+{
+    return (VM_Instruction){ VM_PUSH, segment, index, -1 };
+}
+
+static VM_Instruction pop(VM_Segment segment, int index)
+{
+    return (VM_Instruction){ VM_POP, segment, index, -1 };
+}
+
+static VM_Instruction op(VM_Opcode opcode)
+{
+    return (VM_Instruction){ opcode, 0, 0, -1 };
+}
+
+static VM_Instruction jump(VM_Opcode opcode, int label)
+{
+    return (VM_Instruction){ opcode, 0, label, -1 };
+}
@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include "test.h"
+#include "test-pool.h"
+#include "../src/pool.h"
+
+static void test_pool_recycling();
+static void test_pool_high_water();
+static void test_pool_bulk_release();
+
+void test_pool()
+{
+    tst_suite_begin("Object pool");
+
+    tst_unit("Recycling", test_pool_recycling);
+    tst_unit("High water mark", test_pool_high_water);
+    tst_unit("Bulk release", test_pool_bulk_release);
+
+    tst_suite_finish();
+}
+
+typedef struct {
+    long a;
+    long b;
+    char c;
+} Test_object;
+
+static void test_pool_recycling()
+{
+    PL_Pool *pool = pl_make_typed_pool(Test_object);
+    tst_true(pool != NULL);
+
+    Test_object *first = pl_alloc(pool);
+    Test_object *second = pl_alloc(pool);
+    tst_true(first != second);
+    tst_true((uintptr_t)first % _Alignof(max_align_t) == 0);
+    tst_true((uintptr_t)second % _Alignof(max_align_t) == 0);
+
+    first->a = 1;
+    second->a = 2;
+    tst_int_equals(first->a, 1);
+
+    pl_free(pool, second);
+    tst_true(pl_alloc(pool) == second);
+
+    PL_Stats stats = pl_stats(pool);
+    tst_str_equals((char *)stats.name, "Test_object");
+    tst_true(stats.object_size >= sizeof(Test_object));
+    tst_int_equals(stats.chunks, 1);
+}
+
+static void test_pool_high_water()
+{
+    PL_Pool *pool = pl_make_pool("high_water", 8);
+    void *objects[100];
+
+    pl_enable_debug();
+
+    for (int i = 0; i < 100; i++) {
+        objects[i] = pl_alloc(pool);
+    }
+    for (int i = 0; i < 60; i++) {
+        pl_free(pool, objects[i]);
+    }
+    for (int i = 0; i < 10; i++) {
+        objects[i] = pl_alloc(pool);
+    }
+
+    PL_Stats stats = pl_stats(pool);
+    tst_int_equals(stats.allocations, 110);
+    tst_int_equals(stats.in_use, 50);
+    tst_int_equals(stats.high_water, 100);
+}
+
+static void test_pool_bulk_release()
+{
+    PL_Pool *pool = pl_make_pool("bulk_release", 4096);
+
+    for (int i = 0; i < 100; i++) {
+        pl_alloc(pool);
+    }
+    tst_true(pl_stats(pool).chunks > 1);
+
+    pl_release(pool);
+
+    PL_Stats stats = pl_stats(pool);
+    tst_int_equals(stats.chunks, 0);
+    tst_int_equals(stats.in_use, 0);
+
+    tst_true(pl_alloc(pool) != NULL);
+    tst_int_equals(pl_stats(pool).chunks, 1);
+}
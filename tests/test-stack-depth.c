@@ -0,0 +1,104 @@
+#include <string.h>
+#include "test.h"
+#include "test-stack-depth.h"
+#include "utils.h"
+#include "../src/stack-depth.h"
+
+static void test_operand_depth();
+static void test_call_chains();
+static SD_Function_stats *find(SD_Stats stats, const char *name);
+
+void test_stack_depth()
+{
+    tst_suite_begin("Stack depth");
+
+    tst_unit("Operand depth", test_operand_depth);
+    tst_unit("Call chains", test_call_chains);
+
+    tst_suite_finish();
+}
+
+static void test_operand_depth()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 1);
+    int loop = vm_make_label(class);
+    int exit = vm_make_label(class);
+
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 1);
+    append_test_instruction(function, VM_LABEL, 0, loop);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 2);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 3);
+    append_test_call(class, function, "Math.multiply", 2);
+    append_test_instruction(function, VM_ADD, 0, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_LOCAL, 0);
+    append_test_instruction(function, VM_IF_GOTO, 0, exit);
+    append_test_instruction(function, VM_GOTO, 0, loop);
+    append_test_instruction(function, VM_LABEL, 0, exit);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    tst_int_equals(sd_max_depth(function), 3);
+
+    vm_free_class(class);
+}
+
+static void test_call_chains()
+{
+    VM_Class *main_class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(main_class, "main", 2);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 1);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_CONSTANT, 2);
+    append_test_call(main_class, function, "Util.sum", 2);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    VM_Class *util_class = vm_make_class("Util");
+    function = vm_add_function(util_class, "sum", 1);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_ARGUMENT, 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_ARGUMENT, 1);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_ARGUMENT, 0);
+    append_test_call(util_class, function, "Output.printInt", 1);
+    append_test_instruction(function, VM_POP, VM_SEGMENT_TEMP, 0);
+    append_test_instruction(function, VM_ADD, 0, 0);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    function = vm_add_function(util_class, "recurse", 0);
+    append_test_instruction(function, VM_PUSH, VM_SEGMENT_ARGUMENT, 0);
+    append_test_call(util_class, function, "Util.recurse", 1);
+    append_test_instruction(function, VM_RETURN, 0, 0);
+
+    sd_analyze(main_class);
+    sd_analyze(util_class);
+
+    SD_Stats stats = sd_stats();
+    SD_Function_stats *sum = find(stats, "Util.sum");
+    SD_Function_stats *recurse = find(stats, "Util.recurse");
+
+    tst_true(sum != NULL);
+    tst_int_equals(sum->max_depth, 3);
+    tst_int_equals(sum->chain_depth, SD_FRAME_SIZE + 1 + 3 + SD_FRAME_SIZE);
+    tst_true(sum->calls_unknown);
+    tst_false(sum->is_recursive);
+
+    tst_true(recurse != NULL);
+    tst_int_equals(recurse->chain_depth, SD_FRAME_SIZE + 1);
+    tst_true(recurse->is_recursive);
+
+    tst_true(stats.entry != NULL);
+    tst_str_equals(stats.entry->name, "Main.main");
+    tst_int_equals(stats.entry->chain_depth, SD_FRAME_SIZE + 2 + 2 + sum->chain_depth);
+    tst_true(stats.entry->calls_unknown);
+
+    vm_free_class(main_class);
+    vm_free_class(util_class);
+}
+
+static SD_Function_stats *find(SD_Stats stats, const char *name)
+{
+    for (int i = 0; i < stats.functions_count; i++) {
+        if (strcmp(stats.functions[i].name, name) == 0) {
+            return &stats.functions[i];
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1 @@
+void test_stack_depth();
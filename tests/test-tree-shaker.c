@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include "test.h"
+#include "test-tree-shaker.h"
+#include "utils.h"
+#include "../src/file-handler.h"
+#include "../src/tree-shaker.h"
+
+#define TEST_FILE_NAME "tree_shaker_test_file.vm"
+
+static void test_removing_unreachable_functions();
+
+void test_tree_shaker()
+{
+    tst_suite_begin("Tree shaker");
+
+    tst_unit("Unreachable functions", test_removing_unreachable_functions);
+
+    tst_suite_finish();
+}
+
+static void test_removing_unreachable_functions()
+{
+    VM_Class *main_class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(main_class, "main", 0);
+    append_test_call(main_class, function, "Util.used", 0);
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1 });
+
+    VM_Class *util_class = vm_make_class("Util");
+    function = vm_add_function(util_class, "unused", 0);
+    append_test_call(util_class, function, "Util.used", 0);
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1 });
+    function = vm_add_function(util_class, "used", 0);
+    append_test_call(util_class, function, "Util.nested", 0);
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1 });
+    function = vm_add_function(util_class, "nested", 0);
+    append_test_call(util_class, function, "Util.nested", 0);
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1 });
+
+    VM_Class *dead_class = vm_make_class("Dead");
+    function = vm_add_function(dead_class, "f", 0);
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1 });
+
+    VM_Class *classes[] = { main_class, util_class, dead_class };
+    ts_shake(classes, 3);
+
+    tst_int_equals(dead_class->functions_count, 0);
+
+    FILE *file = fh_open_file(TEST_FILE_NAME, true);
+    vm_write_class(file, main_class);
+    vm_write_class(file, util_class);
+    fh_close_file(file);
+
+    char content[512] = "";
+    file = fopen(TEST_FILE_NAME, "r");
+    fread(content, 1, sizeof(content) - 1, file);
+    fclose(file);
+    remove(TEST_FILE_NAME);
+
+    tst_str_equals(
+        content,
+        "// compiled Main.jack\n"
+        "function Main.main 0\n"
+        "    call Util.used 0\n"
+        "    return\n"
+        "// compiled Util.jack\n"
+        "function Util.used 0\n"
+        "    call Util.nested 0\n"
+        "    return\n"
+        "function Util.nested 0\n"
+        "    call Util.nested 0\n"
+        "    return\n"
+    );
+
+    TS_Stats stats = ts_stats();
+    tst_int_equals(stats.functions, 5);
+    tst_int_equals(stats.removed_functions, 2);
+    tst_int_equals(stats.removed_instructions, 3);
+
+    for (int i = 0; i < 3; i++) {
+        vm_free_class(classes[i]);
+    }
+}
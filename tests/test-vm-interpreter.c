@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include "test.h"
+#include "test-vm-interpreter.h"
+#include "../src/vm-interpreter.h"
+
+#define TEST_FILE_NAME "vm_interpreter_test_file.vm"
+#define TEST_OUTPUT_NAME "vm_interpreter_test_output.txt"
+
+static void test_running_program();
+static void test_runtime_errors();
+static bool run_code(const char *code, char *output, size_t output_size);
+
+void test_vm_interpreter()
+{
+    tst_suite_begin("VM interpreter");
+
+    tst_unit("Running a program", test_running_program);
+    tst_unit("Runtime errors", test_runtime_errors);
+
+    tst_suite_finish();
+}
+
+static void test_running_program()
+{
+    char output[256] = "";
+    bool has_finished = run_code(
+        "function Main.fact 0\n"
+        "    push argument 0\n"
+        "    push constant 2\n"
+        "    lt\n"
+        "    if-goto BASE\n"
+        "    push argument 0\n"
+        "    push argument 0\n"
+        "    push constant 1\n"
+        "    sub\n"
+        "    call Main.fact 1\n"
+        "    call Math.multiply 2\n"
+        "    return\n"
+        "    label BASE\n"
+        "    push constant 1\n"
+        "    return\n"
+        "function Main.main 1\n"
+        "    push constant 5\n"
+        "    call Main.fact 1\n"
+        "    pop local 0\n"
+        "    push local 0\n"
+        "    call Output.printInt 1\n"
+        "    pop temp 0\n"
+        "    push constant 2\n"
+        "    call String.new 1\n"
+        "    push constant 79\n"
+        "    call String.appendChar 2\n"
+        "    push constant 75\n"
+        "    call String.appendChar 2\n"
+        "    call Output.printString 1\n"
+        "    pop temp 0\n"
+        "    push constant 0\n"
+        "    return\n",
+        output,
+        sizeof(output)
+    );
+
+    tst_true(has_finished);
+    tst_str_equals(output, "120OK");
+
+    VI_Stats stats = vi_stats();
+
+    // Entering a function counts as one instruction: fact(1) runs 7,
+    // the 4 other calls 12 each.
+    tst_int_equals(stats.instructions, 55 + 17);
+    tst_int_equals(stats.os_calls, 9);
+    tst_str_equals(stats.functions[0].name, "Main.fact");
+    tst_int_equals(stats.functions[0].calls, 5);
+    tst_int_equals(stats.functions[0].instructions, 55);
+    tst_str_equals(stats.functions[1].name, "Main.main");
+    tst_int_equals(stats.functions[1].instructions, 17);
+    tst_true(stats.functions[2].is_os);
+}
+
+static void test_runtime_errors()
+{
+    char output[256] = "";
+
+    tst_false(run_code(
+        "function Main.main 0\n"
+        "    push constant 1\n"
+        "    push constant 0\n"
+        "    call Math.divide 2\n"
+        "    return\n",
+        output,
+        sizeof(output)
+    ));
+
+    tst_false(run_code(
+        "function Main.main 0\n"
+        "    label LOOP\n"
+        "    goto LOOP\n",
+        output,
+        sizeof(output)
+    ));
+
+    tst_false(run_code(
+        "function Main.main 0\n"
+        "    call Main.main 0\n"
+        "    return\n",
+        output,
+        sizeof(output)
+    ));
+}
+
+static bool run_code(const char *code, char *output, size_t output_size)
+{
+    FILE *file = fopen(TEST_FILE_NAME, "w");
+    fputs(code, file);
+    fclose(file);
+
+    file = fopen(TEST_FILE_NAME, "r");
+    VM_Class *program = vm_read_class(file, "Program");
+    fclose(file);
+    remove(TEST_FILE_NAME);
+
+    FILE *output_file = fopen(TEST_OUTPUT_NAME, "w");
+    bool has_finished = vi_run(program, output_file, 1000);
+    fclose(output_file);
+    vm_free_class(program);
+
+    output_file = fopen(TEST_OUTPUT_NAME, "r");
+    size_t length = fread(output, 1, output_size - 1, output_file);
+    output[length] = '\0';
+    fclose(output_file);
+    remove(TEST_OUTPUT_NAME);
+
+    return has_finished;
+}
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h>
+#include "test.h"
+#include "test-vm-ir.h"
+#include "../src/file-handler.h"
+#include "../src/vm-ir.h"
+
+#define TEST_FILE_NAME "vm_ir_test_file.vm"
+
+static void test_vm_ir_symbols();
+static void test_vm_ir_writing();
+static void test_vm_ir_reading();
+static void test_vm_ir_line_map();
+
+void test_vm_ir()
+{
+    tst_suite_begin("VM IR");
+
+    tst_unit("Symbols", test_vm_ir_symbols);
+    tst_unit("Writing", test_vm_ir_writing);
+    tst_unit("Reading", test_vm_ir_reading);
+    tst_unit("Line map", test_vm_ir_line_map);
+
+    tst_suite_finish();
+}
+
+static void test_vm_ir_symbols()
+{
+    VM_Class *class = vm_make_class("Main");
+    char name[16];
+
+    int first = vm_symbol(class, "Math", "multiply");
+    tst_int_equals(vm_symbol(class, "Math", "multiply"), first);
+    tst_true(vm_symbol(class, "Math", "divide") != first);
+    tst_true(vm_symbol(class, "Mat", "hmultiply") != first);
+
+    for (int i = 0; i < 100; i++) {
+        sprintf(name, "f%d", i);
+        vm_symbol(class, "Main", name);
+    }
+
+    tst_int_equals(class->symbols_count, 103);
+    tst_int_equals(vm_symbol(class, "Math", "multiply"), first);
+    tst_int_equals(vm_symbol(class, "Main", "f42"), 45);
+    tst_str_equals(class->symbols[45], "Main.f42");
+
+    vm_free_class(class);
+}
+
+static void test_vm_ir_writing()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 1);
+    int label = vm_make_label(class);
+
+    vm_append(function, (VM_Instruction){ VM_LABEL, 0, label, -1 });
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_CONSTANT, 7, -1 });
+    vm_append(
+        function, 
+        (VM_Instruction){ VM_CALL, 0, 1, vm_symbol(class, "Output", "printInt") }
+    );
+    vm_append(function, (VM_Instruction){ VM_POP, VM_SEGMENT_TEMP, 0, -1 });
+    vm_append(function, (VM_Instruction){ VM_GOTO, 0, label, -1 });
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1 });
+
+    FILE *file = fh_open_file(TEST_FILE_NAME, true);
+    vm_write_class(file, class);
+    fh_close_file(file);
+    vm_free_class(class);
+
+    char content[512] = "";
+    file = fopen(TEST_FILE_NAME, "r");
+    fread(content, 1, sizeof(content) - 1, file);
+    fclose(file);
+    remove(TEST_FILE_NAME);
+
+    tst_str_equals(
+        content,
+        "// compiled Main.jack\n"
+        "function Main.main 1\n"
+        "    label Main_0\n"
+        "    push constant 7\n"
+        "    call Output.printInt 1\n"
+        "    pop temp 0\n"
+        "    goto Main_0\n"
+        "    return\n"
+    );
+}
+
+static void test_vm_ir_reading()
+{
+    FILE *file = fopen(TEST_FILE_NAME, "w");
+    fputs(
+        "// Math library\n"
+        "function Math.abs 0\n"
+        "  push argument 0\n"
+        "  push constant 0\n"
+        "  lt\n"
+        "  if-goto NEGATIVE   // comment\n"
+        "  push argument 0\n"
+        "  return\n"
+        "label NEGATIVE\n"
+        "  push argument 0\n"
+        "  neg\n"
+        "  return\n"
+        "\n"
+        "function Math.max 0\n"
+        "label NEGATIVE\n"
+        "  push argument 1\n"
+        "  call Math.abs 1\n"
+        "  return\n",
+        file
+    );
+    fclose(file);
+
+    file = fopen(TEST_FILE_NAME, "r");
+    VM_Class *class = vm_read_class(file, "Math");
+    fclose(file);
+
+    tst_true(class != NULL);
+    tst_int_equals(class->functions_count, 2);
+    tst_int_equals(class->labels_count, 2);
+
+    file = fh_open_file(TEST_FILE_NAME, true);
+    vm_write_class(file, class);
+    fh_close_file(file);
+    vm_free_class(class);
+
+    char content[512] = "";
+    file = fopen(TEST_FILE_NAME, "r");
+    fread(content, 1, sizeof(content) - 1, file);
+    fclose(file);
+
+    // Labels are scoped by function.
+    tst_str_equals(
+        content,
+        "// compiled Math.jack\n"
+        "function Math.abs 0\n"
+        "    push argument 0\n"
+        "    push constant 0\n"
+        "    lt\n"
+        "    if-goto Math_0\n"
+        "    push argument 0\n"
+        "    return\n"
+        "    label Math_0\n"
+        "    push argument 0\n"
+        "    neg\n"
+        "    return\n"
+        "function Math.max 0\n"
+        "    label Math_1\n"
+        "    push argument 1\n"
+        "    call Math.abs 1\n"
+        "    return\n"
+    );
+
+    file = fopen(TEST_FILE_NAME, "w");
+    fputs("function Math.abs 0\n  push nowhere 0\n", file);
+    fclose(file);
+
+    file = fopen(TEST_FILE_NAME, "r");
+    tst_true(vm_read_class(file, "Math") == NULL);
+    fclose(file);
+    remove(TEST_FILE_NAME);
+}
+
+static void test_vm_ir_line_map()
+{
+    VM_Class *class = vm_make_class("Main");
+    VM_Function *function = vm_add_function(class, "main", 0);
+
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_CONSTANT, 7, -1, 3 });
+    vm_append(function, (VM_Instruction){ VM_POP, VM_SEGMENT_STATIC, 0, -1, 3 });
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_CONSTANT, 0, -1, 4 });
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1, 4 });
+
+    function = vm_add_function(class, "other", 0);
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_ARGUMENT, 0, -1, 0 });
+    vm_append(function, (VM_Instruction){ VM_POP, VM_SEGMENT_POINTER, 0, -1, 0 });
+    vm_append(function, (VM_Instruction){ VM_PUSH, VM_SEGMENT_CONSTANT, 0, -1, 9 });
+    vm_append(function, (VM_Instruction){ VM_RETURN, 0, 0, -1, 10 });
+
+    FILE *file = fh_open_file(TEST_FILE_NAME, true);
+    tst_int_equals(vm_write_line_map(file, class, 5), 11);
+    fh_close_file(file);
+
+    char content[512] = "";
+    file = fopen(TEST_FILE_NAME, "r");
+    fread(content, 1, sizeof(content) - 1, file);
+    fclose(file);
+    remove(TEST_FILE_NAME);
+
+    tst_str_equals(
+        content,
+        "7-8 Main.jack:3\n"
+        "9-10 Main.jack:4\n"
+        "14 Main.jack:9\n"
+        "15 Main.jack:10\n"
+    );
+
+    tst_true(vm_same_code(class->functions[0].instructions + 2, function->instructions + 2, 2));
+    tst_false(vm_same_code(class->functions[0].instructions, function->instructions, 1));
+
+    vm_free_class(class);
+}
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "utils.h"
 
 FILE *prepare_test_file(const char *file_name, const char *file_content)
@@ -23,3 +24,19 @@ void erase_test_file(FILE *file_handle, const char *file_name)
     remove(file_name);
 }
 
+void append_test_instruction(VM_Function *function, VM_Opcode opcode, VM_Segment segment, int operand)
+{
+    vm_append(function, (VM_Instruction){ opcode, segment, operand, -1 });
+}
+
+void append_test_call(VM_Class *class, VM_Function *function, const char *callee, int args_count)
+{
+    const char *dot = strchr(callee, '.');
+    char class_name[64] = "";
+
+    strncat(class_name, callee, dot - callee);
+    vm_append(
+        function,
+        (VM_Instruction){ VM_CALL, 0, args_count, vm_symbol(class, class_name, dot + 1) }
+    );
+}
@@ -3,8 +3,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include "../src/vm-ir.h"
 
 FILE *prepare_test_file(const char *file_name, const char *file_content);
 void erase_test_file(FILE *file_handle, const char *file_name);
 
+// Appends an instruction that calls nothing, for building test IR.
+void append_test_instruction(VM_Function *function, VM_Opcode opcode, VM_Segment segment, int operand);
+
+// Appends a call to the function named "Class.name".
+void append_test_call(VM_Class *class, VM_Function *function, const char *callee, int args_count);
+
 #endif